@@ -0,0 +1,469 @@
+/*
+ * bench.c: Timing the lookup, search, and conversion functions.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include "data.h"
+#include "lookup.h"
+#include "convert.h"
+
+/* This program times the functions of the ubrowse library, each over
+ * a fixed number of operations. Every benchmark is run for several
+ * trials after an untimed warm-up, and the mean, standard deviation,
+ * and minimum time per operation are reported. The inputs are
+ * generated from a fixed seed, so that every run does the same work.
+ * The results are written to a file, which can be compared against
+ * the results from an earlier build. The rendering of the table is
+ * timed separately, by vtbench.
+ */
+
+/* The number of precomputed inputs that the benchmarks cycle through.
+ */
+enum { inputcount = 4096 };
+
+/* A benchmark. The run function carries out the given number of
+ * operations and returns a value derived from the results, so that
+ * the work cannot be optimized away.
+ */
+typedef struct benchmark {
+    char const *name;		/* the benchmark's name */
+    long (*run)(long ops);	/* the function that does the work */
+    long ops;			/* the number of operations per trial */
+} benchmark;
+
+/* The results of a benchmark.
+ */
+typedef struct result {
+    char name[32];
+    long ops;
+    int trials;
+    double mean, stddev, min;	/* nanoseconds per operation */
+} result;
+
+/* The precomputed inputs: codepoint values, charlist indexes, and
+ * search strings taken from the names of randomly chosen characters.
+ */
+static unsigned int inputuchars[inputcount];
+static int inputindexes[inputcount];
+static char inputnames[inputcount][8];
+
+/* Text for the conversion benchmarks: pure ASCII, and words in a
+ * mixture of Latin, Cyrillic, CJK, and emoji, with the space to
+ * convert it.
+ */
+enum { textsize = 65536 };
+static unsigned char asciitext[textsize];
+static unsigned char mixedtext[textsize];
+static unsigned char convertedtext[textsize * CONVERT_MAXGROWTH];
+
+/* The state of the random-number generator.
+ */
+static unsigned long randomstate = 2463534242UL;
+
+/* Return a pseudo-random number between 0 and 2^32 - 1, using a
+ * xorshift generator so that the sequence is the same everywhere.
+ */
+static unsigned long nextrandom(void)
+{
+    randomstate ^= (randomstate << 13) & 0xFFFFFFFFUL;
+    randomstate ^= randomstate >> 17;
+    randomstate ^= (randomstate << 5) & 0xFFFFFFFFUL;
+    return randomstate;
+}
+
+/* Fill in the arrays of inputs.
+ */
+static void inputsinit(void)
+{
+    char const *name;
+    int i, j, n, size;
+
+    for (i = 0 ; i < inputcount ; ++i) {
+	inputuchars[i] = nextrandom() % (lastucharval + 1);
+	inputindexes[i] = nextrandom() % charlistsize;
+	do {
+	    n = nextrandom() % charlistsize;
+	    size = charlist[n].namesize;
+	} while (size < (int)sizeof *inputnames);
+	name = charnamebuffer + charlist[n].nameoffset;
+	n = nextrandom() % (size - sizeof *inputnames + 2);
+	memcpy(inputnames[i], name + n, sizeof *inputnames - 1);
+	inputnames[i][sizeof *inputnames - 1] = '\0';
+    }
+
+    for (i = 0 ; i < textsize ; ++i)
+	asciitext[i] = 'a' + nextrandom() % 26;
+    i = 0;
+    while (i < textsize - 40) {
+	n = nextrandom() % 20;
+	size = 2 + nextrandom() % 7;
+	for (j = 0 ; j < size ; ++j) {
+	    if (n < 12)
+		mixedtext[i++] = 'a' + nextrandom() % 26;
+	    else if (n < 17)
+		i += encodeutf8(0x0430 + nextrandom() % 32, mixedtext + i);
+	    else if (n < 19)
+		i += encodeutf8(0x4E00 + nextrandom() % 0x5000, mixedtext + i);
+	    else
+		i += encodeutf8(0x1F600 + nextrandom() % 0x50, mixedtext + i);
+	}
+	mixedtext[i++] = ' ';
+    }
+    while (i < textsize)
+	mixedtext[i++] = ' ';
+}
+
+/* Return the current time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Build the index of the names, exiting if there is not enough
+ * memory for it.
+ */
+static void buildnameindex(void)
+{
+    if (!nameindexinit()) {
+	fputs("microbench: out of memory\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * The benchmarks.
+ */
+
+/* Look up random codepoint values.
+ */
+static long runlookupchar(long ops)
+{
+    long i, sum = 0;
+
+    for (i = 0 ; i < ops ; ++i)
+	sum += lookupchar(inputuchars[i % inputcount]);
+    return sum;
+}
+
+/* Move forwards and backwards from random positions by U+1000.
+ */
+static long runoffsetchar(long ops)
+{
+    long i, sum = 0;
+
+    for (i = 0 ; i < ops ; ++i)
+	sum += lookupchar(charlist[inputindexes[i % inputcount]].uchar
+			  + (i & 1 ? -0x1000 : +0x1000));
+    return sum;
+}
+
+/* Look up random codepoint values in the direct lookup table.
+ */
+static long runcharindex(long ops)
+{
+    long i, sum = 0;
+
+    for (i = 0 ; i < ops ; ++i)
+	sum += charindex(inputuchars[i % inputcount]);
+    return sum;
+}
+
+/* Search for substrings of names from random starting positions.
+ */
+static long runsearchhit(long ops)
+{
+    namesearch search;
+    long i, sum = 0;
+
+    for (i = 0 ; i < ops ; ++i) {
+	namesearchinit(&search, inputnames[i % inputcount]);
+	sum += findcharbyname(&search, inputindexes[i % inputcount], +1);
+    }
+    return sum;
+}
+
+/* Search for a string that appears in no name, so that every name
+ * is examined.
+ */
+static long runsearchmiss(long ops)
+{
+    namesearch search;
+    long i, sum = 0;
+
+    namesearchinit(&search, "QXZQ");
+    for (i = 0 ; i < ops ; ++i)
+	sum += findcharbyname(&search, inputindexes[i % inputcount], +1);
+    return sum;
+}
+
+/* Search for substrings of names as above, using the index of the
+ * names. The index is built by the first call, so these benchmarks
+ * must come after the ones that scan.
+ */
+static long runindexedhit(long ops)
+{
+    buildnameindex();
+    return runsearchhit(ops);
+}
+
+/* Search for a string that appears in no name, using the index.
+ */
+static long runindexedmiss(long ops)
+{
+    buildnameindex();
+    return runsearchmiss(ops);
+}
+
+/* Find all of the empty blocks in the block list.
+ */
+static long runemptyblocks(long ops)
+{
+    long i, sum = 0;
+    int n;
+
+    for (i = 0 ; i < ops ; ++i)
+	for (n = 0 ; n < blocklistsize ; ++n)
+	    sum += isemptyblock(n);
+    return sum;
+}
+
+/* Convert text to the given encoding, ops bytes in all. Each byte of
+ * input counts as one operation, so that ops/sec is the throughput.
+ */
+static long runconversion(unsigned char const *text, int encoding, long ops)
+{
+    long done, size, used, sum = 0;
+
+    for (done = 0 ; done < ops ; done += size) {
+	size = ops - done < textsize ? ops - done : textsize;
+	sum += convertutf8(text, size, 1, encoding, convertedtext, &used);
+    }
+    return sum;
+}
+
+/* Convert ASCII text to UTF-8, UTF-16, and UTF-32.
+ */
+static long runconvertascii8(long ops)
+{
+    return runconversion(asciitext, CONVERT_UTF8, ops);
+}
+static long runconvertascii16(long ops)
+{
+    return runconversion(asciitext, CONVERT_UTF16LE, ops);
+}
+static long runconvertascii32(long ops)
+{
+    return runconversion(asciitext, CONVERT_UTF32LE, ops);
+}
+
+/* Convert mixed text to UTF-8, UTF-16, and C escapes.
+ */
+static long runconvertmixed8(long ops)
+{
+    return runconversion(mixedtext, CONVERT_UTF8, ops);
+}
+static long runconvertmixed16(long ops)
+{
+    return runconversion(mixedtext, CONVERT_UTF16LE, ops);
+}
+static long runconvertmixedc(long ops)
+{
+    return runconversion(mixedtext, CONVERT_C, ops);
+}
+
+/* The list of benchmarks.
+ */
+static benchmark const benchmarks[] = {
+    { "lookupchar", runlookupchar, 1000000 },
+    { "offsetchar", runoffsetchar, 500000 },
+    { "charindex", runcharindex, 1000000 },
+    { "findcharbyname-hit", runsearchhit, 200 },
+    { "findcharbyname-miss", runsearchmiss, 50 },
+    { "nameindex-hit", runindexedhit, 20000 },
+    { "nameindex-miss", runindexedmiss, 200000 },
+    { "emptyblocks", runemptyblocks, 5000 },
+    { "convert-ascii-utf8", runconvertascii8, 50000000 },
+    { "convert-ascii-utf16", runconvertascii16, 50000000 },
+    { "convert-ascii-utf32", runconvertascii32, 50000000 },
+    { "convert-mixed-utf8", runconvertmixed8, 20000000 },
+    { "convert-mixed-utf16", runconvertmixed16, 20000000 },
+    { "convert-mixed-c", runconvertmixedc, 20000000 }
+};
+
+/* The value returned by the benchmarks, accumulated so that their
+ * work is not optimized away.
+ */
+static volatile long sink;
+
+/* Run a benchmark for the given number of trials, after an untimed
+ * warm-up trial, and compute the statistics of the time per operation.
+ */
+static void runbenchmark(benchmark const *bench, int trials, result *res)
+{
+    double start, t, sum, sumsq;
+    int i;
+
+    sprintf(res->name, "%.31s", bench->name);
+    res->ops = bench->ops;
+    res->trials = trials;
+    sink += bench->run(bench->ops);
+    sum = sumsq = 0.0;
+    res->min = 0.0;
+    for (i = 0 ; i < trials ; ++i) {
+	start = now();
+	sink += bench->run(bench->ops);
+	t = (now() - start) * 1e9 / bench->ops;
+	sum += t;
+	sumsq += t * t;
+	if (i == 0 || t < res->min)
+	    res->min = t;
+    }
+    res->mean = sum / trials;
+    res->stddev = trials > 1 ?
+	sqrt((sumsq - sum * sum / trials) / (trials - 1)) : 0.0;
+}
+
+/* The heading line of the results file.
+ */
+static char const resultsheading[] =
+    "benchmark\tops\ttrials\tns_per_op\tns_stddev\tns_min\tops_per_sec\n";
+
+/* Read the results from an earlier run. The return value is the
+ * number of results read, or -1 if the file could not be read.
+ */
+static int readresults(char const *filename, result *results, int count)
+{
+    char line[256];
+    FILE *fp;
+    int n;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+	return -1;
+    n = 0;
+    while (n < count && fgets(line, sizeof line, fp)) {
+	if (sscanf(line, "%31s %ld %d %lf %lf %lf", results[n].name,
+		   &results[n].ops, &results[n].trials, &results[n].mean,
+		   &results[n].stddev, &results[n].min) == 6)
+	    ++n;
+    }
+    fclose(fp);
+    return n;
+}
+
+/* Display the command-line usage and exit.
+ */
+static void usage(int status)
+{
+    fputs("Usage: microbench [-o FILE] [-b FILE] [-n TRIALS]\n"
+	  "Time the lookup, search, and conversion functions of ubrowse.\n\n"
+	  "  -o FILE     Write the results to FILE (default bench.tsv).\n"
+	  "  -b FILE     Compare the results against those in FILE.\n"
+	  "  -n TRIALS   Number of timed trials per benchmark (default 10).\n",
+	  status ? stderr : stdout);
+    exit(status);
+}
+
+/* Run the benchmarks, and output the results.
+ */
+int main(int argc, char *argv[])
+{
+    enum { count = sizeof benchmarks / sizeof *benchmarks };
+    result results[count], baseline[count];
+    char const *outfile = "bench.tsv";
+    char const *basefile = NULL;
+    int trials = 10;
+    int basecount, ch, i, j;
+    FILE *fp;
+
+    while ((ch = getopt(argc, argv, "o:b:n:h")) != -1) {
+	switch (ch) {
+	  case 'o':	outfile = optarg;			break;
+	  case 'b':	basefile = optarg;			break;
+	  case 'n':
+	    trials = atoi(optarg);
+	    if (trials < 1)
+		usage(EXIT_FAILURE);
+	    break;
+	  case 'h':	usage(EXIT_SUCCESS);			break;
+	  default:	usage(EXIT_FAILURE);			break;
+	}
+    }
+    if (optind != argc)
+	usage(EXIT_FAILURE);
+
+    basecount = 0;
+    if (basefile) {
+	basecount = readresults(basefile, baseline, count);
+	if (basecount < 0) {
+	    fprintf(stderr, "microbench: %s: %s\n", basefile, strerror(errno));
+	    return EXIT_FAILURE;
+	}
+    }
+
+    inputsinit();
+    for (i = 0 ; i < count ; ++i)
+	runbenchmark(&benchmarks[i], trials, &results[i]);
+
+    printf("%-20s %12s %10s %10s %14s %9s\n", "benchmark", "ns/op",
+	   "stddev", "min", "ops/sec", "vs base");
+    for (i = 0 ; i < count ; ++i) {
+	printf("%-20s %12.1f %10.1f %10.1f %14.0f", results[i].name,
+	       results[i].mean, results[i].stddev, results[i].min,
+	       1e9 / results[i].mean);
+	for (j = 0 ; j < basecount ; ++j)
+	    if (!strcmp(baseline[j].name, results[i].name))
+		break;
+	if (j < basecount)
+	    printf(" %+8.1f%%",
+		   100.0 * (results[i].mean - baseline[j].mean)
+			 / baseline[j].mean);
+	putchar('\n');
+    }
+
+    fp = fopen(outfile, "w");
+    if (!fp) {
+	fprintf(stderr, "microbench: %s: %s\n", outfile, strerror(errno));
+	return EXIT_FAILURE;
+    }
+    fputs(resultsheading, fp);
+    for (i = 0 ; i < count ; ++i)
+	fprintf(fp, "%s\t%ld\t%d\t%.2f\t%.2f\t%.2f\t%.0f\n", results[i].name,
+		results[i].ops, results[i].trials, results[i].mean,
+		results[i].stddev, results[i].min, 1e9 / results[i].mean);
+    fclose(fp);
+    return 0;
+}
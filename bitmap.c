@@ -0,0 +1,173 @@
+/*
+ * bitmap.c: Bit arrays with rank and select.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "bitmap.h"
+
+/* The rank index stores a running count of the set bits at the start
+ * of every block of eight words. A rank query therefore needs to
+ * count the bits in at most eight words. The select index records
+ * which block contains every 256th set bit, which narrows the search
+ * for the nth set bit down to a short range of blocks.
+ */
+
+/* The number of words in a block, and the number of bits.
+ */
+#define BLOCKWORDS 8
+#define BLOCKBITS (BLOCKWORDS * 32)
+
+/* The interval between sampled set bits.
+ */
+#define SAMPLERATE 256
+
+/* Count the bits set in a word.
+ */
+static int popcount(unsigned int w)
+{
+    w = w - ((w >> 1) & 0x55555555U);
+    w = (w & 0x33333333U) + ((w >> 2) & 0x33333333U);
+    w = (w + (w >> 4)) & 0x0F0F0F0FU;
+    return ((w * 0x01010101U) & 0xFFFFFFFFU) >> 24;
+}
+
+/* Allocate the bit array.
+ */
+int bitmapinit(bitmap *map, int size)
+{
+    map->size = size;
+    map->count = 0;
+    map->ranks = NULL;
+    map->samples = NULL;
+    map->bits = calloc(size / BLOCKBITS + 1, BLOCKWORDS * sizeof *map->bits);
+    return map->bits != NULL;
+}
+
+/* Free the bit array and its index.
+ */
+void bitmapfree(bitmap *map)
+{
+    free(map->bits);
+    free(map->ranks);
+    free(map->samples);
+    map->bits = NULL;
+    map->ranks = NULL;
+    map->samples = NULL;
+    map->size = map->count = 0;
+}
+
+/* Set one bit.
+ */
+void bitmapset(bitmap *map, int pos)
+{
+    map->bits[pos >> 5] |= 1U << (pos & 31);
+}
+
+/* Test one bit.
+ */
+int bitmaptest(bitmap const *map, int pos)
+{
+    return (map->bits[pos >> 5] >> (pos & 31)) & 1;
+}
+
+/* Count the set bits, block by block, and note which blocks contain
+ * the sampled bits.
+ */
+int bitmapindex(bitmap *map)
+{
+    int blockcount, total, b, i;
+
+    blockcount = map->size / BLOCKBITS + 1;
+    free(map->ranks);
+    free(map->samples);
+    map->ranks = malloc((blockcount + 1) * sizeof *map->ranks);
+    map->samples = malloc((map->size / SAMPLERATE + 2)
+					* sizeof *map->samples);
+    if (!map->ranks || !map->samples)
+	return 0;
+    total = 0;
+    for (b = 0 ; b < blockcount ; ++b) {
+	map->ranks[b] = total;
+	for (i = 0 ; i < BLOCKWORDS ; ++i)
+	    total += popcount(map->bits[b * BLOCKWORDS + i]);
+	for (i = (map->ranks[b] + SAMPLERATE - 1) / SAMPLERATE ;
+	     i * SAMPLERATE < total ; ++i)
+	    map->samples[i] = b;
+    }
+    map->ranks[blockcount] = total;
+    map->samples[(total + SAMPLERATE - 1) / SAMPLERATE] = blockcount - 1;
+    map->count = total;
+    return 1;
+}
+
+/* Add the count of set bits in the words of the block that precede
+ * the position to the block's stored count.
+ */
+int bitmaprank(bitmap const *map, int pos)
+{
+    int word, rank, i;
+
+    if (pos >= map->size)
+	return map->count;
+    word = pos >> 5;
+    rank = map->ranks[pos / BLOCKBITS];
+    for (i = word - word % BLOCKWORDS ; i < word ; ++i)
+	rank += popcount(map->bits[i]);
+    return rank + popcount(map->bits[word] & ((1U << (pos & 31)) - 1));
+}
+
+/* Use the samples to find the range of blocks that contain the nth
+ * set bit, binary search the stored counts to find the exact block,
+ * and then count the bits in the block's words to find the word.
+ */
+int bitmapselect(bitmap const *map, int n)
+{
+    unsigned int w;
+    int lo, hi, mid, i;
+
+    lo = map->samples[n / SAMPLERATE];
+    hi = map->samples[n / SAMPLERATE + 1];
+    while (lo < hi) {
+	mid = (lo + hi + 1) / 2;
+	if (map->ranks[mid] <= n)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    n -= map->ranks[lo];
+    i = lo * BLOCKWORDS;
+    while (n >= popcount(map->bits[i]))
+	n -= popcount(map->bits[i++]);
+    w = map->bits[i];
+    while (n--)
+	w &= w - 1;
+    i *= 32;
+    while (!(w & 1)) {
+	w >>= 1;
+	++i;
+    }
+    return i;
+}
@@ -0,0 +1,76 @@
+/*
+ * bitmap.h: Bit arrays with rank and select.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _bitmap_h_
+#define _bitmap_h_
+
+/* A bitmap is an array of bits that, once indexed, can answer two
+ * questions quickly: how many bits are set before a given position
+ * (rank), and where the nth set bit is (select). The index adds a
+ * small fraction to the size of the bit array itself.
+ */
+typedef struct bitmap {
+    unsigned int *bits;		/* the bits, 32 to a word */
+    int *ranks;			/* number of set bits before each block */
+    int *samples;		/* the block holding every 256th set bit */
+    int size;			/* the number of bits */
+    int count;			/* the number of set bits */
+} bitmap;
+
+/* Allocate a bitmap of the given size, with all bits clear. The
+ * return value is false if memory could not be allocated.
+ */
+extern int bitmapinit(bitmap *map, int size);
+
+/* Release the memory held by a bitmap.
+ */
+extern void bitmapfree(bitmap *map);
+
+/* Set the bit at position pos.
+ */
+extern void bitmapset(bitmap *map, int pos);
+
+/* Return true if the bit at position pos is set.
+ */
+extern int bitmaptest(bitmap const *map, int pos);
+
+/* Build the index that supports bitmaprank() and bitmapselect(). This
+ * must be called after the bits have been set, and again if any bits
+ * are changed afterwards. The return value is false if memory could
+ * not be allocated.
+ */
+extern int bitmapindex(bitmap *map);
+
+/* Return the number of set bits that precede position pos.
+ */
+extern int bitmaprank(bitmap const *map, int pos);
+
+/* Return the position of the nth set bit, counting from zero. The
+ * value of n must be less than the number of set bits.
+ */
+extern int bitmapselect(bitmap const *map, int n);
+
+#endif
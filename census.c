@@ -0,0 +1,227 @@
+/*
+ * census.c: Counting the codepoints in a UTF-8 file.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "census.h"
+
+/* The file is mapped into memory and decoded in a single pass. Most
+ * text is mostly ASCII, so the decoder checks a machine word of bytes
+ * at a time, and while all of the bytes in a word are ASCII it only
+ * needs to count them. These are counted two bytes at a time, in a
+ * table indexed by pairs of ASCII bytes, which halves the number of
+ * increments; the pairs are split back into single bytes when the
+ * table is added to the totals. Any other bytes are decoded and
+ * validated one sequence at a time.
+ */
+
+/* The number of codepoints.
+ */
+#define UCHARCOUNT 0x110000
+
+/* The size of the table of ASCII byte pairs.
+ */
+#define PAIRCOUNT 0x8000
+
+/* The number of words that can be counted before the pair table
+ * needs to be emptied, to keep its entries from overflowing.
+ */
+#define PAIRFLUSH 0x10000000UL
+
+/* A word with the high bit of each byte set.
+ */
+static unsigned long const highbits = ~0UL / 255 * 128;
+
+/* Record an invalid sequence of the given size at p.
+ */
+static void addinvalid(census *result, unsigned char const *start,
+		       unsigned char const *p, int size)
+{
+    censusinvalid *inv;
+
+    if (result->invalidcount < CENSUS_MAXINVALID) {
+	inv = &result->invalid[result->invalidcount];
+	inv->offset = p - start;
+	inv->size = size;
+	memcpy(inv->bytes, p, size);
+    }
+    ++result->invalidcount;
+}
+
+/* Add the counts in the pair table to the totals, and clear it.
+ */
+static void flushpairs(unsigned long *counts, unsigned int *pairs)
+{
+    int i;
+
+    for (i = 0 ; i < PAIRCOUNT ; ++i) {
+	if (pairs[i]) {
+	    counts[i & 0x7F] += pairs[i];
+	    counts[i >> 8] += pairs[i];
+	    pairs[i] = 0;
+	}
+    }
+}
+
+/* Decode the size bytes at start and add them to the counts.
+ */
+static int decode(census *result, unsigned char const *start,
+		  unsigned long size)
+{
+    unsigned char const *p, *end;
+    unsigned long *counts;
+    unsigned int *pairs;
+    unsigned long word, value, words;
+    unsigned int lo, hi;
+    int n, i;
+
+    pairs = calloc(PAIRCOUNT, sizeof *pairs);
+    if (!pairs)
+	return 0;
+    counts = result->counts;
+    words = 0;
+    p = start;
+    end = start + size;
+    while (p < end) {
+	if (*p < 0x80) {
+	    while (end - p >= (long)sizeof word) {
+		memcpy(&word, p, sizeof word);
+		if (word & highbits)
+		    break;
+		for (i = 0 ; i < (int)sizeof word ; i += 2) {
+		    ++pairs[word & 0x7F7F];
+		    word >>= 16;
+		}
+		p += sizeof word;
+		if (++words == PAIRFLUSH) {
+		    flushpairs(counts, pairs);
+		    words = 0;
+		}
+	    }
+	    while (p < end && *p < 0x80)
+		++counts[*p++];
+	    continue;
+	}
+
+	if (*p < 0xC2 || *p > 0xF4) {
+	    addinvalid(result, start, p, 1);
+	    ++p;
+	    continue;
+	}
+	n = *p < 0xE0 ? 2 : *p < 0xF0 ? 3 : 4;
+	lo = *p == 0xE0 ? 0xA0 : *p == 0xF0 ? 0x90 : 0x80;
+	hi = *p == 0xED ? 0x9F : *p == 0xF4 ? 0x8F : 0xBF;
+	value = *p & (0x7F >> n);
+	for (i = 1 ; i < n ; ++i) {
+	    if (p + i >= end || p[i] < lo || p[i] > hi)
+		break;
+	    value = (value << 6) | (p[i] & 0x3F);
+	    lo = 0x80;
+	    hi = 0xBF;
+	}
+	if (i < n) {
+	    addinvalid(result, start, p, i);
+	    p += i;
+	    continue;
+	}
+	++counts[value];
+	p += n;
+    }
+
+    flushpairs(counts, pairs);
+    free(pairs);
+    return 1;
+}
+
+/* Decode the UTF-8 contents of a file and count its codepoints.
+ */
+int censusfile(census *result, char const *filename)
+{
+    struct stat st;
+    void *map;
+    unsigned long i;
+    int fd, err;
+
+    memset(result, 0, sizeof *result);
+    fd = open(filename, O_RDONLY);
+    if (fd < 0)
+	return 0;
+    if (fstat(fd, &st)) {
+	err = errno;
+	close(fd);
+	errno = err;
+	return 0;
+    }
+    if (!S_ISREG(st.st_mode)) {
+	close(fd);
+	errno = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+	return 0;
+    }
+    result->counts = calloc(UCHARCOUNT, sizeof *result->counts);
+    if (!result->counts) {
+	close(fd);
+	errno = ENOMEM;
+	return 0;
+    }
+    result->bytes = st.st_size;
+    if (st.st_size > 0) {
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED) {
+	    err = errno;
+	    close(fd);
+	    censusfree(result);
+	    errno = err;
+	    return 0;
+	}
+	posix_madvise(map, st.st_size, POSIX_MADV_SEQUENTIAL);
+	if (!decode(result, map, st.st_size)) {
+	    munmap(map, st.st_size);
+	    close(fd);
+	    censusfree(result);
+	    errno = ENOMEM;
+	    return 0;
+	}
+	munmap(map, st.st_size);
+    }
+    close(fd);
+    for (i = 0 ; i < UCHARCOUNT ; ++i)
+	result->chars += result->counts[i];
+    return 1;
+}
+
+/* Release the memory held by the results of a census.
+ */
+void censusfree(census *result)
+{
+    free(result->counts);
+    result->counts = NULL;
+}
@@ -0,0 +1,64 @@
+/*
+ * census.h: Counting the codepoints in a UTF-8 file.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _census_h_
+#define _census_h_
+
+/* The number of invalid sequences whose locations are recorded.
+ */
+#define CENSUS_MAXINVALID 100
+
+/* The location and contents of an invalid sequence.
+ */
+typedef struct censusinvalid {
+    unsigned long offset;	/* byte offset of the sequence in the file */
+    unsigned char bytes[4];	/* the bytes of the sequence */
+    int size;			/* the number of bytes in the sequence */
+} censusinvalid;
+
+/* The results of a census of a file.
+ */
+typedef struct census {
+    unsigned long *counts;	/* occurrences of each codepoint */
+    unsigned long bytes;	/* the size of the file in bytes */
+    unsigned long chars;	/* the number of codepoints decoded */
+    unsigned long invalidcount;	/* the number of invalid sequences */
+    censusinvalid invalid[CENSUS_MAXINVALID];	/* the first ones found */
+} census;
+
+/* Decode the UTF-8 contents of a file and count the occurrences of
+ * each codepoint. Invalid sequences are counted and skipped, in the
+ * way that a decoder substitutes U+FFFD for each maximal subpart of
+ * an ill-formed sequence. The return value is false if the file
+ * could not be read, in which case errno describes the error.
+ */
+extern int censusfile(census *result, char const *filename);
+
+/* Release the memory held by the results of a census.
+ */
+extern void censusfree(census *result);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * convert.c: Converting text between Unicode encodings.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string.h>
+#include "lookup.h"
+#include "convert.h"
+
+/* Most text is mostly ASCII, so the converter checks a machine word
+ * of input at a time, and while all of the bytes in a word are ASCII
+ * it converts the whole word at once: copying it as it is for UTF-8,
+ * or spreading its bytes apart with shifts and masks to make UTF-16
+ * or UTF-32 code units. The spreading depends on the byte order of
+ * the host, so it is only done on little-endian machines. Everything
+ * else is decoded and validated one sequence at a time, and then
+ * encoded by convertchar().
+ */
+
+/* A word with the high bit of each byte set.
+ */
+static unsigned long const highbits = ~0UL / 255 * 128;
+
+/* Words with the low byte of each 16-bit lane set, and with the low
+ * 16 bits of each 32-bit lane set.
+ */
+static unsigned long const bytelanes = ~0UL / 257;
+static unsigned long const wordlanes = ~0UL / 65537;
+
+/* The names of the encodings.
+ */
+char const *const convertnames[CONVERT_COUNT] = {
+    "utf8", "utf16le", "utf16be", "utf32le", "utf32be", "c"
+};
+
+/* Return true if the host stores words with the low byte first.
+ */
+static int littleendian(void)
+{
+    unsigned long one = 1;
+
+    return *(unsigned char*)&one == 1;
+}
+
+/* Spread the bytes in the low half of a word into 16-bit lanes.
+ */
+static unsigned long spread16(unsigned long x)
+{
+    x = (x | x << 16) & wordlanes;
+    return (x | x << 8) & bytelanes;
+}
+
+/* Spread the bytes in the low quarter of a word into 32-bit lanes.
+ */
+static unsigned long spread32(unsigned long x)
+{
+    x = (x | x << 8) & bytelanes;
+    return (x | x << 16) & wordlanes;
+}
+
+/* Convert the run of ASCII bytes at the start of the input. If
+ * wordwise is true, the bytes are converted a word at a time until a
+ * word contains any other bytes, and the rest of the run is converted
+ * a byte at a time. out is advanced past the output, and the number
+ * of input bytes converted is returned.
+ */
+static long convertascii(unsigned char const *in, long size, int encoding,
+			 int wordwise, unsigned char **out)
+{
+    int const w = sizeof(unsigned long);
+    unsigned long word, lane;
+    unsigned char *o;
+    long n;
+    int shift, i;
+
+    o = *out;
+    shift = encoding == CONVERT_UTF16BE ? 8
+	  : encoding == CONVERT_UTF32BE ? 24 : 0;
+    for (n = 0 ; wordwise && size - n >= w ; n += w) {
+	memcpy(&word, in + n, w);
+	if (word & highbits)
+	    break;
+	switch (encoding) {
+	  case CONVERT_UTF8:
+	    memcpy(o, &word, w);
+	    o += w;
+	    break;
+	  case CONVERT_UTF16LE:
+	  case CONVERT_UTF16BE:
+	    lane = spread16(word & (~0UL >> (w * 4))) << shift;
+	    memcpy(o, &lane, w);
+	    lane = spread16(word >> (w * 4)) << shift;
+	    memcpy(o + w, &lane, w);
+	    o += 2 * w;
+	    break;
+	  case CONVERT_UTF32LE:
+	  case CONVERT_UTF32BE:
+	    for (i = 0 ; i < 4 ; ++i) {
+		lane = spread32((word >> (i * w * 2)) & (~0UL >> (w * 6)));
+		lane <<= shift;
+		memcpy(o, &lane, w);
+		o += w;
+	    }
+	    break;
+	}
+    }
+
+    switch (encoding) {
+      case CONVERT_UTF8:
+	for ( ; n < size && in[n] < 0x80 ; ++n)
+	    *o++ = in[n];
+	break;
+      case CONVERT_UTF16LE:
+      case CONVERT_UTF16BE:
+	i = encoding == CONVERT_UTF16BE;
+	for ( ; n < size && in[n] < 0x80 ; ++n) {
+	    o[i] = in[n];
+	    o[!i] = 0;
+	    o += 2;
+	}
+	break;
+      case CONVERT_UTF32LE:
+      case CONVERT_UTF32BE:
+	i = encoding == CONVERT_UTF32BE ? 3 : 0;
+	for ( ; n < size && in[n] < 0x80 ; ++n) {
+	    memset(o, 0, 4);
+	    o[i] = in[n];
+	    o += 4;
+	}
+	break;
+      default:
+	for ( ; n < size && in[n] < 0x80 ; ++n)
+	    o += convertchar(in[n], encoding, o);
+	break;
+    }
+    *out = o;
+    return n;
+}
+
+/* Store a codepoint at out as the contents of a C string literal, and
+ * return the number of bytes used.
+ */
+static int convertescape(unsigned int uchar, unsigned char *out)
+{
+    static char const hexdigits[] = "0123456789ABCDEF";
+    unsigned char utf8[4];
+    int size, digits, n, i;
+
+    if ((uchar >= 0x20 && uchar < 0x7F) || uchar == '\n') {
+	if (uchar != '"' && uchar != '\\') {
+	    out[0] = uchar;
+	    return 1;
+	}
+	out[0] = '\\';
+	out[1] = uchar;
+	return 2;
+    }
+    if (uchar < 0xA0) {
+	size = encodeutf8(uchar, utf8);
+	for (i = 0 ; i < size ; ++i) {
+	    out[i * 4] = '\\';
+	    out[i * 4 + 1] = '0' + (utf8[i] >> 6);
+	    out[i * 4 + 2] = '0' + ((utf8[i] >> 3) & 7);
+	    out[i * 4 + 3] = '0' + (utf8[i] & 7);
+	}
+	return size * 4;
+    }
+    digits = uchar < 0x00010000 ? 4 : 8;
+    out[0] = '\\';
+    out[1] = digits == 4 ? 'u' : 'U';
+    for (n = digits + 1 ; n > 1 ; --n) {
+	out[n] = hexdigits[uchar & 15];
+	uchar >>= 4;
+    }
+    return digits + 2;
+}
+
+/* Store a codepoint in the given encoding.
+ */
+int convertchar(unsigned int uchar, int encoding, unsigned char *out)
+{
+    unsigned int units[2];
+    int big, size, i;
+
+    switch (encoding) {
+      case CONVERT_UTF8:
+	return encodeutf8(uchar, out);
+      case CONVERT_UTF16LE:
+      case CONVERT_UTF16BE:
+	big = encoding == CONVERT_UTF16BE;
+	size = encodeutf16(uchar, units);
+	for (i = 0 ; i < size ; ++i) {
+	    out[i * 2 + big] = units[i] & 0xFF;
+	    out[i * 2 + !big] = units[i] >> 8;
+	}
+	return size * 2;
+      case CONVERT_UTF32LE:
+      case CONVERT_UTF32BE:
+	big = encoding == CONVERT_UTF32BE;
+	for (i = 0 ; i < 4 ; ++i)
+	    out[big ? 3 - i : i] = (uchar >> (i * 8)) & 0xFF;
+	return 4;
+      case CONVERT_C:
+	return convertescape(uchar, out);
+    }
+    return 0;
+}
+
+/* Convert UTF-8 text to the given encoding.
+ */
+long convertutf8(unsigned char const *in, long size, int final,
+		 int encoding, unsigned char *out, long *used)
+{
+    unsigned char const *p, *end;
+    unsigned char *o;
+    unsigned long value;
+    unsigned int lo, hi;
+    int wordwise, n, i;
+
+    wordwise = encoding == CONVERT_UTF8
+		|| (encoding != CONVERT_C && littleendian());
+    p = in;
+    end = in + size;
+    o = out;
+    while (p < end) {
+	if (*p < 0x80) {
+	    p += convertascii(p, end - p, encoding, wordwise, &o);
+	    continue;
+	}
+
+	if (*p < 0xC2 || *p > 0xF4) {
+	    o += convertchar(0xFFFD, encoding, o);
+	    ++p;
+	    continue;
+	}
+	n = *p < 0xE0 ? 2 : *p < 0xF0 ? 3 : 4;
+	lo = *p == 0xE0 ? 0xA0 : *p == 0xF0 ? 0x90 : 0x80;
+	hi = *p == 0xED ? 0x9F : *p == 0xF4 ? 0x8F : 0xBF;
+	value = *p & (0x7F >> n);
+	for (i = 1 ; i < n ; ++i) {
+	    if (p + i >= end || p[i] < lo || p[i] > hi)
+		break;
+	    value = (value << 6) | (p[i] & 0x3F);
+	    lo = 0x80;
+	    hi = 0xBF;
+	}
+	if (i < n) {
+	    if (p + i >= end && !final)
+		break;
+	    o += convertchar(0xFFFD, encoding, o);
+	    p += i;
+	    continue;
+	}
+	if (encoding == CONVERT_UTF8) {
+	    memcpy(o, p, n);
+	    o += n;
+	} else if (encoding == CONVERT_UTF16LE && value < 0x00010000) {
+	    o[0] = value & 0xFF;
+	    o[1] = value >> 8;
+	    o += 2;
+	} else if (encoding == CONVERT_UTF16BE && value < 0x00010000) {
+	    o[0] = value >> 8;
+	    o[1] = value & 0xFF;
+	    o += 2;
+	} else {
+	    o += convertchar(value, encoding, o);
+	}
+	p += n;
+    }
+    *used = p - in;
+    return o - out;
+}
@@ -0,0 +1,70 @@
+/*
+ * convert.h: Converting text between Unicode encodings.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _convert_h_
+#define _convert_h_
+
+/* The encodings that text can be converted to. CONVERT_C is the form
+ * of the contents of a C string literal: printable ASCII characters
+ * are left as they are, apart from the double quote and backslash,
+ * which are escaped; the other characters below U+00A0 are written as
+ * octal escapes of their UTF-8 bytes; and everything else is written
+ * as \u or \U escapes. The exception is the newline, which is left as
+ * it is, so that each line of input becomes one line of output.
+ */
+enum { CONVERT_UTF8, CONVERT_UTF16LE, CONVERT_UTF16BE, CONVERT_UTF32LE,
+       CONVERT_UTF32BE, CONVERT_C, CONVERT_COUNT };
+
+/* The names of the encodings, as given on the command line.
+ */
+extern char const *const convertnames[CONVERT_COUNT];
+
+/* The most bytes that a single codepoint can take in any encoding.
+ */
+#define CONVERT_MAXCHAR 10
+
+/* The most bytes of output that a single byte of UTF-8 input can
+ * produce, which is the case for invalid bytes in CONVERT_C.
+ */
+#define CONVERT_MAXGROWTH 6
+
+/* Store a codepoint at out in the given encoding, and return the
+ * number of bytes used. out must have room for CONVERT_MAXCHAR bytes.
+ */
+extern int convertchar(unsigned int uchar, int encoding, unsigned char *out);
+
+/* Convert UTF-8 text to the given encoding. out must have room for
+ * CONVERT_MAXGROWTH bytes for each byte of input. Each maximal subpart
+ * of an ill-formed sequence is replaced with U+FFFD. If final is
+ * false, a sequence that is cut off at the end of the input is left
+ * unconverted, so that it can be completed by the next call. The
+ * number of input bytes converted is stored in used, and the return
+ * value is the number of bytes of output.
+ */
+extern long convertutf8(unsigned char const *in, long size, int final,
+			int encoding, unsigned char *out, long *used);
+
+#endif
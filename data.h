@@ -34,8 +34,17 @@ typedef struct charinfo {
     unsigned int namesize:8;	/* length of the glpyh name */
     unsigned int uchar:21;	/* the codepoint value */
     unsigned int combining:1;	/* true if this is a combining character */
+    unsigned int width:2;	/* display width implied by the Unicode data */
 } charinfo;
 
+/* Data stored for each alias of a character.
+ */
+typedef struct aliasinfo {
+    unsigned int nameoffset:24;	/* offset of the alias */
+    unsigned int namesize:8;	/* length of the alias */
+    int index;			/* index of the character in charlist */
+} aliasinfo;
+
 /* Data stored for each block.
  */
 typedef struct blockinfo {
@@ -49,6 +58,21 @@ typedef struct blockinfo {
 extern charinfo const charlist[];
 extern int const charlistsize;
 
+/* The list of character aliases.
+ */
+extern aliasinfo const aliaslist[];
+extern int const aliaslistsize;
+
+/* The perfect hash table of names and aliases. Each slot holds either
+ * an index into charlist, or charlistsize plus an index into
+ * aliaslist. A key's bucket holds either a displacement, used to find
+ * the key's slot, or -1 minus the slot itself.
+ */
+extern int const namehashsize;
+extern int const namehashslots[];
+extern int const namehashbucketcount;
+extern int const namehashbuckets[];
+
 /* The complete list of blocks of Unicode characters.
  */
 extern blockinfo const blocklist[];
@@ -0,0 +1,597 @@
+/*
+ * fontscan.c: Finding which characters the installed fonts cover.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 500
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "probe.h"
+#include "fontscan.h"
+
+/* Each font file is mapped into memory, and its cmap table is read
+ * directly. Only the subtables that map Unicode codepoints, in format
+ * 4 (the BMP) or format 12 (all planes), are used. A font's coverage
+ * is first built up as a bitmap over all codepoints, and is then
+ * reduced to a list of ranges, which is what is kept in memory and
+ * saved in the cache. The cache records each font file's modification
+ * time and size, so that only new or changed fonts are read again.
+ * The fonts are read by a pool of threads, which merge their results
+ * into a single bitmap covering all fonts.
+ */
+
+/* The total number of Unicode codepoints, and the number of words in
+ * a bitmap covering all of them.
+ */
+#define UCHARCOUNT 0x110000
+#define COVERAGEWORDS (UCHARCOUNT / 32)
+
+/* The maximum number of threads used to read fonts.
+ */
+#define MAXTHREADS 8
+
+/* The directories searched for fonts, relative to the home directory
+ * if they don't begin with a slash.
+ */
+static char const *fontdirs[] = {
+    "/usr/share/fonts", "/usr/local/share/fonts",
+    ".local/share/fonts", ".fonts"
+};
+
+/* The name of the cache file, and the string identifying its format.
+ */
+static char const cachename[] = "fonts";
+static char const cachemagic[8] = "UBFONTS1";
+
+/* Everything that is known about an installed font.
+ */
+typedef struct fontinfo {
+    char *path;			/* the font's filename */
+    unsigned long mtime;	/* when the file was last modified */
+    unsigned long size;		/* the size of the file */
+    unsigned int *ranges;	/* the first and last codepoint of each range */
+    int rangecount;		/* the number of ranges */
+    int scanned;		/* false if the file still needs to be read */
+} fontinfo;
+
+/* The header of each font's entry in the cache file, which is
+ * followed by the font's filename and its list of ranges.
+ */
+typedef struct cacheentry {
+    unsigned long mtime;
+    unsigned long size;
+    unsigned int pathsize;
+    unsigned int rangecount;
+} cacheentry;
+
+/* The list of installed fonts.
+ */
+static fontinfo *fonts = NULL;
+static int fontcount = 0;
+static int fontsalloced = 0;
+
+/* The codepoints covered by at least one font. This is NULL if the
+ * fonts have not been scanned.
+ */
+static unsigned int *coverage = NULL;
+
+/* The index of the next font to be read by a thread, and the lock
+ * that protects it and the coverage bitmap.
+ */
+static int nextfont;
+static pthread_mutex_t scanlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Read big-endian values from a font file.
+ */
+static unsigned int get16(unsigned char const *p)
+{
+    return (p[0] << 8) | p[1];
+}
+static unsigned long get32(unsigned char const *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+				       | (p[2] << 8) | p[3];
+}
+
+/* Mark a codepoint in a bitmap.
+ */
+static void setbit(unsigned int *bits, unsigned long uchar)
+{
+    bits[uchar >> 5] |= 1U << (uchar & 31);
+}
+
+/* Mark the codepoints covered by a format 4 subtable, which maps
+ * segments of the BMP. A codepoint is covered if it maps to a glyph
+ * other than glyph zero.
+ */
+static void readformat4(unsigned char const *data, unsigned long size,
+			unsigned int *bits)
+{
+    unsigned long segcount, first, last, offset, addr, c, i;
+    unsigned int delta, glyph;
+
+    if (size < 14)
+	return;
+    segcount = get16(data + 6) / 2;
+    if (16 + segcount * 8 > size)
+	return;
+    for (i = 0 ; i < segcount ; ++i) {
+	last = get16(data + 14 + i * 2);
+	first = get16(data + 16 + segcount * 2 + i * 2);
+	delta = get16(data + 16 + segcount * 4 + i * 2);
+	offset = get16(data + 16 + segcount * 6 + i * 2);
+	for (c = first ; c <= last && c != 0xFFFF ; ++c) {
+	    if (offset) {
+		addr = 16 + segcount * 6 + i * 2 + offset + (c - first) * 2;
+		if (addr + 2 > size)
+		    break;
+		glyph = get16(data + addr);
+		if (glyph)
+		    glyph = (glyph + delta) & 0xFFFF;
+	    } else {
+		glyph = (c + delta) & 0xFFFF;
+	    }
+	    if (glyph)
+		setbit(bits, c);
+	}
+    }
+}
+
+/* Mark the codepoints covered by a format 12 subtable, which maps
+ * groups of sequential codepoints to sequential glyphs.
+ */
+static void readformat12(unsigned char const *data, unsigned long size,
+			 unsigned int *bits)
+{
+    unsigned long count, first, last, glyph, c, i;
+
+    if (size < 16)
+	return;
+    count = get32(data + 12);
+    if (count > (size - 16) / 12)
+	count = (size - 16) / 12;
+    for (i = 0 ; i < count ; ++i) {
+	first = get32(data + 16 + i * 12);
+	last = get32(data + 20 + i * 12);
+	glyph = get32(data + 24 + i * 12);
+	if (last >= UCHARCOUNT)
+	    last = UCHARCOUNT - 1;
+	for (c = first ; c <= last ; ++c, ++glyph)
+	    if (glyph)
+		setbit(bits, c);
+    }
+}
+
+/* Find the cmap table of the font whose table directory begins at
+ * the given offset, and mark the codepoints covered by each of its
+ * Unicode subtables.
+ */
+static void readfont(unsigned char const *data, unsigned long size,
+		     unsigned long offset, unsigned int *bits)
+{
+    unsigned long tablecount, cmap, sub, i;
+    unsigned int platform, encoding;
+
+    if (offset + 12 > size)
+	return;
+    tablecount = get16(data + offset + 4);
+    if (offset + 12 + tablecount * 16 > size)
+	return;
+    for (i = 0 ; i < tablecount ; ++i)
+	if (!memcmp(data + offset + 12 + i * 16, "cmap", 4))
+	    break;
+    if (i == tablecount)
+	return;
+    cmap = get32(data + offset + 12 + i * 16 + 8);
+    if (cmap + 4 > size)
+	return;
+    tablecount = get16(data + cmap + 2);
+    if (cmap + 4 + tablecount * 8 > size)
+	return;
+    for (i = 0 ; i < tablecount ; ++i) {
+	platform = get16(data + cmap + 4 + i * 8);
+	encoding = get16(data + cmap + 6 + i * 8);
+	sub = cmap + get32(data + cmap + 8 + i * 8);
+	if (platform != 0 && !(platform == 3 && (encoding == 1
+						 || encoding == 10)))
+	    continue;
+	if (sub + 2 > size)
+	    continue;
+	switch (get16(data + sub)) {
+	  case 4:	readformat4(data + sub, size - sub, bits);	break;
+	  case 12:	readformat12(data + sub, size - sub, bits);	break;
+	}
+    }
+}
+
+/* Map a font file into memory and mark the codepoints covered by the
+ * font, or by all of the fonts if the file is a collection.
+ */
+static void readfontfile(char const *path, unsigned int *bits)
+{
+    unsigned char const *data;
+    struct stat st;
+    unsigned long count, i;
+    void *map;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return;
+    if (fstat(fd, &st) || st.st_size < 12) {
+	close(fd);
+	return;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return;
+    data = map;
+    if (!memcmp(data, "ttcf", 4)) {
+	count = get32(data + 8);
+	for (i = 0 ; i < count && 16 + i * 4 <= (unsigned long)st.st_size ;
+	     ++i)
+	    readfont(data, st.st_size, get32(data + 12 + i * 4), bits);
+    } else {
+	readfont(data, st.st_size, 0, bits);
+    }
+    munmap(map, st.st_size);
+}
+
+/* Reduce a bitmap of codepoints to a list of ranges. The return value
+ * is the number of ranges, or -1 if memory could not be allocated.
+ */
+static int makeranges(unsigned int const *bits, unsigned int **ranges)
+{
+    unsigned int *list = NULL;
+    unsigned int *p;
+    int count, alloced, inrange;
+    unsigned long c;
+
+    count = alloced = 0;
+    inrange = 0;
+    for (c = 0 ; c < UCHARCOUNT ; ++c) {
+	if (!(c & 31) && bits[c >> 5] == (inrange ? 0xFFFFFFFFU : 0)) {
+	    c += 31;
+	    continue;
+	}
+	if ((int)((bits[c >> 5] >> (c & 31)) & 1) == inrange)
+	    continue;
+	if (inrange) {
+	    list[count * 2 - 1] = c - 1;
+	} else {
+	    if (count == alloced) {
+		alloced = alloced ? alloced * 2 : 64;
+		p = realloc(list, alloced * 2 * sizeof *list);
+		if (!p) {
+		    free(list);
+		    return -1;
+		}
+		list = p;
+	    }
+	    list[count * 2] = c;
+	    ++count;
+	}
+	inrange = !inrange;
+    }
+    if (inrange)
+	list[count * 2 - 1] = UCHARCOUNT - 1;
+    *ranges = list;
+    return count;
+}
+
+/* Add a range list to a bitmap.
+ */
+static void addranges(unsigned int *bits, unsigned int const *ranges,
+		      int count)
+{
+    unsigned long c;
+    int i;
+
+    for (i = 0 ; i < count ; ++i)
+	for (c = ranges[i * 2] ; c <= ranges[i * 2 + 1] ; ++c)
+	    setbit(bits, c);
+}
+
+/* The body of each thread in the pool. Fonts that have not been read
+ * are taken from the list one at a time, and each font's coverage is
+ * merged into the overall coverage bitmap.
+ */
+static void *scanthread(void *arg)
+{
+    unsigned int *bits;
+    fontinfo *font;
+    int i;
+
+    (void)arg;
+    bits = malloc(COVERAGEWORDS * sizeof *bits);
+    if (!bits)
+	return NULL;
+    for (;;) {
+	pthread_mutex_lock(&scanlock);
+	while (nextfont < fontcount && fonts[nextfont].scanned)
+	    ++nextfont;
+	font = nextfont < fontcount ? &fonts[nextfont++] : NULL;
+	pthread_mutex_unlock(&scanlock);
+	if (!font)
+	    break;
+	memset(bits, 0, COVERAGEWORDS * sizeof *bits);
+	readfontfile(font->path, bits);
+	font->rangecount = makeranges(bits, &font->ranges);
+	if (font->rangecount < 0) {
+	    font->rangecount = 0;
+	    continue;
+	}
+	font->scanned = 1;
+	pthread_mutex_lock(&scanlock);
+	for (i = 0 ; i < COVERAGEWORDS ; ++i)
+	    coverage[i] |= bits[i];
+	pthread_mutex_unlock(&scanlock);
+    }
+    free(bits);
+    return NULL;
+}
+
+/* Add a file to the list of fonts, if it appears to be a TrueType or
+ * OpenType font file (or collection).
+ */
+static int addfontfile(char const *path, struct stat const *st, int type,
+		       struct FTW *ftw)
+{
+    static char const *exts[] = { "ttf", "otf", "ttc", "otc" };
+    fontinfo *font;
+    char const *ext;
+    int i;
+
+    (void)ftw;
+    if (type != FTW_F)
+	return 0;
+    ext = strrchr(path, '.');
+    if (!ext || strlen(ext) != 4)
+	return 0;
+    for (i = 0 ; i < (int)(sizeof exts / sizeof *exts) ; ++i)
+	if (tolower(ext[1]) == exts[i][0] && tolower(ext[2]) == exts[i][1]
+					  && tolower(ext[3]) == exts[i][2])
+	    break;
+    if (i == (int)(sizeof exts / sizeof *exts))
+	return 0;
+    if (fontcount == fontsalloced) {
+	fontsalloced = fontsalloced ? fontsalloced * 2 : 64;
+	font = realloc(fonts, fontsalloced * sizeof *fonts);
+	if (!font)
+	    return 1;
+	fonts = font;
+    }
+    font = &fonts[fontcount];
+    font->path = malloc(strlen(path) + 1);
+    if (!font->path)
+	return 1;
+    strcpy(font->path, path);
+    font->mtime = st->st_mtime;
+    font->size = st->st_size;
+    font->ranges = NULL;
+    font->rangecount = 0;
+    font->scanned = 0;
+    ++fontcount;
+    return 0;
+}
+
+/* Compare two fonts by filename.
+ */
+static int comparefonts(void const *a, void const *b)
+{
+    return strcmp(((fontinfo const*)a)->path, ((fontinfo const*)b)->path);
+}
+
+/* Read the cache file, and take the coverage of every font whose
+ * entry is still up to date. The return value is the number of fonts
+ * that were found in the cache.
+ */
+static int loadcache(void)
+{
+    char filename[1024];
+    cacheentry entry;
+    fontinfo key, *font;
+    char *path;
+    FILE *fp;
+    char magic[8];
+    int found;
+
+    if (!cachefilepath(filename, sizeof filename, cachename, 0))
+	return 0;
+    fp = fopen(filename, "rb");
+    if (!fp)
+	return 0;
+    found = 0;
+    if (fread(magic, sizeof magic, 1, fp) == 1
+			&& !memcmp(magic, cachemagic, sizeof magic)) {
+	while (fread(&entry, sizeof entry, 1, fp) == 1) {
+	    path = malloc(entry.pathsize + 1);
+	    if (!path || fread(path, entry.pathsize, 1, fp) != 1) {
+		free(path);
+		break;
+	    }
+	    path[entry.pathsize] = '\0';
+	    key.path = path;
+	    font = bsearch(&key, fonts, fontcount, sizeof *fonts,
+			   comparefonts);
+	    free(path);
+	    if (font && !font->scanned && font->mtime == entry.mtime
+				       && font->size == entry.size) {
+		font->ranges = malloc(entry.rangecount * 2
+					* sizeof *font->ranges + 1);
+		if (font->ranges && fread(font->ranges,
+					  2 * sizeof *font->ranges,
+					  entry.rangecount, fp)
+				    == entry.rangecount) {
+		    font->rangecount = entry.rangecount;
+		    font->scanned = 1;
+		    ++found;
+		    continue;
+		}
+		free(font->ranges);
+		font->ranges = NULL;
+		break;
+	    }
+	    if (fseek(fp, entry.rangecount * 2 * sizeof *font->ranges,
+		      SEEK_CUR))
+		break;
+	}
+    }
+    fclose(fp);
+    return found;
+}
+
+/* Write a new cache file, containing every font that was scanned.
+ */
+static void savecache(void)
+{
+    char filename[1024], tempname[1040];
+    cacheentry entry;
+    FILE *fp;
+    int i;
+
+    if (!cachefilepath(filename, sizeof filename, cachename, 1))
+	return;
+    sprintf(tempname, "%s.%ld", filename, (long)getpid());
+    fp = fopen(tempname, "wb");
+    if (!fp)
+	return;
+    fwrite(cachemagic, sizeof cachemagic, 1, fp);
+    for (i = 0 ; i < fontcount ; ++i) {
+	if (!fonts[i].scanned)
+	    continue;
+	entry.mtime = fonts[i].mtime;
+	entry.size = fonts[i].size;
+	entry.pathsize = strlen(fonts[i].path);
+	entry.rangecount = fonts[i].rangecount;
+	fwrite(&entry, sizeof entry, 1, fp);
+	fwrite(fonts[i].path, entry.pathsize, 1, fp);
+	fwrite(fonts[i].ranges, 2 * sizeof *fonts[i].ranges,
+	       fonts[i].rangecount, fp);
+    }
+    if (fclose(fp) || rename(tempname, filename))
+	remove(tempname);
+}
+
+/* Find the installed fonts, take what coverage information is still
+ * valid from the cache, and then read the remaining fonts using a
+ * pool of threads.
+ */
+int fontscan(void)
+{
+    pthread_t threads[MAXTHREADS];
+    char path[1024];
+    char const *home;
+    int threadcount, cached, i;
+
+    if (coverage)
+	return fontcount;
+    coverage = calloc(COVERAGEWORDS, sizeof *coverage);
+    if (!coverage)
+	return 0;
+    home = getenv("HOME");
+    for (i = 0 ; i < (int)(sizeof fontdirs / sizeof *fontdirs) ; ++i) {
+	if (*fontdirs[i] == '/')
+	    strcpy(path, fontdirs[i]);
+	else if (home && strlen(home) + strlen(fontdirs[i]) + 2 < sizeof path)
+	    sprintf(path, "%s/%s", home, fontdirs[i]);
+	else
+	    continue;
+	nftw(path, addfontfile, 16, 0);
+    }
+    qsort(fonts, fontcount, sizeof *fonts, comparefonts);
+
+    cached = loadcache();
+    for (i = 0 ; i < fontcount ; ++i)
+	if (fonts[i].scanned)
+	    addranges(coverage, fonts[i].ranges, fonts[i].rangecount);
+
+    threadcount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadcount > MAXTHREADS)
+	threadcount = MAXTHREADS;
+    if (threadcount > fontcount - cached)
+	threadcount = fontcount - cached;
+    nextfont = 0;
+    for (i = 0 ; i < threadcount ; ++i)
+	if (pthread_create(&threads[i], NULL, scanthread, NULL))
+	    break;
+    threadcount = i;
+    if (cached < fontcount && !threadcount)
+	scanthread(NULL);
+    for (i = 0 ; i < threadcount ; ++i)
+	pthread_join(threads[i], NULL);
+
+    if (cached < fontcount)
+	savecache();
+    return fontcount;
+}
+
+/* Look up a codepoint in the overall coverage bitmap.
+ */
+int fontcovers(unsigned int uchar)
+{
+    if (!coverage)
+	return 1;
+    if (uchar >= UCHARCOUNT)
+	return 0;
+    return (coverage[uchar >> 5] >> (uchar & 31)) & 1;
+}
+
+/* Search each font's range list for the codepoint.
+ */
+char const *fontcovering(unsigned int uchar, int *count)
+{
+    char const *path = NULL;
+    int n, lo, hi, mid, i;
+
+    n = 0;
+    for (i = 0 ; i < fontcount ; ++i) {
+	lo = 0;
+	hi = fonts[i].rangecount;
+	while (lo < hi) {
+	    mid = (lo + hi) / 2;
+	    if (fonts[i].ranges[mid * 2 + 1] < uchar)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	if (lo < fonts[i].rangecount && fonts[i].ranges[lo * 2] <= uchar) {
+	    if (!path)
+		path = fonts[i].path;
+	    ++n;
+	}
+    }
+    if (count)
+	*count = n;
+    return path;
+}
@@ -0,0 +1,48 @@
+/*
+ * fontscan.h: Finding which characters the installed fonts cover.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _fontscan_h_
+#define _fontscan_h_
+
+/* Examine the fonts installed in the standard font directories, and
+ * determine which characters they provide glyphs for. The results
+ * are cached, so that only new or modified fonts need to be read. The
+ * return value is the number of fonts found.
+ */
+extern int fontscan(void);
+
+/* Return true if any installed font covers the given codepoint. If
+ * the fonts have not been scanned, the return value is always true.
+ */
+extern int fontcovers(unsigned int uchar);
+
+/* Return the filename of the first installed font that covers the
+ * given codepoint, or NULL if none do. If count is not NULL, the
+ * total number of fonts covering the codepoint is stored there.
+ */
+extern char const *fontcovering(unsigned int uchar, int *count);
+
+#endif
@@ -0,0 +1,465 @@
+/*
+ * glyphs.c: Displaying glyphs as images on graphical terminals.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "fontscan.h"
+#include "raster.h"
+#include "glyphs.h"
+
+/* Glyphs are rendered from the first installed font that covers the
+ * codepoint, at the pixel size of the area they are to occupy, and
+ * are kept in a cache that discards the least recently used image
+ * when it is full. For sixel terminals, the cache holds the encoded
+ * image, since sixel images must be sent in full every time they are
+ * displayed. For the kitty protocol, images are transmitted to the
+ * terminal once, and the cache holds the ID by which they are placed
+ * on the screen thereafter. An image's ID is released when it leaves
+ * the cache. Kitty images stay on the screen until removed, so all
+ * placements are deleted before each new set is made.
+ */
+
+/* The number of images in the cache, and the size of its hash table.
+ */
+#define CACHESIZE 1024
+#define HASHSIZE 2048
+
+/* The maximum number of images displayed at one time.
+ */
+#define MAXPLACEMENTS 512
+
+/* The number of base64 characters sent in each part of a kitty image.
+ */
+#define KITTYCHUNK 4096
+
+/* A cached image.
+ */
+typedef struct glyphimage {
+    unsigned int uchar;		/* the codepoint */
+    int width, height;		/* the size of the image in pixels */
+    int available;		/* false if no font has the glyph */
+    unsigned int id;		/* the kitty image ID */
+    char *sixel;		/* the encoded sixel image */
+    int hashnext;		/* the next entry in the same hash chain */
+    int newer, older;		/* the neighbors in order of use */
+} glyphimage;
+
+/* An image to be displayed.
+ */
+typedef struct placement {
+    unsigned int uchar;		/* the codepoint */
+    int y, x;			/* the position of the top left cell */
+    int rows, cols;		/* the size in cells */
+} placement;
+
+/* The protocol in use, and the size of a cell in pixels.
+ */
+static int protocol = GLYPHS_NONE;
+static int cellwidth, cellheight;
+
+/* The cache. Each chain of the hash table and the list in order of
+ * use are linked through indexes into the cache, with -1 marking
+ * the end.
+ */
+static glyphimage cache[CACHESIZE];
+static int hashtable[HASHSIZE];
+static int cachecount = 0;
+static int newest = -1, oldest = -1;
+
+/* The next ID to give to a kitty image.
+ */
+static unsigned int nextid = 1;
+
+/* The images waiting to be displayed, and the number displayed by the
+ * last flush.
+ */
+static placement placements[MAXPLACEMENTS];
+static int placementcount = 0;
+static int placedcount = 0;
+
+/* The buffer in which output is gathered before being sent.
+ */
+static char *outbuf = NULL;
+static int outsize = 0, outalloced = 0;
+
+/* Append bytes to the output buffer. Output is silently dropped if
+ * memory is exhausted.
+ */
+static void output(char const *data, int size)
+{
+    char *p;
+    int n;
+
+    if (outsize + size > outalloced) {
+	n = outalloced ? outalloced : 65536;
+	while (n < outsize + size)
+	    n *= 2;
+	p = realloc(outbuf, n);
+	if (!p)
+	    return;
+	outbuf = p;
+	outalloced = n;
+    }
+    memcpy(outbuf + outsize, data, size);
+    outsize += size;
+}
+
+/* Append a string to the output buffer.
+ */
+static void outputstr(char const *str)
+{
+    output(str, strlen(str));
+}
+
+/* Send the contents of the output buffer to the terminal, after
+ * anything that stdio has buffered.
+ */
+static void sendoutput(void)
+{
+    char const *p = outbuf;
+    int n;
+
+    fflush(stdout);
+    while (outsize > 0) {
+	n = write(STDOUT_FILENO, p, outsize);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    break;
+	}
+	p += n;
+	outsize -= n;
+    }
+    outsize = 0;
+}
+
+/* Encode a run of identical sixels, using the repeat introducer if
+ * the run is long enough to make it worthwhile.
+ */
+static char *encoderun(char *p, int ch, int count)
+{
+    if (count > 3) {
+	p += sprintf(p, "!%d%c", count, ch);
+    } else {
+	while (count--)
+	    *p++ = ch;
+    }
+    return p;
+}
+
+/* Encode an image as a sixel sequence. Coverage is reduced to four
+ * shades of gray, and uncovered pixels are left transparent. The
+ * return value is a newly allocated string, or NULL if memory could
+ * not be allocated.
+ */
+static char *encodesixel(unsigned char const *pixels, int width, int height)
+{
+    static char const header[] = "\033P0;1;0q\"1;1;%d;%d"
+				 "#1;2;40;40;40#2;2;60;60;60"
+				 "#3;2;80;80;80#4;2;100;100;100";
+    char *sixel, *p;
+    int band, level, x, y, bits, prev, run, used;
+
+    sixel = malloc(sizeof header + 24 + ((height + 5) / 6) * 4
+					     * (width * 2 + 8) + 3);
+    if (!sixel)
+	return NULL;
+    p = sixel + sprintf(sixel, header, width, height);
+    for (band = 0 ; band < height ; band += 6) {
+	for (level = 1 ; level <= 4 ; ++level) {
+	    used = 0;
+	    for (y = band ; y < band + 6 && y < height && !used ; ++y)
+		for (x = 0 ; x < width && !used ; ++x)
+		    used = (pixels[y * width + x] + 32) / 64 == level;
+	    if (!used)
+		continue;
+	    p += sprintf(p, "#%d", level);
+	    prev = -1;
+	    run = 0;
+	    for (x = 0 ; x < width ; ++x) {
+		bits = 0;
+		for (y = band ; y < band + 6 && y < height ; ++y)
+		    if ((pixels[y * width + x] + 32) / 64 == level)
+			bits |= 1 << (y - band);
+		if (bits + '?' != prev && run) {
+		    p = encoderun(p, prev, run);
+		    run = 0;
+		}
+		prev = bits + '?';
+		++run;
+	    }
+	    if (prev != '?')
+		p = encoderun(p, prev, run);
+	    *p++ = '$';
+	}
+	*p++ = '-';
+    }
+    strcpy(p, "\033\\");
+    return sixel;
+}
+
+/* Transmit an image to a kitty terminal under the given ID, as white
+ * pixels whose opacity is the glyph's coverage. The image is sent in
+ * base64, divided into chunks.
+ */
+static void transmitkitty(unsigned char const *pixels, int width, int height,
+			  unsigned int id)
+{
+    static char const digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				 "abcdefghijklmnopqrstuvwxyz0123456789+/";
+    unsigned char rgb[3];
+    unsigned long value;
+    char buf[80];
+    char *base64, *p;
+    long total, size, i, n;
+    int k;
+
+    total = (long)width * height * 4;
+    base64 = malloc((total + 2) / 3 * 4);
+    if (!base64)
+	return;
+    p = base64;
+    for (i = 0 ; i < total ; i += 3) {
+	for (k = 0 ; k < 3 ; ++k) {
+	    n = i + k;
+	    rgb[k] = n >= total ? 0 : n % 4 == 3 ? pixels[n / 4] : 255;
+	}
+	value = ((unsigned long)rgb[0] << 16) | (rgb[1] << 8) | rgb[2];
+	*p++ = digits[(value >> 18) & 63];
+	*p++ = digits[(value >> 12) & 63];
+	*p++ = i + 1 < total ? digits[(value >> 6) & 63] : '=';
+	*p++ = i + 2 < total ? digits[value & 63] : '=';
+    }
+    size = p - base64;
+
+    for (i = 0 ; i < size ; i += KITTYCHUNK) {
+	n = size - i < KITTYCHUNK ? size - i : KITTYCHUNK;
+	if (i == 0)
+	    sprintf(buf, "\033_Ga=t,q=2,f=32,i=%u,s=%d,v=%d,m=%d;",
+		    id, width, height, i + n < size);
+	else
+	    sprintf(buf, "\033_Gm=%d;", i + n < size);
+	outputstr(buf);
+	output(base64 + i, n);
+	outputstr("\033\\");
+    }
+    free(base64);
+}
+
+/* Return the hash table slot for an image.
+ */
+static int hashimage(unsigned int uchar, int width, int height)
+{
+    return (int)((uchar * 31UL + width * 977UL + height) % HASHSIZE);
+}
+
+/* Remove an entry from the list in order of use.
+ */
+static void unlinkentry(int n)
+{
+    if (cache[n].newer >= 0)
+	cache[cache[n].newer].older = cache[n].older;
+    else
+	newest = cache[n].older;
+    if (cache[n].older >= 0)
+	cache[cache[n].older].newer = cache[n].newer;
+    else
+	oldest = cache[n].newer;
+}
+
+/* Add an entry to the front of the list in order of use.
+ */
+static void linknewest(int n)
+{
+    cache[n].newer = -1;
+    cache[n].older = newest;
+    if (newest >= 0)
+	cache[newest].newer = n;
+    newest = n;
+    if (oldest < 0)
+	oldest = n;
+}
+
+/* Make room for a new entry in the cache, discarding the least
+ * recently used image if the cache is full. The return value is the
+ * index of the free entry.
+ */
+static int allocentry(void)
+{
+    char buf[64];
+    int n, *link;
+
+    if (cachecount < CACHESIZE)
+	return cachecount++;
+    n = oldest;
+    unlinkentry(n);
+    link = hashtable + hashimage(cache[n].uchar, cache[n].width,
+				 cache[n].height);
+    while (*link != n)
+	link = &cache[*link].hashnext;
+    *link = cache[n].hashnext;
+    if (cache[n].id) {
+	sprintf(buf, "\033_Ga=d,d=I,q=2,i=%u\033\\", cache[n].id);
+	outputstr(buf);
+    }
+    free(cache[n].sixel);
+    return n;
+}
+
+/* Return the cache entry for a glyph of the given size, rendering it
+ * if it isn't already present. If a new image has to be transmitted
+ * to the terminal, it is added to the output buffer.
+ */
+static glyphimage *getimage(unsigned int uchar, int width, int height)
+{
+    unsigned char *pixels;
+    char const *path;
+    int h, n;
+
+    h = hashimage(uchar, width, height);
+    for (n = hashtable[h] ; n >= 0 ; n = cache[n].hashnext) {
+	if (cache[n].uchar == uchar && cache[n].width == width
+				    && cache[n].height == height) {
+	    unlinkentry(n);
+	    linknewest(n);
+	    return cache + n;
+	}
+    }
+
+    n = allocentry();
+    cache[n].uchar = uchar;
+    cache[n].width = width;
+    cache[n].height = height;
+    cache[n].available = 0;
+    cache[n].id = 0;
+    cache[n].sixel = NULL;
+    cache[n].hashnext = hashtable[h];
+    hashtable[h] = n;
+    linknewest(n);
+
+    path = fontcovering(uchar, NULL);
+    if (!path)
+	return cache + n;
+    pixels = malloc(width * height);
+    if (!pixels)
+	return cache + n;
+    if (rasterglyph(path, uchar, pixels, width, height)) {
+	if (protocol == GLYPHS_SIXEL) {
+	    cache[n].sixel = encodesixel(pixels, width, height);
+	    cache[n].available = cache[n].sixel != NULL;
+	} else {
+	    cache[n].id = nextid++;
+	    transmitkitty(pixels, width, height, cache[n].id);
+	    cache[n].available = 1;
+	}
+    }
+    free(pixels);
+    return cache + n;
+}
+
+/* Choose the protocol and record the cell size.
+ */
+void glyphsinit(int proto, int width, int height)
+{
+    int i;
+
+    protocol = proto;
+    cellwidth = width;
+    cellheight = height;
+    for (i = 0 ; i < HASHSIZE ; ++i)
+	hashtable[i] = -1;
+}
+
+/* Add an image to the list waiting to be displayed.
+ */
+void glyphplace(unsigned int uchar, int y, int x, int rows, int cols)
+{
+    placement *p;
+
+    if (protocol == GLYPHS_NONE || placementcount == MAXPLACEMENTS)
+	return;
+    p = placements + placementcount++;
+    p->uchar = uchar;
+    p->y = y;
+    p->x = x;
+    p->rows = rows;
+    p->cols = cols;
+}
+
+/* Send the waiting images to the terminal. The cursor is saved and
+ * restored around them, so that curses's idea of its position stays
+ * correct.
+ */
+void glyphsflush(void)
+{
+    glyphimage *image;
+    placement *p;
+    char buf[80];
+    int i;
+
+    if (protocol == GLYPHS_NONE || (!placementcount && !placedcount))
+	return;
+    outputstr("\0337");
+    if (protocol == GLYPHS_KITTY && placedcount)
+	outputstr("\033_Ga=d,d=a,q=2\033\\");
+    placedcount = 0;
+    for (i = 0 ; i < placementcount ; ++i) {
+	p = placements + i;
+	image = getimage(p->uchar, p->cols * cellwidth, p->rows * cellheight);
+	if (!image->available)
+	    continue;
+	sprintf(buf, "\033[%d;%dH", p->y + 1, p->x + 1);
+	outputstr(buf);
+	if (protocol == GLYPHS_SIXEL) {
+	    outputstr(image->sixel);
+	} else {
+	    sprintf(buf, "\033_Ga=p,q=2,C=1,i=%u,c=%d,r=%d\033\\",
+		    image->id, p->cols, p->rows);
+	    outputstr(buf);
+	    ++placedcount;
+	}
+    }
+    outputstr("\0338");
+    placementcount = 0;
+    sendoutput();
+}
+
+/* Delete all kitty placements. Sixel images are part of the screen
+ * contents, and are removed when curses writes over them.
+ */
+void glyphsclear(void)
+{
+    placementcount = 0;
+    if (protocol != GLYPHS_KITTY || !placedcount)
+	return;
+    outputstr("\033_Ga=d,d=a,q=2\033\\");
+    placedcount = 0;
+    sendoutput();
+}
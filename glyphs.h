@@ -0,0 +1,57 @@
+/*
+ * glyphs.h: Displaying glyphs as images on graphical terminals.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _glyphs_h_
+#define _glyphs_h_
+
+/* The graphics protocols that can be used to display images.
+ */
+enum { GLYPHS_NONE, GLYPHS_SIXEL, GLYPHS_KITTY };
+
+/* Select the graphics protocol to use, and the size in pixels of a
+ * character cell. Glyphs are rendered from the installed fonts, so
+ * the fonts must have been scanned with fontscan().
+ */
+extern void glyphsinit(int protocol, int cellwidth, int cellheight);
+
+/* Arrange for the glyph of a codepoint to be displayed as an image
+ * covering the given area of the screen, measured in cells. The image
+ * is sent to the terminal by the next call to glyphsflush().
+ */
+extern void glyphplace(unsigned int uchar, int y, int x, int rows, int cols);
+
+/* Send the images requested since the last call to the terminal. This
+ * must be called after curses has updated the screen. With the kitty
+ * protocol, the images from the previous call are removed first.
+ */
+extern void glyphsflush(void);
+
+/* Remove the images currently displayed, where the protocol allows
+ * them to outlast the text beneath them.
+ */
+extern void glyphsclear(void);
+
+#endif
@@ -0,0 +1,359 @@
+/*
+ * inspect.c: Decoding arbitrary text for inspection.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "data.h"
+#include "lookup.h"
+#include "inspect.h"
+
+/* The text is never decoded as a whole. Moving forward by one
+ * codepoint only requires decoding the lead byte and its continuation
+ * bytes, and moving backward requires looking back at most three
+ * bytes for the lead byte, so the cost of displaying any part of the
+ * text does not depend on its size.
+ */
+
+/* The classes of codepoints that determine where grapheme cluster
+ * boundaries fall.
+ */
+enum { CLASS_OTHER, CLASS_CONTROL, CLASS_CR, CLASS_LF, CLASS_EXTEND,
+       CLASS_ZWJ, CLASS_RI, CLASS_L, CLASS_V, CLASS_T, CLASS_LV, CLASS_LVT,
+       CLASS_PICTO };
+
+/* The size of each read when the text cannot be mapped.
+ */
+#define READSIZE 65536
+
+/* Use the given string as the text.
+ */
+void inspectstring(inspecttext *text, char const *str)
+{
+    text->data = (unsigned char const*)str;
+    text->size = strlen(str);
+    text->owned = 0;
+}
+
+/* Read the contents of a file descriptor as the text.
+ */
+int inspectread(inspecttext *text, int fd)
+{
+    struct stat st;
+    unsigned char *buf, *p;
+    unsigned long alloced;
+    void *map;
+    long n;
+
+    text->data = NULL;
+    text->size = 0;
+    text->owned = 0;
+    if (fstat(fd, &st))
+	return 0;
+    if (S_ISDIR(st.st_mode)) {
+	errno = EISDIR;
+	return 0;
+    }
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map != MAP_FAILED) {
+	    text->data = map;
+	    text->size = st.st_size;
+	    text->owned = 2;
+	    return 1;
+	}
+    }
+
+    buf = NULL;
+    alloced = 0;
+    for (;;) {
+	if (alloced - text->size < READSIZE) {
+	    alloced = alloced * 2 + READSIZE;
+	    p = realloc(buf, alloced);
+	    if (!p) {
+		free(buf);
+		errno = ENOMEM;
+		return 0;
+	    }
+	    buf = p;
+	}
+	n = read(fd, buf + text->size, alloced - text->size);
+	if (n < 0 && errno == EINTR)
+	    continue;
+	if (n < 0) {
+	    free(buf);
+	    return 0;
+	}
+	if (n == 0)
+	    break;
+	text->size += n;
+    }
+    text->data = buf;
+    text->owned = 1;
+    return 1;
+}
+
+/* Release the memory held by a text.
+ */
+void inspectfree(inspecttext *text)
+{
+    if (text->owned == 1)
+	free((void*)text->data);
+    else if (text->owned == 2)
+	munmap((void*)text->data, text->size);
+    text->data = NULL;
+    text->size = 0;
+    text->owned = 0;
+}
+
+/* Decode the codepoint at offset.
+ */
+int inspectdecode(inspecttext const *text, unsigned long offset, long *uchar)
+{
+    unsigned char const *p;
+    unsigned long avail;
+    unsigned int lo, hi;
+    long value;
+    int n, i;
+
+    if (offset >= text->size)
+	return 0;
+    p = text->data + offset;
+    if (*p < 0x80) {
+	*uchar = *p;
+	return 1;
+    }
+    *uchar = -1;
+    if (*p < 0xC2 || *p > 0xF4)
+	return 1;
+    avail = text->size - offset;
+    n = *p < 0xE0 ? 2 : *p < 0xF0 ? 3 : 4;
+    lo = *p == 0xE0 ? 0xA0 : *p == 0xF0 ? 0x90 : 0x80;
+    hi = *p == 0xED ? 0x9F : *p == 0xF4 ? 0x8F : 0xBF;
+    value = *p & (0x7F >> n);
+    for (i = 1 ; i < n ; ++i) {
+	if ((unsigned long)i >= avail || p[i] < lo || p[i] > hi)
+	    return i;
+	value = (value << 6) | (p[i] & 0x3F);
+	lo = 0x80;
+	hi = 0xBF;
+    }
+    *uchar = value;
+    return n;
+}
+
+/* Find the start of the codepoint containing the byte at offset. A
+ * lead byte can be at most three bytes back, and the first byte
+ * found that is not a continuation byte is the only candidate, as no
+ * sequence extends past a byte that does not continue it.
+ */
+unsigned long inspectstart(inspecttext const *text, unsigned long offset)
+{
+    unsigned long start;
+    long uchar;
+    int i;
+
+    for (i = 0 ; i < 4 && (unsigned long)i <= offset ; ++i) {
+	start = offset - i;
+	if ((text->data[start] & 0xC0) != 0x80) {
+	    if (start + inspectdecode(text, start, &uchar) > offset)
+		return start;
+	    break;
+	}
+    }
+    return offset;
+}
+
+/* Find the start of the codepoint before the one at offset.
+ */
+unsigned long inspectprev(inspecttext const *text, unsigned long offset)
+{
+    return offset ? inspectstart(text, offset - 1) : 0;
+}
+
+/* Return the class of a codepoint for the purpose of finding
+ * grapheme cluster boundaries. The Unicode data used by this program
+ * does not include the grapheme break property, so it is derived from
+ * what is available: zero-width characters are extenders, apart from
+ * the invisible format characters that UAX #29 treats as controls,
+ * and the ranges of the Hangul jamo, regional indicators, and emoji
+ * are fixed.
+ */
+static int charclass(long uchar)
+{
+    int index;
+
+    if (uchar < 0)
+	return CLASS_CONTROL;
+    if (uchar == '\r')
+	return CLASS_CR;
+    if (uchar == '\n')
+	return CLASS_LF;
+    if (uchar < 0x20 || (uchar >= 0x7F && uchar < 0xA0))
+	return CLASS_CONTROL;
+    if (uchar == 0x200D)
+	return CLASS_ZWJ;
+    if (uchar == 0x200B || uchar == 0x200E || uchar == 0x200F
+			|| (uchar >= 0x2028 && uchar <= 0x202E)
+			|| (uchar >= 0x2060 && uchar <= 0x206F)
+			|| uchar == 0xFEFF
+			|| (uchar >= 0xFFF0 && uchar <= 0xFFFB))
+	return CLASS_CONTROL;
+    if (uchar >= 0x1F1E6 && uchar <= 0x1F1FF)
+	return CLASS_RI;
+    if (uchar >= 0x1F3FB && uchar <= 0x1F3FF)
+	return CLASS_EXTEND;
+    if ((uchar >= 0x1100 && uchar <= 0x115F)
+			|| (uchar >= 0xA960 && uchar <= 0xA97C))
+	return CLASS_L;
+    if ((uchar >= 0x1160 && uchar <= 0x11A7)
+			|| (uchar >= 0xD7B0 && uchar <= 0xD7C6))
+	return CLASS_V;
+    if ((uchar >= 0x11A8 && uchar <= 0x11FF)
+			|| (uchar >= 0xD7CB && uchar <= 0xD7FB))
+	return CLASS_T;
+    if (uchar >= 0xAC00 && uchar <= 0xD7A3)
+	return (uchar - 0xAC00) % 28 ? CLASS_LVT : CLASS_LV;
+    index = charindex(uchar);
+    if (index >= 0 && charlist[index].width == 0)
+	return CLASS_EXTEND;
+    if (uchar == 0x00A9 || uchar == 0x00AE
+			|| (uchar >= 0x2100 && uchar <= 0x2BFF)
+			|| (uchar >= 0x1F000 && uchar <= 0x1FAFF))
+	return CLASS_PICTO;
+    return CLASS_OTHER;
+}
+
+/* Return true if a grapheme cluster boundary falls before offset.
+ */
+int inspectboundary(inspecttext const *text, unsigned long offset)
+{
+    unsigned long pos;
+    long uchar;
+    int prev, cur, count;
+
+    if (offset == 0 || offset >= text->size)
+	return 1;
+    inspectdecode(text, offset, &uchar);
+    cur = charclass(uchar);
+    pos = inspectprev(text, offset);
+    inspectdecode(text, pos, &uchar);
+    prev = charclass(uchar);
+
+    if (prev == CLASS_CR && cur == CLASS_LF)
+	return 0;
+    if (prev == CLASS_CONTROL || prev == CLASS_CR || prev == CLASS_LF)
+	return 1;
+    if (cur == CLASS_CONTROL || cur == CLASS_CR || cur == CLASS_LF)
+	return 1;
+    if (prev == CLASS_L && (cur == CLASS_L || cur == CLASS_V
+				|| cur == CLASS_LV || cur == CLASS_LVT))
+	return 0;
+    if ((prev == CLASS_LV || prev == CLASS_V)
+			&& (cur == CLASS_V || cur == CLASS_T))
+	return 0;
+    if ((prev == CLASS_LVT || prev == CLASS_T) && cur == CLASS_T)
+	return 0;
+    if (cur == CLASS_EXTEND || cur == CLASS_ZWJ)
+	return 0;
+    if (prev == CLASS_ZWJ && cur == CLASS_PICTO)
+	return 0;
+    if (prev == CLASS_RI && cur == CLASS_RI) {
+	count = 1;
+	while (pos > 0) {
+	    pos = inspectprev(text, pos);
+	    inspectdecode(text, pos, &uchar);
+	    if (charclass(uchar) != CLASS_RI)
+		break;
+	    ++count;
+	}
+	return count % 2 == 0;
+    }
+    return 1;
+}
+
+/* Return true if a codepoint is unusual.
+ */
+int inspectunusual(long uchar)
+{
+    return uchar < 0x20 ? uchar != '\t' && uchar != '\n' : uchar >= 0x7F;
+}
+
+/* Find the next unusual character. Every byte of a non-ASCII
+ * character, or of an ill-formed sequence, has its high bit set, so
+ * the search only needs to examine bytes, and only needs to decode
+ * when going backwards, to find the start of the character.
+ */
+long inspectfindunusual(inspecttext const *text, unsigned long offset,
+			int direction)
+{
+    unsigned char const *p, *end;
+    long uchar;
+
+    if (direction > 0) {
+	offset += inspectdecode(text, offset, &uchar);
+	end = text->data + text->size;
+	for (p = text->data + offset ; p < end ; ++p)
+	    if (inspectunusual(*p < 0x80 ? *p : -1))
+		return p - text->data;
+    } else {
+	for (p = text->data + offset ; p > text->data ; --p)
+	    if (inspectunusual(p[-1] < 0x80 ? p[-1] : -1))
+		return inspectstart(text, p - 1 - text->data);
+    }
+    return -1;
+}
+
+/* Find the next occurrence of a codepoint. A match for the complete
+ * UTF-8 encoding always begins a codepoint, since a lead byte is
+ * never taken as part of an earlier sequence.
+ */
+long inspectfindchar(inspecttext const *text, unsigned long offset,
+		     unsigned int uchar)
+{
+    unsigned char const *p, *end;
+    unsigned char utf8[4];
+    long value;
+    int size;
+
+    size = encodeutf8(uchar, utf8);
+    offset += inspectdecode(text, offset, &value);
+    if (offset + size > text->size)
+	return -1;
+    end = text->data + text->size - size + 1;
+    for (p = text->data + offset ; p < end ; ++p) {
+	p = memchr(p, utf8[0], end - p);
+	if (!p)
+	    break;
+	if (!memcmp(p, utf8, size))
+	    return p - text->data;
+    }
+    return -1;
+}
@@ -0,0 +1,106 @@
+/*
+ * inspect.h: Decoding arbitrary text for inspection.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _inspect_h_
+#define _inspect_h_
+
+/* A piece of text being inspected. The text is not decoded in
+ * advance; each codepoint is decoded as it is needed, so even very
+ * large texts can be browsed without delay.
+ */
+typedef struct inspecttext {
+    unsigned char const *data;	/* the text, as UTF-8 (or not) */
+    unsigned long size;		/* the size of the text in bytes */
+    int owned;			/* 1 if data was allocated, 2 if mapped */
+} inspecttext;
+
+/* Use the given string as the text to inspect. The string is not
+ * copied, and must remain valid while the text is in use.
+ */
+extern void inspectstring(inspecttext *text, char const *str);
+
+/* Read the entire contents of the given file descriptor as the text
+ * to inspect. A regular file is mapped into memory instead of being
+ * read. The return value is false if the text could not be read, in
+ * which case errno describes the error.
+ */
+extern int inspectread(inspecttext *text, int fd);
+
+/* Release the memory held by a text.
+ */
+extern void inspectfree(inspecttext *text);
+
+/* Decode the codepoint at the given byte offset, store its value in
+ * uchar, and return the number of bytes it occupies. A maximal
+ * subpart of an ill-formed sequence is treated as a single unit,
+ * whose value is stored as -1. The return value is zero if offset is
+ * at the end of the text.
+ */
+extern int inspectdecode(inspecttext const *text, unsigned long offset,
+			 long *uchar);
+
+/* Return the offset of the codepoint (or ill-formed sequence) that
+ * contains the byte at the given offset.
+ */
+extern unsigned long inspectstart(inspecttext const *text,
+				  unsigned long offset);
+
+/* Return the offset of the codepoint that precedes the one at the
+ * given offset, or zero if there is none.
+ */
+extern unsigned long inspectprev(inspecttext const *text,
+				 unsigned long offset);
+
+/* Return true if a grapheme cluster boundary falls before the
+ * codepoint at the given offset. The rules of UAX #29 are followed
+ * as closely as the character data allows: combining marks, joiners,
+ * emoji modifiers, and other zero-width extenders stay with the
+ * preceding character, as do the parts of a Hangul syllable, pairs
+ * of regional indicators, emoji joined by ZWJ, and CR LF.
+ */
+extern int inspectboundary(inspecttext const *text, unsigned long offset);
+
+/* Return true if a codepoint is worth stopping at when looking for
+ * unusual characters, which is to say anything other than printable
+ * ASCII, tab, and newline. A value of -1, for an ill-formed
+ * sequence, is always unusual.
+ */
+extern int inspectunusual(long uchar);
+
+/* Return the offset of the next unusual character after the one at
+ * offset, going in the given direction (+1 or -1), or -1 if there is
+ * none.
+ */
+extern long inspectfindunusual(inspecttext const *text, unsigned long offset,
+			       int direction);
+
+/* Return the offset of the next occurrence of the given codepoint
+ * after the one at offset, or -1 if there is none.
+ */
+extern long inspectfindchar(inspecttext const *text, unsigned long offset,
+			    unsigned int uchar);
+
+#endif
@@ -0,0 +1,535 @@
+/*
+ * lookup.c: Finding characters by codepoint, block, and name.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+#include "data.h"
+#include "lookup.h"
+
+/* The value of the highest possible Unicode codepoint.
+ */
+unsigned int const lastucharval = 0x0010FFFF;
+
+/* The direct lookup table used by charindex(), which maps each page
+ * of 256 codepoints to its page of charlist indices, and the flag
+ * that ensures that it is only built once.
+ */
+static unsigned short charpagemap[0x1100];
+static int *charpages = NULL;
+static pthread_once_t charindexonce = PTHREAD_ONCE_INIT;
+
+/* The number of distinct three-letter sequences (trigrams) that are
+ * indexed. Letters, digits, spaces, and hyphens each have their own
+ * code, and all other bytes share a single code.
+ */
+#define TRIGRAMCOUNT (40 * 40 * 40)
+
+/* The index of the trigrams in the character names. The charlist
+ * indices of the characters whose names contain each trigram are
+ * stored in ascending order in nameindexlist, starting at the
+ * position given in nameindexstarts. The index is built by whichever
+ * thread first calls nameindexinit(), and nameindexbuilt is only set,
+ * under the lock, once it is complete.
+ */
+static int *nameindexstarts = NULL;
+static int *nameindexlist = NULL;
+static int nameindexbuilt = 0;
+static pthread_once_t nameindexonce = PTHREAD_ONCE_INIT;
+static pthread_mutex_t nameindexlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Find the codepoint with the value uchar in the charlist array and
+ * return its index. If uchar doesn't map to a defined codepoint,
+ * return the nearest one.
+ */
+int lookupchar(int uchar)
+{
+    int top, bottom, n;
+
+    top = 0;
+    bottom = charlistsize - 1;
+    while (bottom - top > 1) {
+	n = (top + bottom) / 2;
+	if (charlist[n].uchar < uchar)
+	    top = n;
+	else if (charlist[n].uchar > uchar)
+	    bottom = n;
+	else
+	    return n;
+    }
+    return uchar - charlist[top].uchar < charlist[bottom].uchar - uchar ?
+		top : bottom;
+}
+
+/* Build the direct lookup table for charindex(). The table has two
+ * levels: the upper bits of a codepoint select a page, and the lower
+ * eight bits select an entry within it. All the pages that contain no
+ * defined codepoints share a single page of -1 entries.
+ */
+static void buildcharindex(void)
+{
+    int pagecount, lastpage, page, i;
+
+    pagecount = 1;
+    lastpage = -1;
+    for (i = 0 ; i < charlistsize ; ++i) {
+	if ((int)(charlist[i].uchar >> 8) != lastpage) {
+	    lastpage = charlist[i].uchar >> 8;
+	    ++pagecount;
+	}
+    }
+    charpages = malloc(pagecount * 256 * sizeof *charpages);
+    if (!charpages)
+	return;
+    for (i = 0 ; i < 256 ; ++i)
+	charpages[i] = -1;
+    memset(charpagemap, 0, sizeof charpagemap);
+    pagecount = 1;
+    for (i = 0 ; i < charlistsize ; ++i) {
+	page = charlist[i].uchar >> 8;
+	if (!charpagemap[page]) {
+	    charpagemap[page] = pagecount++;
+	    memcpy(charpages + charpagemap[page] * 256, charpages,
+		   256 * sizeof *charpages);
+	}
+	charpages[charpagemap[page] * 256 + (charlist[i].uchar & 255)] = i;
+    }
+}
+
+/* Build the direct lookup table, if it has not been built already.
+ */
+int charindexinit(void)
+{
+    pthread_once(&charindexonce, buildcharindex);
+    return charpages != NULL;
+}
+
+/* Return the index of the codepoint with the value uchar in the
+ * charlist array, or -1 if it is not defined. The direct lookup table
+ * is built on the first call; if that fails, a binary search is used
+ * instead.
+ */
+int charindex(unsigned int uchar)
+{
+    int n;
+
+    if (uchar > lastucharval)
+	return -1;
+    if (!charindexinit()) {
+	n = lookupchar(uchar);
+	return charlist[n].uchar == uchar ? n : -1;
+    }
+    return charpages[charpagemap[uchar >> 8] * 256 + (uchar & 255)];
+}
+
+/* Return the index of the block containing uchar, or -1 if it is not
+ * in any block.
+ */
+int findblock(unsigned int uchar)
+{
+    int top, bottom, n;
+
+    top = 0;
+    bottom = blocklistsize;
+    while (top < bottom) {
+	n = (top + bottom) / 2;
+	if (blocklist[n].to < uchar)
+	    top = n + 1;
+	else
+	    bottom = n;
+    }
+    if (top < blocklistsize && blocklist[top].from <= uchar)
+	return top;
+    return -1;
+}
+
+/* Return true if no defined codepoint falls within the block.
+ */
+int isemptyblock(int block)
+{
+    int n;
+
+    n = findcharafter(blocklist[block].from);
+    return n == charlistsize || charlist[n].uchar > blocklist[block].to;
+}
+
+/* Return the index of the first codepoint in the charlist array whose
+ * value is uchar or greater. If there is no such codepoint, the size
+ * of the array is returned.
+ */
+int findcharafter(unsigned int uchar)
+{
+    int top, bottom, n;
+
+    top = 0;
+    bottom = charlistsize;
+    while (top < bottom) {
+	n = (top + bottom) / 2;
+	if (charlist[n].uchar < uchar)
+	    top = n + 1;
+	else
+	    bottom = n;
+    }
+    return top;
+}
+
+/* Return true if the given substring appears in the official name of
+ * the index-th codepoint.
+ */
+int namecontains(int index, char const *substring)
+{
+    char buf[256];
+    char const *p;
+    int size;
+
+    p = charnamebuffer + charlist[index].nameoffset;
+    size = charlist[index].namesize;
+    if (!memchr(p, *substring, size))
+	return 0;
+    memcpy(buf, p, size);
+    buf[size] = '\0';
+    return strstr(buf, substring) != NULL;
+}
+
+/* Return the index of the trigram that starts at str, which must
+ * have at least three bytes.
+ */
+static int trigramkey(char const *str)
+{
+    int key, ch, i;
+
+    key = 0;
+    for (i = 0 ; i < 3 ; ++i) {
+	ch = (unsigned char)str[i];
+	if (ch >= 'a' && ch <= 'z')
+	    ch = ch - 'a' + 1;
+	else if (ch >= '0' && ch <= '9')
+	    ch = ch - '0' + 27;
+	else
+	    ch = ch == ' ' ? 37 : ch == '-' ? 38 : 39;
+	key = key * 40 + ch;
+    }
+    return key;
+}
+
+/* Build the index of the trigrams in the names. The first pass counts
+ * the names containing each trigram, and the second pass fills in the
+ * lists. A trigram that appears more than once in a name is only
+ * listed once for it.
+ */
+static void buildnameindex(void)
+{
+    int *starts, *list, *next;
+    char const *name;
+    int size, key, i, j;
+
+    starts = calloc(TRIGRAMCOUNT + 1, sizeof *starts);
+    next = malloc(TRIGRAMCOUNT * sizeof *next);
+    if (!starts || !next) {
+	free(starts);
+	free(next);
+	return;
+    }
+    for (key = 0 ; key < TRIGRAMCOUNT ; ++key)
+	next[key] = -1;
+    for (i = 0 ; i < charlistsize ; ++i) {
+	name = charnamebuffer + charlist[i].nameoffset;
+	size = charlist[i].namesize;
+	for (j = 0 ; j + 3 <= size ; ++j) {
+	    key = trigramkey(name + j);
+	    if (next[key] != i) {
+		next[key] = i;
+		++starts[key + 1];
+	    }
+	}
+    }
+    for (key = 0 ; key < TRIGRAMCOUNT ; ++key)
+	starts[key + 1] += starts[key];
+    list = malloc(starts[TRIGRAMCOUNT] * sizeof *list);
+    if (!list) {
+	free(starts);
+	free(next);
+	return;
+    }
+    memcpy(next, starts, TRIGRAMCOUNT * sizeof *next);
+    for (i = 0 ; i < charlistsize ; ++i) {
+	name = charnamebuffer + charlist[i].nameoffset;
+	size = charlist[i].namesize;
+	for (j = 0 ; j + 3 <= size ; ++j) {
+	    key = trigramkey(name + j);
+	    if (next[key] == starts[key] || list[next[key] - 1] != i)
+		list[next[key]++] = i;
+	}
+    }
+    free(next);
+
+    pthread_mutex_lock(&nameindexlock);
+    nameindexstarts = starts;
+    nameindexlist = list;
+    nameindexbuilt = 1;
+    pthread_mutex_unlock(&nameindexlock);
+}
+
+/* Build the index of the names, if it has not been built already.
+ */
+int nameindexinit(void)
+{
+    pthread_once(&nameindexonce, buildnameindex);
+    return nameindexready();
+}
+
+/* Return true if the index of the names is ready. The lock ensures
+ * that a thread which sees the flag set also sees the complete index.
+ */
+int nameindexready(void)
+{
+    int ready;
+
+    pthread_mutex_lock(&nameindexlock);
+    ready = nameindexbuilt;
+    pthread_mutex_unlock(&nameindexlock);
+    return ready;
+}
+
+/* Search for a substring of three or more bytes using the index of
+ * the names. Only the names listed under the substring's rarest
+ * trigram need to be examined, and they are visited in the same order
+ * as a full scan would visit them, starting after startpos and ending
+ * with startpos itself.
+ */
+static int findcharbyindex(char const *substring, int startpos, int direction)
+{
+    int const *list;
+    int count, key, pos, top, bottom, n, i;
+
+    list = NULL;
+    count = 0;
+    for (i = 0 ; substring[i + 1] && substring[i + 2] ; ++i) {
+	key = trigramkey(substring + i);
+	n = nameindexstarts[key + 1] - nameindexstarts[key];
+	if (!list || n < count) {
+	    list = nameindexlist + nameindexstarts[key];
+	    count = n;
+	}
+    }
+    if (!count)
+	return -1;
+
+    top = 0;
+    bottom = count;
+    while (top < bottom) {
+	n = (top + bottom) / 2;
+	if (list[n] < startpos || (direction > 0 && list[n] == startpos))
+	    top = n + 1;
+	else
+	    bottom = n;
+    }
+    for (i = 0 ; i < count ; ++i) {
+	if (direction > 0)
+	    pos = list[(top + i) % count];
+	else
+	    pos = list[(top + count - 1 - i) % count];
+	if (namecontains(pos, substring))
+	    return pos;
+    }
+    return -1;
+}
+
+/* Store the search string in lowercase, as the names are.
+ */
+int namesearchinit(namesearch *search, char const *substring)
+{
+    int n;
+
+    for (n = 0 ; substring[n] ; ++n) {
+	if (n + 1 >= (int)sizeof search->substring)
+	    return 0;
+	search->substring[n] = tolower((unsigned char)substring[n]);
+    }
+    search->substring[n] = '\0';
+    return n > 0;
+}
+
+/* Return the index of the next codepoint that contains the search
+ * string in its official name. The return value is negative if the
+ * string appears nowhere in any name. The index of the names is used
+ * if it is ready and the string is long enough to have a trigram;
+ * otherwise every name is examined in turn.
+ */
+int findcharbyname(namesearch const *search, int startpos, int direction)
+{
+    int pos;
+
+    if (!*search->substring)
+	return -1;
+    if (search->substring[1] && search->substring[2] && nameindexready())
+	return findcharbyindex(search->substring, startpos, direction);
+    pos = startpos;
+    for (;;) {
+	pos += direction;
+	if (pos >= charlistsize)
+	    pos = 0;
+	else if (pos < 0)
+	    pos = charlistsize - 1;
+	if (namecontains(pos, search->substring))
+	    return pos;
+	if (pos == startpos)
+	    return -1;
+    }
+}
+
+/* Store the loose form of a name in buf, for matching according to
+ * rule UAX44-LM2: case, spaces, underscores, and medial hyphens are
+ * ignored, except for the hyphen that distinguishes U+1180 HANGUL
+ * JUNGSEONG O-E from U+116C HANGUL JUNGSEONG OE. This must match the
+ * loosename() function in mkcharlist.py. The return value is false if
+ * the loose form doesn't fit in buf.
+ */
+static int loosename(char *buf, int bufsize, char const *name, int size)
+{
+    int hyphenat, n, i;
+
+    hyphenat = -1;
+    n = 0;
+    for (i = 0 ; i < size ; ++i) {
+	if (name[i] == ' ' || name[i] == '_')
+	    continue;
+	if (name[i] == '-' && i > 0 && i < size - 1
+			   && isalnum((unsigned char)name[i - 1])
+			   && isalnum((unsigned char)name[i + 1])) {
+	    hyphenat = n;
+	    continue;
+	}
+	if (n + 2 >= bufsize)
+	    return 0;
+	buf[n++] = tolower((unsigned char)name[i]);
+    }
+    buf[n] = '\0';
+    if (hyphenat == 16 && !strcmp(buf, "hanguljungseongoe"))
+	strcpy(buf, "hanguljungseongo-e");
+    return 1;
+}
+
+/* Mix the bits of a 32-bit hash value, using the MurmurHash3
+ * finalizer.
+ */
+static unsigned long fmix(unsigned long h)
+{
+    h ^= h >> 16;
+    h = (h * 0x85EBCA6BUL) & 0xFFFFFFFFUL;
+    h ^= h >> 13;
+    h = (h * 0xC2B2AE35UL) & 0xFFFFFFFFUL;
+    return h ^ (h >> 16);
+}
+
+/* Return the index of the character whose name or alias matches the
+ * given name, or -1 if there is none. Names are matched loosely, as
+ * per loosename(). The name is hashed to find the only slot in the
+ * perfect hash table that could hold it, so the time taken does not
+ * depend on the number of names. The hashing must match namehashes()
+ * in mkcharlist.py.
+ */
+int findcharbyexactname(char const *name)
+{
+    char key[256], candidate[256];
+    unsigned long a, b, h1, h2, h3;
+    char const *str;
+    int slot, size, i;
+
+    if (!loosename(key, sizeof key, name, strlen(name)) || !*key)
+	return -1;
+    a = 0x811C9DC5UL;
+    b = 0x9747B28CUL;
+    for (i = 0 ; key[i] ; ++i) {
+	a = ((a ^ (unsigned char)key[i]) * 0x01000193UL) & 0xFFFFFFFFUL;
+	b = ((b ^ (unsigned char)key[i]) * 0x5BD1E995UL) & 0xFFFFFFFFUL;
+    }
+
+    h1 = fmix(a);
+    h2 = fmix(b);
+    h3 = fmix(a ^ (b >> 15) ^ ((b << 17) & 0xFFFFFFFFUL)) | 1;
+
+    slot = namehashbuckets[h1 % namehashbucketcount];
+    if (slot < 0)
+	slot = -1 - slot;
+    else
+	slot = ((h2 + slot * h3) & 0xFFFFFFFFUL) % namehashsize;
+    i = namehashslots[slot];
+    if (i < charlistsize) {
+	str = charnamebuffer + charlist[i].nameoffset;
+	size = charlist[i].namesize;
+    } else {
+	i -= charlistsize;
+	str = charnamebuffer + aliaslist[i].nameoffset;
+	size = aliaslist[i].namesize;
+	i = aliaslist[i].index;
+    }
+    if (!loosename(candidate, sizeof candidate, str, size)
+			|| strcmp(candidate, key))
+	return -1;
+    return i;
+}
+
+/* Store the UTF-8 encoding of a codepoint in buf, and return the
+ * number of bytes used.
+ */
+int encodeutf8(unsigned int uchar, unsigned char *buf)
+{
+    if (uchar < 0x0080) {
+	buf[0] = uchar;
+	return 1;
+    } else if (uchar < 0x0800) {
+	buf[0] = 0xC0 | (uchar >> 6);
+	buf[1] = 0x80 | (uchar & 0x3F);
+	return 2;
+    } else if (uchar < 0x00010000) {
+	buf[0] = 0xE0 | (uchar >> 12);
+	buf[1] = 0x80 | ((uchar >> 6) & 0x3F);
+	buf[2] = 0x80 | (uchar & 0x3F);
+	return 3;
+    } else {
+	buf[0] = 0xF0 | (uchar >> 18);
+	buf[1] = 0x80 | ((uchar >> 12) & 0x3F);
+	buf[2] = 0x80 | ((uchar >> 6) & 0x3F);
+	buf[3] = 0x80 | (uchar & 0x3F);
+	return 4;
+    }
+}
+
+/* Store the UTF-16 encoding of a codepoint in units, and return the
+ * number of code units used.
+ */
+int encodeutf16(unsigned int uchar, unsigned int *units)
+{
+    if (uchar < 0x00010000) {
+	units[0] = uchar;
+	return 1;
+    }
+    units[0] = 0xD800 | ((uchar - 0x00010000) >> 10);
+    units[1] = 0xDC00 | ((uchar - 0x00010000) & 0x03FF);
+    return 2;
+}
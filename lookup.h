@@ -0,0 +1,132 @@
+/*
+ * lookup.h: Finding characters by codepoint, block, and name.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _lookup_h_
+#define _lookup_h_
+
+/* These functions make up the libubrowse library, together with the
+ * tables declared in data.h. None of them modify any shared state,
+ * apart from building the direct lookup table on first use, which is
+ * done safely, so all of them can be called from any thread.
+ */
+
+/* The value of the highest possible Unicode codepoint.
+ */
+extern unsigned int const lastucharval;
+
+/* The state of a search for a substring in the character names.
+ */
+typedef struct namesearch {
+    char substring[256];	/* the string to search for, in lowercase */
+} namesearch;
+
+/* Find the codepoint with the value uchar in the charlist array and
+ * return its index. If uchar doesn't map to a defined codepoint,
+ * return the nearest one.
+ */
+extern int lookupchar(int uchar);
+
+/* Build the direct lookup table used by charindex(), if it has not
+ * been built already. Calling this is optional, as charindex() builds
+ * the table itself when first called. The return value is false if
+ * memory could not be allocated for the table, in which case
+ * charindex() falls back to a binary search.
+ */
+extern int charindexinit(void);
+
+/* Return the index of the codepoint with the value uchar in the
+ * charlist array, or -1 if it is not defined. Unlike lookupchar(),
+ * this uses a direct lookup table instead of a binary search.
+ */
+extern int charindex(unsigned int uchar);
+
+/* Return the index of the block containing uchar, or -1 if it is not
+ * in any block.
+ */
+extern int findblock(unsigned int uchar);
+
+/* Return true if the block with the given index contains no defined
+ * codepoints.
+ */
+extern int isemptyblock(int block);
+
+/* Return the index of the first codepoint in the charlist array whose
+ * value is uchar or greater. If there is no such codepoint, the size
+ * of the array is returned.
+ */
+extern int findcharafter(unsigned int uchar);
+
+/* Return true if the given substring, which must be in lowercase,
+ * appears in the official name of the index-th codepoint.
+ */
+extern int namecontains(int index, char const *substring);
+
+/* Build the index of the three-letter sequences in the character
+ * names, if it has not been built already. Once the index is ready,
+ * findcharbyname() uses it to examine only the names that could
+ * contain the search string. It takes a moment to build, so
+ * findcharbyname() never waits for it, but scans all of the names
+ * until it is ready; a program can build it ahead of time, on another
+ * thread if need be. The return value is false if memory could not be
+ * allocated for the index.
+ */
+extern int nameindexinit(void);
+
+/* Return true if the index of the character names is ready for use.
+ */
+extern int nameindexready(void);
+
+/* Prepare a search for the given substring in the character names,
+ * ignoring case. The return value is false if the substring is empty
+ * or too long.
+ */
+extern int namesearchinit(namesearch *search, char const *substring);
+
+/* Return the index of the next codepoint after startpos, going in the
+ * given direction (+1 or -1) and wrapping around at either end, that
+ * contains the search string in its official name. The return value
+ * is negative if the string appears nowhere in any name.
+ */
+extern int findcharbyname(namesearch const *search, int startpos,
+			  int direction);
+
+/* Return the index of the character whose name or alias matches the
+ * given name, or -1 if there is none. Case, spaces, underscores, and
+ * medial hyphens are ignored, as per rule UAX44-LM2.
+ */
+extern int findcharbyexactname(char const *name);
+
+/* Store the UTF-8 encoding of a codepoint in buf, which must have room
+ * for four bytes, and return the number of bytes used.
+ */
+extern int encodeutf8(unsigned int uchar, unsigned char *buf);
+
+/* Store the UTF-16 encoding of a codepoint in units, which must have
+ * room for two code units, and return the number of code units used.
+ */
+extern int encodeutf16(unsigned int uchar, unsigned int *units);
+
+#endif
@@ -26,34 +26,103 @@
 
 import re
 import sys
+import bisect
 
 # This script parses the UnicodeData.txt file supplied by unicode.org
 # which describes the current set of Unicode characters, and extracts
 # the official name of each assigned codepoint and whether it is a
 # combining character. The script filters out control characters and
-# undefined sections. The data is then output as a C file containing
-# an array initialization statement.
+# undefined sections. If the EastAsianWidth.txt file is named on the
+# command line, it is also used to determine the display width that
+# the Unicode standard implies for each codepoint, and if the
+# NameAliases.txt file is named after it, the aliases of the
+# characters are included. The data is then output as a C file
+# containing array initialization statements, together with a perfect
+# hash table for looking up characters by their exact names.
 
 # A codepoint object corresponds to a single struct in the C array.
 # uchar is the Unicode codepoint number of the character. name is the
 # official name of the character. combining is True if the character
-# is a combining character.
+# is a combining character. width is the number of cells the character
+# should occupy.
 
 class codepoint(object):
-  def __init__(self, uchar, name, combining=False):
+  def __init__(self, uchar, name, combining=False, width=1):
     self.uchar = uchar
     self.combining = 1 if combining else 0
+    self.width = width
     self.name = name
     self.namesize = len(name)
     self.nameoffset = None
 
   def entry(self):
-    return '{{{0},{1},{2},{3}}}'.format(self.nameoffset, self.namesize,
-					self.uchar, self.combining)
+    return '{{{0},{1},{2},{3},{4}}}'.format(self.nameoffset, self.namesize,
+					    self.uchar, self.combining,
+					    self.width)
+
+# Parse the East Asian Width data file, if one was provided. Each line
+# contains a codepoint or a range of codepoints, and the property
+# value that applies to them, separated by a semicolon. The ranges are
+# stored in sorted order, so that they can be searched with bisect.
+
+eawstarts = []
+eawranges = []
+if len(sys.argv) > 1:
+  for line in open(sys.argv[1]):
+    m = re.match(r'([0-9A-F]+)(?:\.\.([0-9A-F]+))?\s*;\s*(\w+)', line)
+    if m:
+      first = int(m.group(1), 16)
+      last = int(m.group(2), 16) if m.group(2) else first
+      eawranges.append((first, last, m.group(3)))
+  eawranges.sort()
+  eawstarts = [r[0] for r in eawranges]
+
+# The format characters that are nonetheless visible: the soft hyphen,
+# and the prepended concatenation marks (such as the Arabic number
+# sign), which are displayed above or below the following digits.
+
+visibleformatchars = [ 0x00AD, 0x0600, 0x0601, 0x0602, 0x0603, 0x0604,
+		       0x0605, 0x06DD, 0x070F, 0x0890, 0x0891, 0x08E2,
+		       0x110BD, 0x110CD ]
+
+# Determine the display width of a codepoint. Combining marks, format
+# characters (other than the visible ones above), and the medial and
+# final conjoining jamo have zero width. Characters with an East Asian
+# Width of wide or fullwidth occupy two cells, and everything else one.
+
+def derivedwidth(uchar, flags):
+  if flags in ('Mn', 'Me'):
+    return 0
+  if flags == 'Cf' and uchar not in visibleformatchars:
+    return 0
+  if 0x1160 <= uchar <= 0x11FF or 0xD7B0 <= uchar <= 0xD7FF:
+    return 0
+  i = bisect.bisect_right(eawstarts, uchar) - 1
+  if i >= 0 and eawranges[i][1] >= uchar and eawranges[i][2] in ('W', 'F'):
+    return 2
+  return 1
+
+# An alias object corresponds to a single struct in the C array of
+# aliases. name is the alias, and index is the position in charlist of
+# the character it refers to.
+
+class alias(object):
+  def __init__(self, name, index):
+    self.name = name
+    self.namesize = len(name)
+    self.nameoffset = None
+    self.index = index
+
+  def entry(self):
+    return '{{{0},{1},{2}}}'.format(self.nameoffset, self.namesize,
+				    self.index)
 
 # The complete list of Unicode characters.
 charlist = []
 
+# The list of aliases.
+aliaslist = []
+
 # The size of the longest character name.
 maxnamesize = 0
 
@@ -82,15 +151,30 @@ for line in sys.stdin:
     if rstart:
       name = m.group(1).lower()
       for u in xrange(rstart, uchar + 1):
-	charlist.append(codepoint(u, name))
+	charlist.append(codepoint(u, name, False, derivedwidth(u, flags)))
       rstart = None
     else:
       rstart = uchar
   else:
-    charlist.append(codepoint(uchar, name, flags == 'Mn'))
+    charlist.append(codepoint(uchar, name, flags == 'Mn',
+			      derivedwidth(uchar, flags)))
   if maxnamesize < charlist[-1].namesize:
     maxnamesize = charlist[-1].namesize
 
+# Parse the name aliases data file, if one was provided. Each line
+# contains a codepoint, an alias, and the type of the alias, separated
+# by semicolons. Aliases of characters that are not in the list (such
+# as the control characters) are ignored.
+
+if len(sys.argv) > 2:
+  indices = dict((char.uchar, i) for i, char in enumerate(charlist))
+  for line in open(sys.argv[2]):
+    m = re.match(r'([0-9A-F]+);([^;]+);', line)
+    if m and int(m.group(1), 16) in indices:
+      aliaslist.append(alias(m.group(2).lower(), indices[int(m.group(1), 16)]))
+      if maxnamesize < aliaslist[-1].namesize:
+	maxnamesize = aliaslist[-1].namesize
+
 # Transfer all the names into a single heap of strings. The strings
 # are added to the heap in order of length, longest to shortest, so as
 # to identify (and collapse) names that are substrings of longer
@@ -100,14 +184,115 @@ sys.stderr.write('Parsing the codepoint list ...\n')
 
 nameheap = ''
 for size in xrange(maxnamesize, 0, -1):
-  for char in charlist:
+  for char in charlist + aliaslist:
     if char.namesize != size:
       continue
     char.nameoffset = nameheap.find(char.name)
     if char.nameoffset == -1:
       char.nameoffset = len(nameheap)
       nameheap += char.name
-    char.name = None
+
+# Names are matched loosely, following rule UAX44-LM2 of the Unicode
+# standard: case, spaces, underscores, and medial hyphens (those
+# between two letters or digits) are ignored. The one exception is the
+# hyphen in U+1180 HANGUL JUNGSEONG O-E, which distinguishes it from
+# U+116C HANGUL JUNGSEONG OE. This function must match the one in
+# ubrowse.c exactly.
+
+def loosename(name):
+  key = ''
+  hyphenat = -1
+  for i in xrange(len(name)):
+    c = name[i]
+    if c in ' _':
+      continue
+    if c == '-' and 0 < i < len(name) - 1 and name[i - 1].isalnum() \
+		 and name[i + 1].isalnum():
+      hyphenat = len(key)
+      continue
+    key += c.lower()
+  if key == 'hanguljungseongoe' and hyphenat == 16:
+    key = 'hanguljungseongo-e'
+  return key
+
+# A key is hashed twice, using FNV-1a with two different multipliers,
+# and three values are derived from the two hashes using the MurmurHash3
+# finalizer. The third value is always odd. These too must match the
+# functions in ubrowse.c.
+
+def fmix(h):
+  h ^= h >> 16
+  h = (h * 0x85EBCA6B) & 0xFFFFFFFF
+  h ^= h >> 13
+  h = (h * 0xC2B2AE35) & 0xFFFFFFFF
+  return h ^ (h >> 16)
+
+def namehashes(key):
+  a = 0x811C9DC5
+  b = 0x9747B28C
+  for c in key:
+    a = ((a ^ ord(c)) * 0x01000193) & 0xFFFFFFFF
+    b = ((b ^ ord(c)) * 0x5BD1E995) & 0xFFFFFFFF
+  return (fmix(a), fmix(b),
+	  fmix((a ^ (b >> 15) ^ (b << 17)) & 0xFFFFFFFF) | 1)
+
+# Build a minimal perfect hash table over the loose forms of the names
+# and aliases, using the "hash and displace" method. The first hash
+# assigns each key to a bucket, with an average of four keys to a
+# bucket. Then, starting with the largest buckets, each bucket is
+# given a displacement d such that the slots (h2 + d * h3) mod n of
+# all of its keys are unoccupied. Buckets holding a single key are
+# left until last, and are simply given the position of a free slot,
+# stored as -1 - slot. Each slot holds a key number: an index into
+# charlist, or charlistsize plus an index into aliaslist. A key whose
+# loose form duplicates an earlier one is left out of the table.
+
+sys.stderr.write('Building the name hash table ...\n')
+
+keys = {}
+for i, char in enumerate(charlist + aliaslist):
+  key = loosename(char.name)
+  if key not in keys:
+    keys[key] = i
+  char.name = None
+hashsize = len(keys)
+bucketcount = (hashsize + 3) // 4
+buckets = [[] for i in xrange(bucketcount)]
+for key, i in keys.iteritems():
+  h = namehashes(key)
+  buckets[h[0] % bucketcount].append((i, h[1], h[2]))
+order = sorted(xrange(bucketcount), key=lambda b: -len(buckets[b]))
+displacements = [0] * bucketcount
+slots = [-1] * hashsize
+for b in order:
+  if len(buckets[b]) <= 1:
+    break
+  d = 0
+  while True:
+    taken = [((h2 + d * h3) & 0xFFFFFFFF) % hashsize
+	     for i, h2, h3 in buckets[b]]
+    if len(set(taken)) == len(taken) and \
+       all(slots[slot] < 0 for slot in taken):
+      break
+    d += 1
+    if d > hashsize:
+      sys.stderr.write('unable to build the name hash table\n')
+      sys.exit(1)
+  displacements[b] = d
+  for slot, (i, h2, h3) in zip(taken, buckets[b]):
+    slots[slot] = i
+free = (slot for slot in xrange(hashsize) if slots[slot] < 0)
+for b in order:
+  if len(buckets[b]) == 1:
+    slot = free.next()
+    displacements[b] = -1 - slot
+    slots[slot] = buckets[b][0][0]
+
+# Output a list of integers as the body of a C array initializer.
+
+def writeints(values):
+  for i in xrange(0, len(values), 12):
+    sys.stdout.write(','.join(str(v) for v in values[i:i+12]) + ',\n')
 
 # Finally, output the list of characters and the heap of name strings
 # as C initialization statements.
@@ -121,8 +306,23 @@ for char in charlist:
 
 sys.stdout.write(
     '};\n'
-    'int const charlistsize = sizeof charlist / sizeof *charlist;\n'
-    'char const *charnamebuffer = "\\\n')
+    'int const charlistsize = sizeof charlist / sizeof *charlist;\n')
+sys.stdout.write('aliasinfo const aliaslist[] = {\n')
+for a in aliaslist:
+  sys.stdout.write(a.entry() + ',\n')
+if not aliaslist:
+  sys.stdout.write('{0,0,0}\n')
+sys.stdout.write('};\n')
+sys.stdout.write('int const aliaslistsize = {0};\n'.format(len(aliaslist)))
+sys.stdout.write('int const namehashsize = {0};\n'.format(hashsize))
+sys.stdout.write('int const namehashslots[] = {\n')
+writeints(slots)
+sys.stdout.write('};\n')
+sys.stdout.write('int const namehashbucketcount = {0};\n'.format(bucketcount))
+sys.stdout.write('int const namehashbuckets[] = {\n')
+writeints(displacements)
+sys.stdout.write('};\n')
+sys.stdout.write('char const *charnamebuffer = "\\\n')
 for i in xrange(0, len(nameheap), 76):
   sys.stdout.write(nameheap[i:i+76] + '\\\n')
 sys.stdout.write('";\n')
@@ -0,0 +1,567 @@
+/*
+ * probe.c: Measuring how the terminal displays characters.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE
+#define _XOPEN_SOURCE_EXTENDED
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <errno.h>
+#include <wchar.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "data.h"
+#include "probe.h"
+
+/* The width of a codepoint is measured by displaying it at the start
+ * of a line, and then sending the DSR (device status report) escape
+ * sequence, to which the terminal replies with the cursor position.
+ * Instead of waiting for each reply in turn, a whole batch of
+ * codepoints is displayed and queried with a single write, and then
+ * the replies are collected in order. This way the time taken is
+ * dominated by the number of batches, rather than the number of
+ * codepoints.
+ */
+
+/* The measured widths are saved in a cache file, so that a terminal
+ * only needs to be probed once. The file begins with a header that
+ * identifies the terminal the measurements were made on, followed by
+ * a bitmap holding two bits for each Unicode codepoint. A value of 0
+ * indicates an unmeasured codepoint; otherwise the value is one more
+ * than the measured width. Because the layout of the file is fixed,
+ * the program can map it directly into memory at startup.
+ */
+
+/* The header of a width cache file.
+ */
+typedef struct widthcacheheader {
+    char magic[8];		/* identifies the file format */
+    char key[248];		/* the terminal the widths apply to */
+} widthcacheheader;
+
+/* The string identifying the file format.
+ */
+static char const cachemagic[8] = "UBWIDTH1";
+
+/* The total number of Unicode codepoints.
+ */
+#define UCHARCOUNT 0x110000
+
+/* The size of a width cache file.
+ */
+#define CACHEFILESIZE (sizeof(widthcacheheader) + UCHARCOUNT / 4)
+
+/* The number of codepoints measured in a single batch. The replies to
+ * a batch need to fit within the terminal's input buffer.
+ */
+#define BATCHSIZE 256
+
+/* How long to wait, in milliseconds, for the terminal to reply before
+ * giving up on it.
+ */
+static int const replytimeout = 2000;
+
+/* How long to wait, in milliseconds, for the terminal to identify
+ * itself. This is kept short as it happens at startup.
+ */
+static int const idtimeout = 500;
+
+/* The memory-mapped width cache, and whether it is writable.
+ */
+static unsigned char *widthcache = NULL;
+static int widthcachewritable = 0;
+
+/* Set when the user interrupts the probing.
+ */
+static volatile sig_atomic_t interrupted = 0;
+
+/* The signal handler that was in place before probing began.
+ */
+static void (*savedsiginthandler)(int);
+
+/* The file descriptor of the terminal being probed.
+ */
+static int ttyfd = -1;
+
+/* The terminal's original settings.
+ */
+static struct termios savedtermios;
+
+/* Handle an interrupt from the user during probing.
+ */
+static void handlesigint(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+}
+
+/* Open the controlling terminal and put it into raw mode.
+ */
+int probeopen(void)
+{
+    struct termios t;
+
+    ttyfd = open("/dev/tty", O_RDWR | O_NOCTTY);
+    if (ttyfd < 0)
+	return 0;
+    if (tcgetattr(ttyfd, &savedtermios)) {
+	close(ttyfd);
+	ttyfd = -1;
+	return 0;
+    }
+    t = savedtermios;
+    t.c_lflag &= ~(ICANON | ECHO);
+    t.c_cc[VMIN] = 0;
+    t.c_cc[VTIME] = 0;
+    tcsetattr(ttyfd, TCSANOW, &t);
+    interrupted = 0;
+    savedsiginthandler = signal(SIGINT, handlesigint);
+    return 1;
+}
+
+/* Restore the terminal's original settings.
+ */
+void probeclose(void)
+{
+    if (ttyfd < 0)
+	return;
+    tcsetattr(ttyfd, TCSADRAIN, &savedtermios);
+    signal(SIGINT, savedsiginthandler);
+    close(ttyfd);
+    ttyfd = -1;
+}
+
+/* Write the entire contents of a buffer to the terminal.
+ */
+static int writeall(char const *buf, int size)
+{
+    int n;
+
+    while (size) {
+	n = write(ttyfd, buf, size);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return 0;
+	}
+	buf += n;
+	size -= n;
+    }
+    return 1;
+}
+
+/* Read cursor position reports from the terminal, storing the column
+ * values in cols, until count reports have been received. Any other
+ * input is discarded. The return value is the number of reports
+ * received before the terminal stopped responding.
+ */
+static int readreplies(int *cols, int count)
+{
+    struct pollfd pfd;
+    char buf[1024];
+    int state, col, got, size, i;
+
+    pfd.fd = ttyfd;
+    pfd.events = POLLIN;
+    state = col = 0;
+    got = 0;
+    while (got < count) {
+	if (poll(&pfd, 1, replytimeout) <= 0)
+	    break;
+	size = read(ttyfd, buf, sizeof buf);
+	if (size <= 0)
+	    break;
+	for (i = 0 ; i < size ; ++i) {
+	    switch (state) {
+	      case 0:
+		if (buf[i] == '\033')
+		    state = 1;
+		break;
+	      case 1:
+		state = buf[i] == '[' ? 2 : 0;
+		col = 0;
+		break;
+	      case 2:
+		if (buf[i] < '0' || buf[i] > '9')
+		    state = buf[i] == ';' ? 3 : 0;
+		break;
+	      case 3:
+		if (buf[i] >= '0' && buf[i] <= '9') {
+		    col = col * 10 + buf[i] - '0';
+		} else {
+		    if (buf[i] == 'R' && got < count)
+			cols[got++] = col;
+		    state = 0;
+		}
+		break;
+	    }
+	}
+    }
+    return got;
+}
+
+/* Return a pointer to the first occurrence of the byte sequence seq
+ * in the buffer, or NULL if it isn't present.
+ */
+static char const *findseq(char const *buf, int size, char const *seq)
+{
+    int n = strlen(seq);
+    int i;
+
+    for (i = 0 ; i + n <= size ; ++i)
+	if (!memcmp(buf + i, seq, n))
+	    return buf + i;
+    return NULL;
+}
+
+/* Ask the terminal to identify itself, using both XTVERSION (which
+ * gives the name and version of the terminal program) and the
+ * secondary device attributes request. These are followed by a cursor
+ * position request, which every terminal answers, so that the replies
+ * can be collected without waiting for a timeout on terminals that
+ * ignore one or both of the queries.
+ */
+char const *probeterminalid(void)
+{
+    static char id[200];
+    struct pollfd pfd;
+    char buf[512];
+    char const *p, *q;
+    int size, n;
+
+    *id = '\0';
+    if (ttyfd < 0)
+	return id;
+    if (!writeall("\033[>0q\033[>c\033[6n", 13))
+	return id;
+    pfd.fd = ttyfd;
+    pfd.events = POLLIN;
+    size = 0;
+    for (;;) {
+	if (size == sizeof buf || poll(&pfd, 1, idtimeout) <= 0)
+	    break;
+	n = read(ttyfd, buf + size, sizeof buf - size);
+	if (n <= 0)
+	    break;
+	size += n;
+	if (buf[size - 1] == 'R')
+	    break;
+    }
+
+    p = findseq(buf, size, "\033P>|");
+    if (p) {
+	p += 4;
+	for (q = p ; q < buf + size && *q != '\033' && *q != '\007' ; ++q) ;
+	n = q - p;
+	if (n > 120)
+	    n = 120;
+	memcpy(id, p, n);
+	id[n] = '\0';
+    }
+    p = findseq(buf, size, "\033[>");
+    if (p) {
+	p += 3;
+	for (q = p ; q < buf + size && *q != 'c' ; ++q) ;
+	if (q < buf + size) {
+	    n = strlen(id);
+	    id[n++] = '|';
+	    if (q - p > (int)sizeof id - n - 1)
+		q = p + sizeof id - n - 1;
+	    memcpy(id + n, p, q - p);
+	    id[n + (q - p)] = '\0';
+	}
+    }
+    return id;
+}
+
+/* Find the size of a character cell in pixels, from the window size
+ * if the terminal driver knows it, or else by asking the terminal.
+ * The cursor position request that follows the query ensures that a
+ * terminal which ignores it doesn't cause a delay.
+ */
+int probecellsize(int *width, int *height)
+{
+    struct winsize ws;
+    struct pollfd pfd;
+    char buf[256];
+    char const *p;
+    int size, n, h, w;
+
+    if (ttyfd < 0)
+	return 0;
+    if (!ioctl(ttyfd, TIOCGWINSZ, &ws) && ws.ws_xpixel && ws.ws_ypixel
+				       && ws.ws_col && ws.ws_row) {
+	*width = ws.ws_xpixel / ws.ws_col;
+	*height = ws.ws_ypixel / ws.ws_row;
+	return *width > 0 && *height > 0;
+    }
+    if (!writeall("\033[16t\033[6n", 9))
+	return 0;
+    pfd.fd = ttyfd;
+    pfd.events = POLLIN;
+    size = 0;
+    for (;;) {
+	if (size == sizeof buf - 1 || poll(&pfd, 1, idtimeout) <= 0)
+	    break;
+	n = read(ttyfd, buf + size, sizeof buf - 1 - size);
+	if (n <= 0)
+	    break;
+	size += n;
+	if (buf[size - 1] == 'R')
+	    break;
+    }
+    buf[size] = '\0';
+    p = findseq(buf, size, "\033[6;");
+    if (!p || sscanf(p + 4, "%d;%dt", &h, &w) != 2 || w <= 0 || h <= 0)
+	return 0;
+    *width = w;
+    *height = h;
+    return 1;
+}
+
+/* True if the user interrupted the probing.
+ */
+int probeinterrupted(void)
+{
+    return interrupted;
+}
+
+/* Measure the widths of a range of codepoints, one batch at a time.
+ */
+int probewidths(unsigned char *widths, int from, int to)
+{
+    char buf[BATCHSIZE * (MB_LEN_MAX + 8) + 16];
+    int indices[BATCHSIZE], cols[BATCHSIZE];
+    mbstate_t state;
+    int size, count, got, total, hidden, n, i;
+
+    if (ttyfd < 0)
+	return -1;
+    total = 0;
+    hidden = 0;
+    while (from < to && !interrupted) {
+	size = 0;
+	if (!hidden) {
+	    memcpy(buf, "\033[?25l", 6);
+	    size = 6;
+	}
+	count = 0;
+	for ( ; from < to && count < BATCHSIZE ; ++from) {
+	    if (widths[from] != WIDTH_UNKNOWN)
+		continue;
+	    buf[size++] = '\r';
+	    memset(&state, 0, sizeof state);
+	    n = wcrtomb(buf + size, charlist[from].uchar, &state);
+	    if (n <= 0) {
+		--size;
+		continue;
+	    }
+	    size += n;
+	    memcpy(buf + size, "\033[6n", 4);
+	    size += 4;
+	    indices[count++] = from;
+	}
+	if (!count)
+	    break;
+	memcpy(buf + size, "\r\033[K", 4);
+	size += 4;
+	if (!writeall(buf, size))
+	    break;
+	hidden = 1;
+	got = readreplies(cols, count);
+	for (i = 0 ; i < got ; ++i)
+	    widths[indices[i]] = cols[i] < 1 ? WIDTH_UNKNOWN :
+				 cols[i] > 3 ? 2 : cols[i] - 1;
+	total += got;
+	if (got < count) {
+	    if (!total)
+		total = -1;
+	    break;
+	}
+    }
+    if (hidden)
+	writeall("\033[?25h", 6);
+    return total;
+}
+
+/*
+ * The width cache.
+ */
+
+/* Build the full pathname of a file in the program's cache directory.
+ */
+int cachefilepath(char *filename, int size, char const *name, int mkdirs)
+{
+    struct stat st;
+    char const *dir;
+
+    dir = getenv("XDG_CACHE_HOME");
+    if (dir && *dir) {
+	if ((int)(strlen(dir) + strlen(name)) + 16 > size)
+	    return 0;
+	sprintf(filename, "%s/ubrowse", dir);
+    } else {
+	dir = getenv("HOME");
+	if (!dir || (int)(strlen(dir) + strlen(name)) + 24 > size)
+	    return 0;
+	sprintf(filename, "%s/.cache", dir);
+	if (mkdirs)
+	    mkdir(filename, 0755);
+	strcat(filename, "/ubrowse");
+    }
+    if (mkdirs)
+	mkdir(filename, 0755);
+    else if (stat(filename, &st) || !S_ISDIR(st.st_mode))
+	return 0;
+    strcat(filename, "/");
+    strcat(filename, name);
+    return 1;
+}
+
+/* Build the name of the cache file for the current terminal, and the
+ * key identifying the terminal, which is stored in the file's header.
+ * The cache directory is checked first, so that the terminal isn't
+ * queried unless there is a cache to be found.
+ */
+static int cachefilename(char *filename, int size, char *key, int keysize,
+			 int mkdirs)
+{
+    char const *term;
+    unsigned long hash;
+    int n;
+
+    if (!cachefilepath(filename, size - 16, "", mkdirs))
+	return 0;
+
+    term = getenv("TERM");
+    if (!term)
+	term = "";
+    if ((int)(strlen(term) + strlen(unicodeversion)) + 32 >= keysize)
+	return 0;
+    sprintf(key, "TERM=%s;UNICODE=%s;ID=", term, unicodeversion);
+    n = strlen(key);
+    if (ttyfd >= 0)
+	sprintf(key + n, "%.*s", keysize - n - 1, probeterminalid());
+
+    hash = 2166136261UL;
+    for (n = 0 ; key[n] ; ++n)
+	hash = ((hash ^ (unsigned char)key[n]) * 16777619UL) & 0xFFFFFFFFUL;
+    sprintf(filename + strlen(filename), "widths-%08lx", hash);
+    return 1;
+}
+
+/* Map the width cache for the current terminal into memory.
+ */
+int widthcacheopen(int writable)
+{
+    widthcacheheader header;
+    char filename[1024];
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (widthcache)
+	return 1;
+    memset(&header, 0, sizeof header);
+    memcpy(header.magic, cachemagic, sizeof header.magic);
+    if (!cachefilename(filename, sizeof filename,
+		       header.key, sizeof header.key, writable))
+	return 0;
+    fd = open(filename, writable ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0)
+	return 0;
+    if (fstat(fd, &st) || (st.st_size != (off_t)CACHEFILESIZE
+					&& (!writable || st.st_size != 0))) {
+	close(fd);
+	return 0;
+    }
+    if (st.st_size == 0) {
+	if (ftruncate(fd, CACHEFILESIZE)
+			|| write(fd, &header, sizeof header) != sizeof header) {
+	    close(fd);
+	    return 0;
+	}
+    }
+    map = mmap(NULL, CACHEFILESIZE,
+	       writable ? PROT_READ | PROT_WRITE : PROT_READ,
+	       MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return 0;
+    if (memcmp(map, &header, sizeof header)) {
+	munmap(map, CACHEFILESIZE);
+	return 0;
+    }
+    widthcache = (unsigned char*)map + sizeof header;
+    widthcachewritable = writable;
+    return 1;
+}
+
+/* Unmap the width cache.
+ */
+void widthcacheclose(void)
+{
+    void *map;
+
+    if (!widthcache)
+	return;
+    map = widthcache - sizeof(widthcacheheader);
+    if (widthcachewritable)
+	msync(map, CACHEFILESIZE, MS_SYNC);
+    munmap(map, CACHEFILESIZE);
+    widthcache = NULL;
+}
+
+/* Look up a measured width in the cache.
+ */
+int cachedwidth(unsigned int uchar)
+{
+    if (!widthcache || uchar >= UCHARCOUNT)
+	return -1;
+    return ((widthcache[uchar >> 2] >> ((uchar & 3) * 2)) & 3) - 1;
+}
+
+/* Store a measured width in the cache.
+ */
+void setcachedwidth(unsigned int uchar, int width)
+{
+    int shift;
+
+    if (!widthcache || !widthcachewritable || uchar >= UCHARCOUNT)
+	return;
+    if (width < 0 || width > 2)
+	width = -1;
+    shift = (uchar & 3) * 2;
+    widthcache[uchar >> 2] = (widthcache[uchar >> 2] & ~(3 << shift))
+			   | ((width + 1) << shift);
+}
@@ -0,0 +1,99 @@
+/*
+ * probe.h: Measuring how the terminal displays characters.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _probe_h_
+#define _probe_h_
+
+/* The value used for a width that has not been measured.
+ */
+#define WIDTH_UNKNOWN 0xFF
+
+/* Open the controlling terminal and put it into a state suitable for
+ * probing. The return value is false if the terminal is unavailable.
+ */
+extern int probeopen(void);
+
+/* Restore the terminal to its original state.
+ */
+extern void probeclose(void);
+
+/* Return a string identifying the terminal program, as reported by
+ * the terminal itself. An empty string is returned if the terminal
+ * does not identify itself. The terminal must be open for probing.
+ */
+extern char const *probeterminalid(void);
+
+/* Find the size of a character cell in pixels, and store it in width
+ * and height. The return value is false if the size is unknown. The
+ * terminal must be open for probing.
+ */
+extern int probecellsize(int *width, int *height);
+
+/* Measure the number of cells the terminal uses to display each of
+ * the codepoints in charlist from index from up to (but not including)
+ * index to. The widths are stored in the widths array, which is
+ * indexed by position in charlist. Entries that already contain a
+ * width other than WIDTH_UNKNOWN are skipped. The return value is the
+ * number of codepoints measured, or -1 if the terminal stopped
+ * responding. Measuring stops early if the user interrupts it.
+ */
+extern int probewidths(unsigned char *widths, int from, int to);
+
+/* True if the user interrupted the most recent call to probewidths().
+ */
+extern int probeinterrupted(void);
+
+/* Store in filename the pathname of the file with the given name in
+ * the program's cache directory. If mkdirs is true, the directory is
+ * created if necessary; otherwise, the return value is false if the
+ * directory doesn't exist.
+ */
+extern int cachefilepath(char *filename, int size, char const *name,
+			 int mkdirs);
+
+/* Find the cache of measured widths belonging to the current terminal
+ * and map it into memory. The cache is identified by the terminal
+ * type, the terminal's own identification, and the Unicode version.
+ * If writable is true, the cache is created if it doesn't exist
+ * already. The return value is false if no cache is available.
+ */
+extern int widthcacheopen(int writable);
+
+/* Unmap the width cache, saving any changes.
+ */
+extern void widthcacheclose(void);
+
+/* Return the measured width of a codepoint from the width cache, or
+ * -1 if the width has not been measured.
+ */
+extern int cachedwidth(unsigned int uchar);
+
+/* Store the measured width of a codepoint in the width cache. The
+ * cache must have been opened as writable.
+ */
+extern void setcachedwidth(unsigned int uchar, int width);
+
+#endif
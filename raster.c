@@ -0,0 +1,736 @@
+/*
+ * raster.c: Rendering glyphs from TrueType font files.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 500
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "raster.h"
+
+/* Glyphs are read directly from the glyf table of a TrueType font.
+ * The outline is flattened into line segments, and each segment adds
+ * its signed area to an accumulation buffer. A running sum over the
+ * buffer then gives the exact coverage of every pixel, which provides
+ * antialiasing without supersampling. Composite glyphs are drawn by
+ * drawing their components with the transformation given for each.
+ */
+
+/* The number of font files kept mapped into memory.
+ */
+#define MAXFONTS 8
+
+/* The deepest nesting of composite glyphs that is followed.
+ */
+#define MAXDEPTH 8
+
+/* A mapped font file.
+ */
+typedef struct fontfile {
+    char *path;			/* the font's filename */
+    unsigned char const *data;	/* the contents of the file */
+    unsigned long size;		/* the size of the file */
+    unsigned long lastused;	/* when the file was last used */
+} fontfile;
+
+/* The tables of a single font needed to render its glyphs.
+ */
+typedef struct fonttables {
+    unsigned char const *data;	/* the contents of the font file */
+    unsigned long size;		/* the size of the font file */
+    unsigned long cmap;		/* the offset of the cmap table */
+    unsigned long glyf;		/* the offset of the glyf table */
+    unsigned long loca;		/* the offset of the loca table */
+    unsigned long glyfsize;	/* the size of the glyf table */
+    unsigned int glyphcount;	/* the number of glyphs in the font */
+    int longloca;		/* true if loca has 32-bit offsets */
+    int ascender;		/* the ascender, in font units */
+    int descender;		/* the descender (negative), in font units */
+} fonttables;
+
+/* The state of a glyph being rendered. The transformation maps font
+ * units to pixels.
+ */
+typedef struct raster {
+    float *acc;			/* the accumulation buffer */
+    int width, height;		/* the size of the image */
+    double matrix[6];		/* the current transformation */
+} raster;
+
+/* The mapped font files.
+ */
+static fontfile fontfiles[MAXFONTS];
+static unsigned long usecount = 0;
+
+/* Read big-endian values from a font file.
+ */
+static unsigned int get16(unsigned char const *p)
+{
+    return (p[0] << 8) | p[1];
+}
+static int gets16(unsigned char const *p)
+{
+    int n = get16(p);
+
+    return n >= 0x8000 ? n - 0x10000 : n;
+}
+static unsigned long get32(unsigned char const *p)
+{
+    return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16)
+				       | (p[2] << 8) | p[3];
+}
+
+/* Return the contents of a font file, mapping it into memory if it
+ * isn't already. The least recently used file is unmapped to make
+ * room if necessary.
+ */
+static fontfile *openfontfile(char const *path)
+{
+    fontfile *font;
+    struct stat st;
+    void *map;
+    int fd, i;
+
+    font = fontfiles;
+    for (i = 0 ; i < MAXFONTS ; ++i) {
+	if (fontfiles[i].path && !strcmp(fontfiles[i].path, path)) {
+	    fontfiles[i].lastused = ++usecount;
+	    return fontfiles + i;
+	}
+	if (fontfiles[i].lastused < font->lastused)
+	    font = fontfiles + i;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+	return NULL;
+    if (fstat(fd, &st) || st.st_size < 12) {
+	close(fd);
+	return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+	return NULL;
+    if (font->path) {
+	munmap((void*)font->data, font->size);
+	free(font->path);
+    }
+    font->path = malloc(strlen(path) + 1);
+    if (!font->path) {
+	munmap(map, st.st_size);
+	font->lastused = 0;
+	return NULL;
+    }
+    strcpy(font->path, path);
+    font->data = map;
+    font->size = st.st_size;
+    font->lastused = ++usecount;
+    return font;
+}
+
+/* Locate the tables of the font whose table directory begins at the
+ * given offset. The return value is false if any required table is
+ * missing, which includes fonts that have CFF outlines.
+ */
+static int findtables(fonttables *tables, unsigned char const *data,
+		      unsigned long size, unsigned long offset)
+{
+    unsigned long head = 0, hhea = 0, maxp = 0;
+    unsigned long count, i, at;
+    unsigned char const *entry;
+
+    memset(tables, 0, sizeof *tables);
+    tables->data = data;
+    tables->size = size;
+    if (offset + 12 > size)
+	return 0;
+    count = get16(data + offset + 4);
+    if (offset + 12 + count * 16 > size)
+	return 0;
+    for (i = 0 ; i < count ; ++i) {
+	entry = data + offset + 12 + i * 16;
+	at = get32(entry + 8);
+	if (at + get32(entry + 12) > size || at + get32(entry + 12) < at)
+	    continue;
+	if (!memcmp(entry, "cmap", 4))
+	    tables->cmap = at;
+	else if (!memcmp(entry, "glyf", 4)) {
+	    tables->glyf = at;
+	    tables->glyfsize = get32(entry + 12);
+	} else if (!memcmp(entry, "loca", 4))
+	    tables->loca = at;
+	else if (!memcmp(entry, "head", 4) && get32(entry + 12) >= 54)
+	    head = at;
+	else if (!memcmp(entry, "hhea", 4) && get32(entry + 12) >= 36)
+	    hhea = at;
+	else if (!memcmp(entry, "maxp", 4) && get32(entry + 12) >= 6)
+	    maxp = at;
+    }
+    if (!tables->cmap || !tables->glyf || !tables->loca
+		      || !head || !hhea || !maxp)
+	return 0;
+    tables->longloca = get16(data + head + 50) != 0;
+    tables->ascender = gets16(data + hhea + 4);
+    tables->descender = gets16(data + hhea + 6);
+    tables->glyphcount = get16(data + maxp + 4);
+    if (tables->ascender <= tables->descender)
+	return 0;
+    if (tables->loca + (tables->glyphcount + 1) * (tables->longloca ? 4 : 2)
+			> size)
+	return 0;
+    return 1;
+}
+
+/* Find the glyph for a codepoint in a format 4 subtable.
+ */
+static unsigned int lookupformat4(unsigned char const *data,
+				  unsigned long size, unsigned int uchar)
+{
+    unsigned long segcount, first, last, offset, addr, i;
+    unsigned int delta, glyph;
+
+    if (size < 14 || uchar > 0xFFFF)
+	return 0;
+    segcount = get16(data + 6) / 2;
+    if (16 + segcount * 8 > size)
+	return 0;
+    for (i = 0 ; i < segcount ; ++i) {
+	last = get16(data + 14 + i * 2);
+	if (last >= uchar)
+	    break;
+    }
+    if (i == segcount)
+	return 0;
+    first = get16(data + 16 + segcount * 2 + i * 2);
+    if (first > uchar)
+	return 0;
+    delta = get16(data + 16 + segcount * 4 + i * 2);
+    offset = get16(data + 16 + segcount * 6 + i * 2);
+    if (!offset)
+	return (uchar + delta) & 0xFFFF;
+    addr = 16 + segcount * 6 + i * 2 + offset + (uchar - first) * 2;
+    if (addr + 2 > size)
+	return 0;
+    glyph = get16(data + addr);
+    return glyph ? (glyph + delta) & 0xFFFF : 0;
+}
+
+/* Find the glyph for a codepoint in a format 12 subtable. The groups
+ * are sorted, so they are searched with a binary search.
+ */
+static unsigned int lookupformat12(unsigned char const *data,
+				   unsigned long size, unsigned int uchar)
+{
+    unsigned long count, lo, hi, mid, first, last;
+
+    if (size < 16)
+	return 0;
+    count = get32(data + 12);
+    if (count > (size - 16) / 12)
+	count = (size - 16) / 12;
+    lo = 0;
+    hi = count;
+    while (lo < hi) {
+	mid = (lo + hi) / 2;
+	first = get32(data + 16 + mid * 12);
+	last = get32(data + 20 + mid * 12);
+	if (uchar < first)
+	    hi = mid;
+	else if (uchar > last)
+	    lo = mid + 1;
+	else
+	    return get32(data + 24 + mid * 12) + (uchar - first);
+    }
+    return 0;
+}
+
+/* Find the glyph for a codepoint in the font's Unicode cmap
+ * subtables. Zero is returned if the font has no glyph for it.
+ */
+static unsigned int lookupglyph(fonttables const *tables, unsigned int uchar)
+{
+    unsigned char const *data = tables->data;
+    unsigned long cmap = tables->cmap;
+    unsigned long count, sub, i;
+    unsigned int platform, encoding, glyph;
+
+    if (cmap + 4 > tables->size)
+	return 0;
+    count = get16(data + cmap + 2);
+    if (cmap + 4 + count * 8 > tables->size)
+	return 0;
+    for (i = 0 ; i < count ; ++i) {
+	platform = get16(data + cmap + 4 + i * 8);
+	encoding = get16(data + cmap + 6 + i * 8);
+	sub = cmap + get32(data + cmap + 8 + i * 8);
+	if (platform != 0 && !(platform == 3 && (encoding == 1
+						 || encoding == 10)))
+	    continue;
+	if (sub + 2 > tables->size)
+	    continue;
+	switch (get16(data + sub)) {
+	  case 4:
+	    glyph = lookupformat4(data + sub, tables->size - sub, uchar);
+	    break;
+	  case 12:
+	    glyph = lookupformat12(data + sub, tables->size - sub, uchar);
+	    break;
+	  default:
+	    glyph = 0;
+	    break;
+	}
+	if (glyph && glyph < tables->glyphcount)
+	    return glyph;
+    }
+    return 0;
+}
+
+/* Return a pointer to a glyph's data in the glyf table, and store its
+ * size in size. NULL is returned if the glyph has no outline.
+ */
+static unsigned char const *glyphdata(fonttables const *tables,
+				      unsigned int glyph, unsigned long *size)
+{
+    unsigned char const *loca = tables->data + tables->loca;
+    unsigned long from, to;
+
+    if (glyph >= tables->glyphcount)
+	return NULL;
+    if (tables->longloca) {
+	from = get32(loca + glyph * 4);
+	to = get32(loca + glyph * 4 + 4);
+    } else {
+	from = get16(loca + glyph * 2) * 2UL;
+	to = get16(loca + glyph * 2 + 2) * 2UL;
+    }
+    if (to <= from || to > tables->glyfsize || to - from < 10)
+	return NULL;
+    *size = to - from;
+    return tables->data + tables->glyf + from;
+}
+
+/* Add a line segment, in pixel coordinates, to the accumulation
+ * buffer. Each row that the line crosses receives the signed area
+ * between the line and the right edge of the image, spread over the
+ * pixels that the line passes through.
+ */
+static void drawline(raster *r, double x0, double y0, double x1, double y1)
+{
+    double dir, dxdy, x, xnext, dy, d, xa, xb, s, a0, a1, a2, am, f;
+    float *row;
+    int y, ylast, xai, xbi, i;
+
+    if (y0 == y1)
+	return;
+    dir = 1.0;
+    if (y0 > y1) {
+	dir = -1.0;
+	x = x0;  x0 = x1;  x1 = x;
+	x = y0;  y0 = y1;  y1 = x;
+    }
+    dxdy = (x1 - x0) / (y1 - y0);
+    x = x0;
+    if (y0 < 0.0) {
+	x -= y0 * dxdy;
+	y0 = 0.0;
+    }
+    if (y1 > r->height)
+	y1 = r->height;
+    ylast = (int)ceil(y1);
+    for (y = (int)y0 ; y < ylast ; ++y) {
+	row = r->acc + y * r->width;
+	dy = (y + 1 < y1 ? y + 1 : y1) - (y > y0 ? y : y0);
+	xnext = x + dxdy * dy;
+	d = dy * dir;
+	xa = x < xnext ? x : xnext;
+	xb = x < xnext ? xnext : x;
+	xai = (int)floor(xa);
+	xbi = (int)ceil(xb);
+	if (xbi <= xai + 1) {
+	    f = 0.5 * (x + xnext) - xai;
+	    row[xai] += d - d * f;
+	    row[xai + 1] += d * f;
+	} else {
+	    s = 1.0 / (xb - xa);
+	    f = xa - xai;
+	    a0 = 0.5 * s * (1.0 - f) * (1.0 - f);
+	    f = xb - xbi + 1.0;
+	    am = 0.5 * s * f * f;
+	    row[xai] += d * a0;
+	    if (xbi == xai + 2) {
+		row[xai + 1] += d * (1.0 - a0 - am);
+	    } else {
+		a1 = s * (1.5 - (xa - xai));
+		row[xai + 1] += d * (a1 - a0);
+		for (i = xai + 2 ; i < xbi - 1 ; ++i)
+		    row[i] += d * s;
+		a2 = a1 + (xbi - xai - 3) * s;
+		row[xbi - 1] += d * (1.0 - a2 - am);
+	    }
+	    row[xbi] += d * am;
+	}
+	x = xnext;
+    }
+}
+
+/* Transform a point from font units into pixels, keeping it within
+ * the horizontal bounds of the image.
+ */
+static void transform(raster const *r, double fx, double fy,
+		      double *x, double *y)
+{
+    *x = r->matrix[0] * fx + r->matrix[2] * fy + r->matrix[4];
+    *y = r->matrix[1] * fx + r->matrix[3] * fy + r->matrix[5];
+    if (*x < 0.0)
+	*x = 0.0;
+    else if (*x > r->width - 1)
+	*x = r->width - 1;
+}
+
+/* Add a quadratic curve, in font units, to the accumulation buffer,
+ * by dividing it into enough line segments to follow it closely.
+ */
+static void drawcurve(raster *r, double fx0, double fy0, double fx1,
+		      double fy1, double fx2, double fy2)
+{
+    double x0, y0, x1, y1, x2, y2, ddx, ddy, t, px, py, x, y;
+    int n, i;
+
+    transform(r, fx0, fy0, &x0, &y0);
+    transform(r, fx1, fy1, &x1, &y1);
+    transform(r, fx2, fy2, &x2, &y2);
+    ddx = x0 - 2.0 * x1 + x2;
+    ddy = y0 - 2.0 * y1 + y2;
+    n = 1 + (int)sqrt(sqrt(3.0 * (ddx * ddx + ddy * ddy)));
+    px = x0;
+    py = y0;
+    for (i = 1 ; i <= n ; ++i) {
+	t = (double)i / n;
+	x = (1 - t) * (1 - t) * x0 + 2 * t * (1 - t) * x1 + t * t * x2;
+	y = (1 - t) * (1 - t) * y0 + 2 * t * (1 - t) * y1 + t * t * y2;
+	drawline(r, px, py, x, y);
+	px = x;
+	py = y;
+    }
+}
+
+/* Draw the contours of a simple glyph. Off-curve points are control
+ * points of quadratic curves, with an on-curve point implied midway
+ * between two consecutive off-curve points.
+ */
+static int drawsimple(raster *r, unsigned char const *data,
+		      unsigned long size, int contourcount)
+{
+    unsigned char const *p, *end, *flagp;
+    unsigned char *flags;
+    short *xs, *ys;
+    int pointcount, n, first, last, from, to, havectrl, i, k, v;
+    unsigned char flag;
+    double sx, sy, cx, cy, qx = 0.0, qy = 0.0;
+
+    end = data + size;
+    p = data + 10 + contourcount * 2;
+    if (p + 2 > end)
+	return 0;
+    pointcount = get16(p - 2) + 1;
+    p += 2 + get16(p);
+    if (p > end)
+	return 0;
+    flags = malloc(pointcount);
+    xs = malloc(pointcount * sizeof *xs);
+    ys = malloc(pointcount * sizeof *ys);
+    if (!flags || !xs || !ys)
+	goto failed;
+
+    for (i = 0 ; i < pointcount ; ) {
+	if (p >= end)
+	    goto failed;
+	flag = *p++;
+	n = 1;
+	if (flag & 8) {
+	    if (p >= end)
+		goto failed;
+	    n += *p++;
+	}
+	while (n-- && i < pointcount)
+	    flags[i++] = flag;
+    }
+    flagp = flags;
+    for (i = v = 0 ; i < pointcount ; ++i) {
+	if (flagp[i] & 2) {
+	    if (p >= end)
+		goto failed;
+	    v += flagp[i] & 16 ? *p : -*p;
+	    ++p;
+	} else if (!(flagp[i] & 16)) {
+	    if (p + 2 > end)
+		goto failed;
+	    v += gets16(p);
+	    p += 2;
+	}
+	xs[i] = v;
+    }
+    for (i = v = 0 ; i < pointcount ; ++i) {
+	if (flagp[i] & 4) {
+	    if (p >= end)
+		goto failed;
+	    v += flagp[i] & 32 ? *p : -*p;
+	    ++p;
+	} else if (!(flagp[i] & 32)) {
+	    if (p + 2 > end)
+		goto failed;
+	    v += gets16(p);
+	    p += 2;
+	}
+	ys[i] = v;
+    }
+
+    first = 0;
+    for (k = 0 ; k < contourcount ; ++k) {
+	last = get16(data + 10 + k * 2);
+	if (last < first || last >= pointcount)
+	    break;
+	from = first;
+	to = last;
+	if (flags[first] & 1) {
+	    sx = xs[first];
+	    sy = ys[first];
+	    ++from;
+	} else if (flags[last] & 1) {
+	    sx = xs[last];
+	    sy = ys[last];
+	    --to;
+	} else {
+	    sx = (xs[first] + xs[last]) / 2.0;
+	    sy = (ys[first] + ys[last]) / 2.0;
+	}
+	cx = sx;
+	cy = sy;
+	havectrl = 0;
+	for (i = from ; i <= to ; ++i) {
+	    if (flags[i] & 1) {
+		if (havectrl)
+		    drawcurve(r, cx, cy, qx, qy, xs[i], ys[i]);
+		else
+		    drawcurve(r, cx, cy, cx, cy, xs[i], ys[i]);
+		cx = xs[i];
+		cy = ys[i];
+		havectrl = 0;
+	    } else {
+		if (havectrl) {
+		    drawcurve(r, cx, cy, qx, qy, (qx + xs[i]) / 2.0,
+			      (qy + ys[i]) / 2.0);
+		    cx = (qx + xs[i]) / 2.0;
+		    cy = (qy + ys[i]) / 2.0;
+		}
+		qx = xs[i];
+		qy = ys[i];
+		havectrl = 1;
+	    }
+	}
+	if (havectrl)
+	    drawcurve(r, cx, cy, qx, qy, sx, sy);
+	else
+	    drawcurve(r, cx, cy, cx, cy, sx, sy);
+	first = last + 1;
+    }
+
+    free(flags);
+    free(xs);
+    free(ys);
+    return 1;
+
+  failed:
+    free(flags);
+    free(xs);
+    free(ys);
+    return 0;
+}
+
+/* Draw a glyph, which may be a composite of other glyphs.
+ */
+static int drawglyph(raster *r, fonttables const *tables,
+		     unsigned int glyph, int depth)
+{
+    unsigned char const *data, *p, *end;
+    unsigned long size;
+    unsigned int flags, component;
+    double saved[6], a, b, c, d, dx, dy;
+    int contourcount, drawn;
+
+    data = glyphdata(tables, glyph, &size);
+    if (!data)
+	return 0;
+    contourcount = gets16(data);
+    if (contourcount >= 0)
+	return drawsimple(r, data, size, contourcount);
+    if (depth >= MAXDEPTH)
+	return 0;
+
+    memcpy(saved, r->matrix, sizeof saved);
+    drawn = 0;
+    end = data + size;
+    p = data + 10;
+    do {
+	if (p + 4 > end)
+	    break;
+	flags = get16(p);
+	component = get16(p + 2);
+	p += 4;
+	if (flags & 1) {
+	    if (p + 4 > end)
+		break;
+	    dx = gets16(p);
+	    dy = gets16(p + 2);
+	    p += 4;
+	} else {
+	    if (p + 2 > end)
+		break;
+	    dx = (signed char)p[0];
+	    dy = (signed char)p[1];
+	    p += 2;
+	}
+	if (!(flags & 2))
+	    dx = dy = 0.0;
+	a = d = 1.0;
+	b = c = 0.0;
+	if (flags & 8) {
+	    if (p + 2 > end)
+		break;
+	    a = d = gets16(p) / 16384.0;
+	    p += 2;
+	} else if (flags & 0x40) {
+	    if (p + 4 > end)
+		break;
+	    a = gets16(p) / 16384.0;
+	    d = gets16(p + 2) / 16384.0;
+	    p += 4;
+	} else if (flags & 0x80) {
+	    if (p + 8 > end)
+		break;
+	    a = gets16(p) / 16384.0;
+	    b = gets16(p + 2) / 16384.0;
+	    c = gets16(p + 4) / 16384.0;
+	    d = gets16(p + 6) / 16384.0;
+	    p += 8;
+	}
+	r->matrix[0] = saved[0] * a + saved[2] * b;
+	r->matrix[1] = saved[1] * a + saved[3] * b;
+	r->matrix[2] = saved[0] * c + saved[2] * d;
+	r->matrix[3] = saved[1] * c + saved[3] * d;
+	r->matrix[4] = saved[0] * dx + saved[2] * dy + saved[4];
+	r->matrix[5] = saved[1] * dx + saved[3] * dy + saved[5];
+	if (drawglyph(r, tables, component, depth + 1))
+	    drawn = 1;
+    } while (flags & 0x20);
+    memcpy(r->matrix, saved, sizeof saved);
+    return drawn;
+}
+
+/* Render a glyph from a single font into the image.
+ */
+static int renderglyph(fonttables const *tables, unsigned int glyph,
+		       unsigned char *pixels, int width, int height)
+{
+    unsigned char const *data;
+    unsigned long size;
+    raster r;
+    double scale, xmin, xmax, sum;
+    int i;
+
+    data = glyphdata(tables, glyph, &size);
+    if (!data)
+	return 0;
+    xmin = gets16(data + 2);
+    xmax = gets16(data + 6);
+    scale = (double)height / (tables->ascender - tables->descender);
+    if (xmax > xmin && (xmax - xmin) * scale > width)
+	scale = width / (xmax - xmin);
+
+    r.width = width;
+    r.height = height;
+    r.acc = calloc(width * height + 2, sizeof *r.acc);
+    if (!r.acc)
+	return 0;
+    r.matrix[0] = scale;
+    r.matrix[1] = 0.0;
+    r.matrix[2] = 0.0;
+    r.matrix[3] = -scale;
+    r.matrix[4] = width / 2.0 - (xmin + xmax) / 2.0 * scale;
+    r.matrix[5] = tables->ascender * scale
+		  + (height - (tables->ascender - tables->descender)
+			      * scale) / 2.0;
+    if (!drawglyph(&r, tables, glyph, 0)) {
+	free(r.acc);
+	return 0;
+    }
+
+    sum = 0.0;
+    for (i = 0 ; i < width * height ; ++i) {
+	sum += r.acc[i];
+	pixels[i] = (unsigned char)(fabs(sum) >= 1.0 ? 255 : fabs(sum) * 255);
+    }
+    free(r.acc);
+    return 1;
+}
+
+/* Render a glyph from the first font in the file that has it.
+ */
+int rasterglyph(char const *path, unsigned int uchar,
+		unsigned char *pixels, int width, int height)
+{
+    fontfile *font;
+    fonttables tables;
+    unsigned long count, i, offset;
+    unsigned int glyph;
+
+    if (width < 1 || height < 1)
+	return 0;
+    font = openfontfile(path);
+    if (!font)
+	return 0;
+    count = 1;
+    if (!memcmp(font->data, "ttcf", 4))
+	count = get32(font->data + 8);
+    for (i = 0 ; i < count ; ++i) {
+	offset = 0;
+	if (count > 1 || !memcmp(font->data, "ttcf", 4)) {
+	    if (16 + i * 4 > font->size)
+		break;
+	    offset = get32(font->data + 12 + i * 4);
+	}
+	if (!findtables(&tables, font->data, font->size, offset))
+	    continue;
+	glyph = lookupglyph(&tables, uchar);
+	if (glyph && renderglyph(&tables, glyph, pixels, width, height))
+	    return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,41 @@
+/*
+ * raster.h: Rendering glyphs from TrueType font files.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _raster_h_
+#define _raster_h_
+
+/* Render the glyph for a codepoint from the given font file into an
+ * array of width * height coverage values, from 0 (empty) to 255
+ * (solid). The glyph is scaled so that the font's line height fills
+ * the image, and is centered horizontally. If the file is a font
+ * collection, the first font in it that has the glyph is used. The
+ * return value is false if the glyph is unavailable, including when
+ * the font's outlines are in CFF format, which is not supported.
+ */
+extern int rasterglyph(char const *path, unsigned int uchar,
+		       unsigned char *pixels, int width, int height);
+
+#endif
@@ -0,0 +1,373 @@
+/*
+ * servebench.c: Measuring the throughput of the lookup server.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+/* This program starts ubrowse as a lookup server, and then connects
+ * a varying number of clients to it at once. Each client sends its
+ * requests in windows of a fixed size, waiting for all of the replies
+ * to one window before sending the next, so that a window of one
+ * measures the round-trip time and larger windows measure how well
+ * the server handles pipelined requests. The requests are a mix of
+ * all the kinds that the server answers, with the exception of
+ * substring searches, whose cost would swamp everything else.
+ */
+
+/* A run of the benchmark.
+ */
+typedef struct scenario {
+    char const *name;		/* the scenario's name */
+    int clients;		/* the number of simultaneous clients */
+    int window;			/* the number of requests sent at once */
+} scenario;
+
+/* The scenarios.
+ */
+static scenario const scenarios[] = {
+    { "1x1", 1, 1 },
+    { "8x1", 8, 1 },
+    { "1x64", 1, 64 },
+    { "4x64", 4, 64 },
+    { "16x64", 16, 64 },
+    { "64x64", 64, 64 },
+    { "256x16", 256, 16 }
+};
+
+/* Names used in the exact-name requests.
+ */
+static char const *const names[] = {
+    "LATIN SMALL LETTER A", "greek capital letter omega",
+    "RIGHTWARDS ARROW", "snowman", "GRINNING FACE", "hiragana letter ka",
+    "Box Drawings Light Horizontal", "CJK UNIFIED IDEOGRAPH-4E00",
+    "HANGUL SYLLABLE GA", "byte order mark"
+};
+
+/* How long to wait for the server to start, in milliseconds.
+ */
+static int const starttimeout = 5000;
+
+/* The number of distinct request lines generated.
+ */
+#define REQUESTCOUNT 4096
+
+/* The generated requests, and the offset of each one in the text.
+ */
+static char requesttext[REQUESTCOUNT * 64];
+static int requestoffsets[REQUESTCOUNT + 1];
+
+/* The state of one client.
+ */
+typedef struct client {
+    char const *path;		/* the server's socket */
+    int requests;		/* the number of requests to send */
+    int window;			/* the number of requests sent at once */
+    int start;			/* the first request to send */
+    int errors;			/* the number of error replies */
+    int failed;			/* true if the connection failed */
+} client;
+
+/* Return the current time in seconds.
+ */
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Fill in the address of the server's socket.
+ */
+static void socketaddress(struct sockaddr_un *addr, char const *path)
+{
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    strncpy(addr->sun_path, path, sizeof addr->sun_path - 1);
+}
+
+/* Generate the request lines, using a fixed seed so that every run
+ * sends the same requests.
+ */
+static void makerequests(void)
+{
+    static char const *const commands[] = { "name-of", "block-of", "encode" };
+    unsigned long seed, cp;
+    char *p;
+    int i;
+
+    seed = 12345;
+    p = requesttext;
+    for (i = 0 ; i < REQUESTCOUNT ; ++i) {
+	requestoffsets[i] = p - requesttext;
+	seed = (seed * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	if (seed % 4 == 3)
+	    p += sprintf(p, "find %s\n", names[(seed >> 8) % 10]);
+	else {
+	    /* Leave out the surrogates, which the server rejects. */
+	    cp = (seed >> 8) % (0x30000 - 0x800);
+	    if (cp >= 0xD800)
+		cp += 0x800;
+	    p += sprintf(p, "%s U+%04lX\n", commands[seed % 4], cp);
+	}
+    }
+    requestoffsets[i] = p - requesttext;
+}
+
+/* Send a client's requests and check its replies.
+ */
+static void *runclient(void *arg)
+{
+    client *c = arg;
+    struct sockaddr_un addr;
+    char buf[65536];
+    char const *p;
+    int fd, first, last, count, sent, newlines, n;
+
+    socketaddress(&addr, c->path);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr*)&addr, sizeof addr)) {
+	c->failed = 1;
+	return NULL;
+    }
+    for (sent = 0 ; sent < c->requests ; sent += count) {
+	count = c->requests - sent < c->window ? c->requests - sent
+					       : c->window;
+	first = (c->start + sent) % REQUESTCOUNT;
+	n = 0;
+	while (n < count) {
+	    last = first + count - n;
+	    if (last > REQUESTCOUNT)
+		last = REQUESTCOUNT;
+	    if (write(fd, requesttext + requestoffsets[first],
+		      requestoffsets[last] - requestoffsets[first])
+			!= requestoffsets[last] - requestoffsets[first]) {
+		c->failed = 1;
+		break;
+	    }
+	    n += last - first;
+	    first = 0;
+	}
+	newlines = 0;
+	while (!c->failed && newlines < count) {
+	    n = read(fd, buf, sizeof buf);
+	    if (n <= 0) {
+		c->failed = 1;
+		break;
+	    }
+	    for (p = buf ; p < buf + n ; ++p) {
+		if (*p == '\n')
+		    ++newlines;
+		else if (*p == 'E' && (p == buf || p[-1] == '\n'))
+		    ++c->errors;
+	    }
+	}
+	if (c->failed)
+	    break;
+    }
+    close(fd);
+    return NULL;
+}
+
+/* Run a scenario, and return the number of requests answered per
+ * second, or a negative value if the scenario could not be run.
+ */
+static double runscenario(char const *path, scenario const *s, int requests,
+			  int *errors)
+{
+    pthread_t *threads;
+    client *clients;
+    double start, elapsed;
+    int failed, i;
+
+    threads = malloc(s->clients * sizeof *threads);
+    clients = malloc(s->clients * sizeof *clients);
+    if (!threads || !clients)
+	return -1.0;
+    start = now();
+    for (i = 0 ; i < s->clients ; ++i) {
+	clients[i].path = path;
+	clients[i].requests = requests / s->clients;
+	clients[i].window = s->window;
+	clients[i].start = i * 997;
+	clients[i].errors = 0;
+	clients[i].failed = 0;
+	if (pthread_create(&threads[i], NULL, runclient, &clients[i])) {
+	    clients[i].failed = 1;
+	    break;
+	}
+    }
+    failed = i < s->clients;
+    while (i--)
+	pthread_join(threads[i], NULL);
+    elapsed = now() - start;
+    *errors = 0;
+    for (i = 0 ; i < s->clients ; ++i) {
+	failed |= clients[i].failed;
+	*errors += clients[i].errors;
+    }
+    free(threads);
+    free(clients);
+    if (failed)
+	return -1.0;
+    return (requests / s->clients) * s->clients / elapsed;
+}
+
+/* Start the server, and wait until it accepts connections. The return
+ * value is the server's process ID, or -1 if it failed to start.
+ */
+static pid_t startserver(char const *program, char const *path)
+{
+    struct sockaddr_un addr;
+    struct timespec pause;
+    char arg[256];
+    pid_t pid;
+    int fd, waited, connected;
+
+    sprintf(arg, "--serve=%s", path);
+    pid = fork();
+    if (pid < 0)
+	return -1;
+    if (pid == 0) {
+	execl(program, program, arg, (char*)NULL);
+	fprintf(stderr, "servebench: %s: %s\n", program, strerror(errno));
+	_exit(127);
+    }
+    socketaddress(&addr, path);
+    pause.tv_sec = 0;
+    pause.tv_nsec = 10000000;
+    for (waited = 0 ; waited < starttimeout ; waited += 10) {
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0)
+	    break;
+	connected = !connect(fd, (struct sockaddr*)&addr, sizeof addr);
+	close(fd);
+	if (connected)
+	    return pid;
+	if (waitpid(pid, NULL, WNOHANG) == pid)
+	    return -1;
+	nanosleep(&pause, NULL);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/* Display the command-line usage and exit.
+ */
+static void usage(int status)
+{
+    fputs("Usage: servebench [-n COUNT] PROGRAM\n"
+	  "Run PROGRAM (ubrowse) as a lookup server and measure how many\n"
+	  "requests per second it answers, for varying numbers of clients\n"
+	  "and requests in flight.\n\n"
+	  "  -n COUNT    Requests to send in each scenario (default 200000).\n",
+	  status ? stderr : stdout);
+    exit(status);
+}
+
+/* Start the server, run all of the scenarios, and stop the server.
+ * The exit status is non-zero if any scenario failed to run, if any
+ * request received an error reply, or if the server did not shut
+ * down cleanly.
+ */
+int main(int argc, char *argv[])
+{
+    enum { count = sizeof scenarios / sizeof *scenarios };
+    char path[64];
+    double rate;
+    int requests = 200000;
+    int failed, errors, status, ch, i;
+    pid_t pid;
+
+    while ((ch = getopt(argc, argv, "n:h")) != -1) {
+	switch (ch) {
+	  case 'n':
+	    requests = atoi(optarg);
+	    if (requests < 1)
+		usage(EXIT_FAILURE);
+	    break;
+	  case 'h':	usage(EXIT_SUCCESS);			break;
+	  default:	usage(EXIT_FAILURE);			break;
+	}
+    }
+    if (optind != argc - 1)
+	usage(EXIT_FAILURE);
+    signal(SIGPIPE, SIG_IGN);
+
+    makerequests();
+    sprintf(path, "/tmp/servebench.%ld.sock", (long)getpid());
+    pid = startserver(argv[optind], path);
+    if (pid < 0) {
+	fprintf(stderr, "servebench: server did not start\n");
+	return EXIT_FAILURE;
+    }
+
+    failed = 0;
+    printf("%-8s %7s %6s %12s %10s\n", "scenario", "clients", "window",
+	   "requests/s", "us/window");
+    for (i = 0 ; i < count ; ++i) {
+	rate = runscenario(path, &scenarios[i], requests, &errors);
+	if (rate < 0) {
+	    printf("%-8s failed\n", scenarios[i].name);
+	    failed = 1;
+	    continue;
+	}
+	printf("%-8s %7d %6d %12.0f %10.1f", scenarios[i].name,
+	       scenarios[i].clients, scenarios[i].window, rate,
+	       1000000.0 * scenarios[i].clients * scenarios[i].window / rate);
+	if (errors) {
+	    printf("  (%d errors)", errors);
+	    failed = 1;
+	}
+	putchar('\n');
+	fflush(stdout);
+    }
+
+    kill(pid, SIGTERM);
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)
+			|| WEXITSTATUS(status)) {
+	fprintf(stderr, "servebench: server did not exit cleanly\n");
+	failed = 1;
+    }
+    if (!access(path, F_OK)) {
+	fprintf(stderr, "servebench: server left %s behind\n", path);
+	unlink(path);
+	failed = 1;
+    }
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
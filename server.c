@@ -0,0 +1,581 @@
+/*
+ * server.c: A line-oriented lookup service on a Unix domain socket.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "server.h"
+
+/* The main thread runs an event loop that accepts connections, reads
+ * requests, and writes replies, all without blocking. As soon as a
+ * connection has at least one complete line buffered, it is taken out
+ * of the loop and queued for the worker threads. The worker that
+ * takes it answers as many complete lines as its output buffer has
+ * room for, and hands the connection back to the event loop, waking
+ * it through a pipe. The event loop then sends the replies, and does
+ * not read any more from that client until they have all been sent,
+ * so a client that stops reading its replies only stalls itself, and
+ * the workers never wait on a socket. Since a connection belongs to
+ * only one thread at a time, no locking is needed for its buffers,
+ * and its replies cannot be reordered. Clients that send requests
+ * without waiting for the replies have them answered in batches,
+ * which amortizes the cost of the system calls and the thread
+ * handoffs.
+ */
+
+/* The maximum number of clients that can be connected at once.
+ */
+#define MAXCONNECTIONS 1024
+
+/* The size of the buffer for incoming requests on each connection,
+ * which is also the length limit for a single request.
+ */
+#define REQUESTBUFSIZE 4096
+
+/* The size of the buffer for outgoing replies on each connection.
+ */
+#define REPLYBUFSIZE 65536
+
+/* A connection to a client.
+ */
+typedef struct connection {
+    int fd;			/* the connected socket */
+    int busy;			/* true while queued for or held by a worker */
+    int finished;		/* true once the client has closed its end */
+    int failed;			/* true if the client stopped accepting replies */
+    int size;			/* the number of bytes in buf */
+    int outsize;		/* the number of bytes in out */
+    struct connection *next;	/* the next connection in the same queue */
+    char buf[REQUESTBUFSIZE];	/* the unanswered input from the client */
+    char out[REPLYBUFSIZE];	/* the replies not yet sent to the client */
+} connection;
+
+/* The function that answers requests.
+ */
+static serverhandler handler;
+
+/* All of the current connections.
+ */
+static connection *connections[MAXCONNECTIONS];
+static int connectioncount = 0;
+
+/* The queue of connections waiting for a worker, and the list of
+ * connections that the workers have finished with. Both are guarded
+ * by queuelock.
+ */
+static connection *workqueue = NULL;
+static connection *workqueuetail = NULL;
+static connection *donelist = NULL;
+static int stopping = 0;
+static pthread_mutex_t queuelock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queuecond = PTHREAD_COND_INITIALIZER;
+
+/* The pipe used to wake the event loop.
+ */
+static int wakepipe[2] = { -1, -1 };
+
+/* Set when the server has been asked to stop.
+ */
+static volatile sig_atomic_t interrupted = 0;
+
+/* Wake the event loop. If the pipe is already full, the event loop
+ * is certain to wake anyway.
+ */
+static void wake(void)
+{
+    int saved;
+
+    saved = errno;
+    if (write(wakepipe[1], "", 1) < 0)
+	errno = saved;
+}
+
+/* Handle a request to stop the server.
+ */
+static void handlestop(int sig)
+{
+    (void)sig;
+    interrupted = 1;
+    wake();
+}
+
+/* Write the entire contents of a buffer to a file descriptor. The
+ * return value is false if an error occurred.
+ */
+static int writeall(int fd, char const *buf, int size)
+{
+    int n;
+
+    while (size > 0) {
+	n = write(fd, buf, size);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return 0;
+	}
+	buf += n;
+	size -= n;
+    }
+    return 1;
+}
+
+/* Answer the complete lines in a connection's buffer, for as long as
+ * there is room for the replies in its output buffer, and remove them
+ * from the buffer. Any lines left over are answered once the replies
+ * have been sent.
+ */
+static void answer(connection *conn)
+{
+    char *line, *end, *nl;
+
+    line = conn->buf;
+    end = conn->buf + conn->size;
+    while (conn->outsize + SERVER_MAXREPLY + 1 <= REPLYBUFSIZE
+		&& (nl = memchr(line, '\n', end - line)) != NULL) {
+	*nl = '\0';
+	if (nl > line && nl[-1] == '\r')
+	    nl[-1] = '\0';
+	conn->outsize += handler(line, conn->out + conn->outsize);
+	conn->out[conn->outsize++] = '\n';
+	line = nl + 1;
+    }
+    conn->size = end - line;
+    memmove(conn->buf, line, conn->size);
+}
+
+/* The body of a worker thread: take connections from the queue,
+ * answer their requests, and return them to the event loop.
+ */
+static void *worker(void *arg)
+{
+    connection *conn;
+
+    (void)arg;
+    for (;;) {
+	pthread_mutex_lock(&queuelock);
+	while (!workqueue && !stopping)
+	    pthread_cond_wait(&queuecond, &queuelock);
+	if (!workqueue) {
+	    pthread_mutex_unlock(&queuelock);
+	    break;
+	}
+	conn = workqueue;
+	workqueue = conn->next;
+	pthread_mutex_unlock(&queuelock);
+
+	answer(conn);
+
+	pthread_mutex_lock(&queuelock);
+	conn->next = donelist;
+	donelist = conn;
+	pthread_mutex_unlock(&queuelock);
+	wake();
+    }
+    return NULL;
+}
+
+/* Hand a connection over to the workers.
+ */
+static void enqueue(connection *conn)
+{
+    conn->busy = 1;
+    conn->next = NULL;
+    pthread_mutex_lock(&queuelock);
+    if (workqueue)
+	workqueuetail->next = conn;
+    else
+	workqueue = conn;
+    workqueuetail = conn;
+    pthread_cond_signal(&queuecond);
+    pthread_mutex_unlock(&queuelock);
+}
+
+/* Accept all of the pending connections on the listening socket.
+ * Connections beyond the maximum are closed immediately.
+ */
+static void acceptconnections(int listenfd)
+{
+    connection *conn;
+    int fd;
+
+    for (;;) {
+	fd = accept(listenfd, NULL, NULL);
+	if (fd < 0) {
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    break;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	conn = connectioncount < MAXCONNECTIONS ? malloc(sizeof *conn) : NULL;
+	if (!conn) {
+	    close(fd);
+	    continue;
+	}
+	conn->fd = fd;
+	conn->busy = 0;
+	conn->finished = 0;
+	conn->failed = 0;
+	conn->size = 0;
+	conn->outsize = 0;
+	connections[connectioncount++] = conn;
+    }
+}
+
+/* Read whatever a client has sent. This is only done while no
+ * replies are waiting to be sent and no complete request is waiting
+ * to be answered, so the buffer holds at most part of a request. When
+ * the client closes its end, a final request without a line ending is
+ * still answered. A request that does not fit in the buffer gets an
+ * error reply, and the connection is dropped.
+ */
+static void readrequests(connection *conn)
+{
+    static char const toolong[] = "ERR request too long\n";
+    int size;
+
+    size = read(conn->fd, conn->buf + conn->size, REQUESTBUFSIZE - conn->size);
+    if (size < 0 && (errno == EINTR || errno == EAGAIN))
+	return;
+    if (size <= 0) {
+	conn->finished = 1;
+	if (conn->size)
+	    conn->buf[conn->size++] = '\n';
+	return;
+    }
+    conn->size += size;
+    if (conn->size == REQUESTBUFSIZE
+		&& !memchr(conn->buf + conn->size - size, '\n', size)) {
+	memcpy(conn->out, toolong, sizeof toolong - 1);
+	conn->outsize = sizeof toolong - 1;
+	conn->size = 0;
+	conn->finished = 1;
+    }
+}
+
+/* Send as much of a connection's waiting replies as the socket will
+ * take without blocking. If the client has gone away, the replies are
+ * discarded and the connection is marked as failed.
+ */
+static void sendreplies(connection *conn)
+{
+    int n;
+
+    if (!conn->outsize)
+	return;
+    n = write(conn->fd, conn->out, conn->outsize);
+    if (n < 0) {
+	if (errno != EINTR && errno != EAGAIN) {
+	    conn->failed = 1;
+	    conn->outsize = 0;
+	}
+	return;
+    }
+    conn->outsize -= n;
+    memmove(conn->out, conn->out + n, conn->outsize);
+}
+
+/* Return true if a connection has a complete request waiting to be
+ * answered.
+ */
+static int haverequest(connection const *conn)
+{
+    return memchr(conn->buf, '\n', conn->size) != NULL;
+}
+
+/* Take back the connections that the workers have finished with.
+ */
+static void reclaimconnections(void)
+{
+    connection *conn;
+    char buf[256];
+
+    while (read(wakepipe[0], buf, sizeof buf) > 0) ;
+    pthread_mutex_lock(&queuelock);
+    conn = donelist;
+    donelist = NULL;
+    pthread_mutex_unlock(&queuelock);
+    for ( ; conn ; conn = conn->next) {
+	conn->busy = 0;
+	sendreplies(conn);
+    }
+}
+
+/* Queue the connections that have complete requests waiting, and no
+ * replies still to be sent, for the workers.
+ */
+static void dispatchrequests(void)
+{
+    int n;
+
+    for (n = 0 ; n < connectioncount ; ++n)
+	if (!connections[n]->busy && !connections[n]->failed
+				  && !connections[n]->outsize
+				  && haverequest(connections[n]))
+	    enqueue(connections[n]);
+}
+
+/* Close the connections whose clients have stopped accepting replies,
+ * or have finished and been sent all of their replies, once no worker
+ * holds them.
+ */
+static void closeconnections(void)
+{
+    connection *conn;
+    int n;
+
+    for (n = connectioncount - 1 ; n >= 0 ; --n) {
+	conn = connections[n];
+	if (conn->busy)
+	    continue;
+	if (conn->failed || (conn->finished && !conn->outsize
+					    && !haverequest(conn))) {
+	    close(connections[n]->fd);
+	    free(connections[n]);
+	    connections[n] = connections[--connectioncount];
+	}
+    }
+}
+
+/* Fill in the address of a Unix domain socket. The return value is
+ * false if the path is too long.
+ */
+static int socketaddress(struct sockaddr_un *addr, char const *path)
+{
+    if (strlen(path) >= sizeof addr->sun_path) {
+	errno = ENAMETOOLONG;
+	return 0;
+    }
+    memset(addr, 0, sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return 1;
+}
+
+/* Remove a socket file left over from an earlier run. The return
+ * value is false if a server is still answering on it.
+ */
+static int removestalesocket(struct sockaddr_un const *addr)
+{
+    int fd, stale;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+	return 0;
+    stale = connect(fd, (struct sockaddr const*)addr, sizeof *addr)
+		&& errno == ECONNREFUSED;
+    close(fd);
+    if (!stale) {
+	errno = EADDRINUSE;
+	return 0;
+    }
+    return !unlink(addr->sun_path);
+}
+
+/* Create a socket listening at path. The return value is the socket,
+ * or -1 if it could not be created.
+ */
+static int openlistener(char const *path)
+{
+    struct sockaddr_un addr;
+    int fd, saved;
+
+    if (!socketaddress(&addr, path))
+	return -1;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+	return -1;
+    if ((bind(fd, (struct sockaddr*)&addr, sizeof addr)
+		&& (errno != EADDRINUSE || !removestalesocket(&addr)
+			|| bind(fd, (struct sockaddr*)&addr, sizeof addr)))
+		|| listen(fd, SOMAXCONN)) {
+	saved = errno;
+	close(fd);
+	errno = saved;
+	return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return fd;
+}
+
+/* Run the server.
+ */
+int serverrun(char const *path, int threadcount, serverhandler h)
+{
+    static struct pollfd fds[MAXCONNECTIONS + 2];
+    static connection *polled[MAXCONNECTIONS];
+    pthread_t *threads;
+    int listenfd, count, n;
+
+    handler = h;
+    threads = malloc(threadcount * sizeof *threads);
+    if (!threads) {
+	errno = ENOMEM;
+	return 0;
+    }
+    if (pipe(wakepipe))
+	return 0;
+    fcntl(wakepipe[0], F_SETFL, fcntl(wakepipe[0], F_GETFL) | O_NONBLOCK);
+    fcntl(wakepipe[1], F_SETFL, fcntl(wakepipe[1], F_GETFL) | O_NONBLOCK);
+    listenfd = openlistener(path);
+    if (listenfd < 0)
+	return 0;
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, handlestop);
+    signal(SIGTERM, handlestop);
+    for (n = 0 ; n < threadcount ; ++n) {
+	errno = pthread_create(&threads[n], NULL, worker, NULL);
+	if (errno) {
+	    unlink(path);
+	    return 0;
+	}
+    }
+
+    while (!interrupted) {
+	fds[0].fd = listenfd;
+	fds[0].events = POLLIN;
+	fds[1].fd = wakepipe[0];
+	fds[1].events = POLLIN;
+	count = 0;
+	for (n = 0 ; n < connectioncount ; ++n) {
+	    if (connections[n]->busy
+			|| (connections[n]->finished && !connections[n]->outsize))
+		continue;
+	    fds[count + 2].fd = connections[n]->fd;
+	    fds[count + 2].events = connections[n]->outsize ? POLLOUT : POLLIN;
+	    polled[count++] = connections[n];
+	}
+	if (poll(fds, count + 2, -1) < 0)
+	    continue;
+	for (n = 0 ; n < count ; ++n) {
+	    if (!fds[n + 2].revents)
+		continue;
+	    if (polled[n]->outsize)
+		sendreplies(polled[n]);
+	    else
+		readrequests(polled[n]);
+	}
+	if (fds[1].revents)
+	    reclaimconnections();
+	dispatchrequests();
+	closeconnections();
+	if (fds[0].revents)
+	    acceptconnections(listenfd);
+    }
+
+    for (n = 0 ; n < connectioncount ; ++n)
+	shutdown(connections[n]->fd, SHUT_RDWR);
+    pthread_mutex_lock(&queuelock);
+    stopping = 1;
+    pthread_cond_broadcast(&queuecond);
+    pthread_mutex_unlock(&queuelock);
+    for (n = 0 ; n < threadcount ; ++n)
+	pthread_join(threads[n], NULL);
+    for (n = 0 ; n < connectioncount ; ++n) {
+	close(connections[n]->fd);
+	free(connections[n]);
+    }
+    connectioncount = 0;
+    close(listenfd);
+    unlink(path);
+    free(threads);
+    return 1;
+}
+
+/* Run the client. The socket is non-blocking, and input is only read
+ * once the previous input has been sent, so that the client never
+ * stops reading replies while the server is waiting to send them.
+ */
+int serverclient(char const *path)
+{
+    static char input[65536], output[65536];
+    struct sockaddr_un addr;
+    struct pollfd fds[2];
+    int fd, sending, pending, offset, n;
+
+    if (!socketaddress(&addr, path))
+	return 0;
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+	return 0;
+    if (connect(fd, (struct sockaddr*)&addr, sizeof addr))
+	return 0;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    sending = 1;
+    pending = 0;
+    offset = 0;
+    for (;;) {
+	fds[0].fd = fd;
+	fds[0].events = pending ? POLLIN | POLLOUT : POLLIN;
+	fds[1].fd = STDIN_FILENO;
+	fds[1].events = POLLIN;
+	if (poll(fds, sending && !pending ? 2 : 1, -1) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return 0;
+	}
+	if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+	    n = read(fd, output, sizeof output);
+	    if (n == 0)
+		break;
+	    if (n < 0 && errno != EINTR && errno != EAGAIN)
+		return 0;
+	    if (n > 0 && !writeall(STDOUT_FILENO, output, n))
+		return 0;
+	}
+	if (pending && (fds[0].revents & POLLOUT)) {
+	    n = write(fd, input + offset, pending);
+	    if (n < 0 && errno != EINTR && errno != EAGAIN)
+		return 0;
+	    if (n > 0) {
+		offset += n;
+		pending -= n;
+	    }
+	} else if (sending && !pending && fds[1].revents) {
+	    n = read(STDIN_FILENO, input, sizeof input);
+	    if (n < 0 && errno != EINTR)
+		return 0;
+	    if (n == 0) {
+		shutdown(fd, SHUT_WR);
+		sending = 0;
+	    } else if (n > 0) {
+		pending = n;
+		offset = 0;
+	    }
+	}
+    }
+    close(fd);
+    return 1;
+}
@@ -0,0 +1,63 @@
+/*
+ * server.h: A line-oriented lookup service on a Unix domain socket.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef _server_h_
+#define _server_h_
+
+/* The largest reply that a request handler may produce, not counting
+ * the newline that ends it.
+ */
+#define SERVER_MAXREPLY 4096
+
+/* A function that answers a single request. request is one line of
+ * input from a client, without its line ending. The reply, which is
+ * not terminated, is stored in reply, and its length is returned.
+ * The function is called from several threads at once, so it must
+ * not modify any shared state.
+ */
+typedef int (*serverhandler)(char const *request, char *reply);
+
+/* Listen for connections on the Unix domain socket at path, and
+ * answer each line that a client sends with a line from handler.
+ * Requests from different clients are answered concurrently by
+ * threadcount worker threads, while the replies to each client are
+ * kept in the order of its requests. The function returns when the
+ * process receives SIGINT or SIGTERM, after removing the socket. The
+ * return value is false if the socket could not be created, in which
+ * case errno describes the error.
+ */
+extern int serverrun(char const *path, int threadcount,
+		     serverhandler handler);
+
+/* Connect to the server listening at path, send it the lines read
+ * from standard input, and copy its replies to standard output. The
+ * requests are sent without waiting for each reply, so that input
+ * from a pipe is not limited by the round-trip time. The return value
+ * is false if an error occurred, in which case errno describes it.
+ */
+extern int serverclient(char const *path);
+
+#endif
@@ -36,12 +36,21 @@
 #include <wchar.h>
 #include <locale.h>
 #include <getopt.h>
+#include <unistd.h>
+#include <termios.h>
+#include <pthread.h>
+#include <sys/time.h>
 #include <ncurses.h>
 #include "data.h"
-
-/* The value of the highest possible Unicode codepoint.
- */
-static unsigned int const lastucharval = 0x0010FFFF;
+#include "lookup.h"
+#include "probe.h"
+#include "bitmap.h"
+#include "fontscan.h"
+#include "glyphs.h"
+#include "census.h"
+#include "convert.h"
+#include "server.h"
+#include "inspect.h"
 
 /* Online help for program invocation.
  */
@@ -52,12 +61,70 @@ static char const *yowzitch[] = {
     "  -a, --accent=C    Specify codepoint C to use when rendering combining",
     "                    accent characters (default is U+00B7).",
     "  -A, --noaccent    Suppress display of combining accent characters.",
+    "  -l, --lowbandwidth Minimize output, for use over slow connections.",
+    "      --baud=RATE   Assume a connection speed of RATE bits per second",
+    "                    (implies --lowbandwidth).",
+    "  -T, --timing      Display frame timing statistics.",
+    "      --sync        Mark the start and end of each screen update, for",
+    "                    terminals that support synchronized output.",
+    "      --fonts       Mark the characters that no installed font covers.",
+    "      --glyphs=PROTO Display glyphs as images rendered from the",
+    "                    installed fonts, using the sixel or kitty",
+    "                    graphics protocol (implies --fonts).",
+    "      --mismatches  List the characters whose widths, as given by the",
+    "                    C library, the Unicode data, and the terminal,",
+    "                    do not all agree.",
+    "      --dump[=SPEC] Output a line for each character selected by SPEC,",
+    "                    which is a range of codepoints (such as",
+    "                    U+0400-U+04FF), a block name, or a string to",
+    "                    search for in the names. The default is all.",
+    "      --batch       Read codepoints from standard input, one per line,",
+    "                    either as hex values or as literal characters,",
+    "                    and output a line for each.",
+    "      --name=NAME   Output a line for the character with the official",
+    "                    name or alias NAME, ignoring case, spaces,",
+    "                    underscores, and medial hyphens.",
+    "      --serve=SOCKET Answer lookup requests from other programs on",
+    "                    the Unix domain socket SOCKET, until interrupted.",
+    "      --client=SOCKET Send lines from standard input as requests to",
+    "                    the server at SOCKET, and output the replies.",
+    "      --fields=LIST Select the fields output by --dump, --batch, or",
+    "                    --name, from: code, glyph, name, utf8, utf16,",
+    "                    decimal, width, block, combining (default is",
+    "                    code,glyph,name for --dump and --name, and",
+    "                    code,name,utf8,utf16 for --batch).",
+    "      --format=FMT  Output --dump, --batch, or --name as tsv, csv, or",
+    "                    jsonl (JSON Lines). The default is tsv.",
+    "      --inspect     List the codepoints in STRING, or in the text read",
+    "                    from standard input, grouped into grapheme",
+    "                    clusters, with their names, widths, and",
+    "                    encodings.",
+    "      --convert=ENC Convert UTF-8 text from standard input to ENC,",
+    "                    which is utf8, utf16le, utf16be, utf32le, utf32be,",
+    "                    or c (C string literal escapes). With --dump, the",
+    "                    selected characters are output instead, one per",
+    "                    line.",
+    "      --report[=FMT] Output a summary of how well each block is",
+    "                    supported, as text, tsv, or json.",
+    "      --census=FILE Count the characters in the UTF-8 text in FILE,",
+    "                    and show only the characters that are present.",
+    "                    With --report, output the counts for each block",
+    "                    and the locations of any invalid sequences.",
+    "      --stats       Report, at exit, how long it took to display the",
+    "                    first screen and to build the search indexes.",
+    "      --record=FILE Save the keys pressed during the session to FILE.",
+    "      --replay=FILE Run the session recorded in FILE, without output,",
+    "                    and display timing statistics afterwards.",
+    "      --probe       Measure the width the terminal actually gives to",
+    "                    each character, and output the results. The",
+    "                    results are saved and used by later sessions.",
     "      --help        Display this online help.",
     "      --version     Display version information.",
     "",
     "CHAR is a literal character with which to initialize the list position.",
     "CODEPOINT is specified as a hex value, optionally prefixed with \"U+\".",
-    "STRING is a substring to search for in the codepoint names.",
+    "STRING is a substring to search for in the codepoint names, or with",
+    "--inspect, the text to inspect.",
     "",
     "Use \"?\" while the program is running to see a list of key commands.",
 };
@@ -71,11 +138,6 @@ static char const *vourzhon[] = {
     "There is NO WARRANTY, to the extent permitted by law."
 };
 
-/* Array marking the blocks in the block list that are devoid of
- * printable characters. Created by emptyblocksinit().
- */
-static unsigned char *emptyblocks;
-
 /* The default number of columns in the table.
  */
 static int columncount = 2;
@@ -97,61 +159,455 @@ static wchar_t accentchar = 0x00B7;
  */
 static int showcombining = TRUE;
 
+/* If true, the display is managed so as to minimize the amount of
+ * output sent to the terminal, at the cost of showing less detail.
+ */
+static int lowbandwidth = FALSE;
+
+/* The levels of detail at which the character names can be rendered.
+ * The codepoint value and the glyph itself are always shown.
+ */
+enum { DETAIL_NONE, DETAIL_BRIEF, DETAIL_FULL };
+
+/* The level of detail currently in use when rendering names.
+ */
+static int namedetail = DETAIL_FULL;
+
+/* The longest a name is permitted to be at the brief detail level.
+ */
+static int const briefnamesize = 12;
+
+/* The measured throughput of the terminal, in bytes per second. This
+ * is only tracked in low-bandwidth mode.
+ */
+static long linerate = 0;
+
+/* If true, the throughput was specified by the user and is not
+ * updated with measurements.
+ */
+static int fixedlinerate = FALSE;
+
+/* The (estimated) number of bytes that were output to update the
+ * terminal for the most recently displayed frame.
+ */
+static long framebytes = 0;
+
+/* The amount of time, in milliseconds, that the output for a single
+ * frame should take to transmit in low-bandwidth mode.
+ */
+static long const frametime = 250;
+
+/* The layout of a piece of text, broken into lines to fit within a
+ * given width.
+ */
+typedef struct textlayout {
+    char const *text;		/* the text being laid out */
+    int size;			/* the length of the text */
+    int width;			/* the width the text is to fit within */
+    int linecount;		/* the number of lines in the layout */
+    int linesalloced;		/* the allocated size of lines */
+    struct {
+	int start;		/* offset of the line within the text */
+	int size;		/* length of the line */
+    } *lines;
+} textlayout;
+
+/* A pre-formatted entry in the character table.
+ */
+typedef struct tableentry {
+    int index;			/* the entry's index in charlist */
+    short colwidth;		/* the column width it was formatted for */
+    char detail;		/* the name detail it was formatted with */
+    char width;			/* the number of cells the glyph occupies */
+    char hex[8];		/* the codepoint value as a string */
+    char showname;		/* true if the name is displayed at all */
+    char ellipsis;		/* true if the name is abbreviated */
+    char covered;		/* false if no installed font has the glyph */
+    unsigned char head;		/* number of leading name chars shown */
+    unsigned char tail;		/* number of trailing name chars shown */
+    cchar_t glyph;		/* the glyph ready for display */
+} tableentry;
+
+/* A cache of recently displayed table entries, indexed by their
+ * position in charlist modulo the size of the cache.
+ */
+static tableentry *entrycache = NULL;
+static int entrycachesize = 0;
+static int entrycachecolwidth = 0;
+
+/* The number of screens' worth of entries held in the entry cache.
+ */
+static int const entrycachescreens = 4;
+
+/* The number of buckets in a histogram: four for each power of two
+ * up to 2^31, plus four for the values under four.
+ */
+enum { histogramsize = 4 + 4 * 30 };
+
+/* A histogram of measurements, kept in logarithmically sized buckets.
+ */
+typedef struct histogram {
+    char const *name;		/* label for the measurements */
+    unsigned long count;	/* total number of measurements */
+    double total;		/* sum of all measurements */
+    long max;			/* highest value measured */
+    unsigned long buckets[histogramsize];
+} histogram;
+
+/* The filters that can be applied to the character table.
+ */
+enum { FILTER_NONE, FILTER_SUPPORTED, FILTER_UNSUPPORTED, FILTER_CENSUS,
+       FILTER_COUNT };
+
+/* The filter currently applied to the character table.
+ */
+static int filtermode = FILTER_NONE;
+
+/* The characters that pass each filter, indexed by position in the
+ * charlist array. A filter's bitmap is built when it is first used.
+ */
+static bitmap filters[FILTER_COUNT];
+
+/* The descriptions of the filters, as shown on the status line.
+ */
+static char const *filternames[FILTER_COUNT] = {
+    "all", "supported", "unsupported", "in file"
+};
+
+/* The file whose characters are counted with --census, if any, the
+ * results of the census, and the time it took.
+ */
+static char const *censusname = NULL;
+static census censusresult;
+static double censustime = 0.0;
+
+/* If true, the installed fonts are examined, and characters which no
+ * font covers are marked in the table.
+ */
+static int scanfonts = FALSE;
+
+/* True if the terminal's measured widths are available.
+ */
+static int havewidthcache = FALSE;
+
+/* If true, the program lists the characters with conflicting widths
+ * instead of running the interactive display.
+ */
+static int mismatchmode = FALSE;
+
+/* If true, repeated searches look for the next character with
+ * conflicting widths, instead of for a name.
+ */
+static int searchmismatches = FALSE;
+
+/* The most recent successful search of the names, which is used
+ * again when the user repeats the search.
+ */
+static namesearch lastsearch;
+
+/* The formats in which the coverage report can be output.
+ */
+enum { REPORT_NONE, REPORT_TEXT, REPORT_TSV, REPORT_JSON };
+
+/* The format of the coverage report, if one is requested instead of
+ * running the interactive display.
+ */
+static int reportformat = REPORT_NONE;
+
+/* If true, the program outputs a list of characters instead of
+ * running the interactive display. The specification selects the
+ * characters listed, and is NULL or empty to list all of them.
+ */
+static int dumpmode = FALSE;
+static char const *dumpspec = NULL;
+
+/* The formats in which characters can be listed.
+ */
+enum { DUMP_TSV, DUMP_CSV, DUMP_JSONL };
+
+/* The format used by --dump, --batch, and --name.
+ */
+static int dumpformat = DUMP_TSV;
+
+/* The encoding selected with --convert, or -1 if none was.
+ */
+static int convertencoding = -1;
+
+/* The fields that can be output for each character.
+ */
+enum { FIELD_CODE, FIELD_GLYPH, FIELD_NAME, FIELD_UTF8, FIELD_UTF16,
+       FIELD_DECIMAL, FIELD_WIDTH, FIELD_BLOCK, FIELD_COMBINING,
+       FIELD_COUNT };
+
+/* The names by which the fields are selected, which are also used as
+ * the column headings and the keys of the output.
+ */
+static char const *fieldnames[FIELD_COUNT] = {
+    "code", "glyph", "name", "utf8", "utf16", "decimal", "width", "block",
+    "combining"
+};
+
+/* The fields selected for output, in order.
+ */
+static int fields[FIELD_COUNT];
+static int fieldcount = 0;
+
+/* If true, the program reads codepoints from standard input and
+ * outputs a line for each one, instead of running the interactive
+ * display.
+ */
+static int batchmode = FALSE;
+
+/* The name of the character to output with --name, if any.
+ */
+static char const *exactname = NULL;
+
+/* The path of the socket on which to run the lookup server, or to
+ * which to connect as a client.
+ */
+static char const *servepath = NULL;
+static char const *clientpath = NULL;
+
+/* The maximum number of codepoints listed in the reply to a find
+ * request made to the lookup server.
+ */
+static int const findlimit = 100;
+
+/* If true, the program displays the codepoints in a piece of text
+ * instead of the character table. The text is given on the command
+ * line, or else read from standard input.
+ */
+static int inspectmode = FALSE;
+static char const *inspectarg = NULL;
+static inspecttext inspected;
+
+/* The names displayed for the C0 control characters, which have no
+ * names of their own in the Unicode data.
+ */
+static char const *controlnames[32] = {
+    "null", "start of heading", "start of text", "end of text",
+    "end of transmission", "enquiry", "acknowledge", "alert", "backspace",
+    "character tabulation", "line feed", "line tabulation", "form feed",
+    "carriage return", "shift out", "shift in", "data link escape",
+    "device control one", "device control two", "device control three",
+    "device control four", "negative acknowledge", "synchronous idle",
+    "end of transmission block", "cancel", "end of medium", "substitute",
+    "escape", "information separator four", "information separator three",
+    "information separator two", "information separator one"
+};
+
+/* The buffer through which bulk output is written, and the number of
+ * bytes currently in it.
+ */
+static char outbuf[262144];
+static int outsize = 0;
+
+/* The most space that a single line of dump output can require.
+ */
+static int const maxdumpline = 1024;
+
+/* If true, the program measures the terminal's character widths
+ * instead of running the interactive display.
+ */
+static int probemode = FALSE;
+
+/* If true, each frame is bracketed with the sequences that begin and
+ * end a synchronized update (DEC private mode 2026), so that the
+ * terminal can display the whole frame at once.
+ */
+static int syncupdates = FALSE;
+
+/* The graphics protocol used to display glyphs as images rendered
+ * from the installed fonts, or GLYPHS_NONE to display them as text.
+ */
+static int glyphmode = GLYPHS_NONE;
+
+/* If true, frame timing statistics are shown on the status line.
+ */
+static int showtiming = FALSE;
+
+/* Histograms of the time taken to render the table, the time from a
+ * keypress arriving to the updated table being flushed to the
+ * terminal, and the number of bytes output for each frame.
+ */
+static histogram rendertimes = { "render (us)", 0, 0.0, 0, { 0 } };
+static histogram latencytimes = { "latency (us)", 0, 0.0, 0, { 0 } };
+static histogram outputsizes = { "output (bytes)", 0, 0.0, 0, { 0 } };
+
+/* The time at which the most recent keypress was received.
+ */
+static double keytime;
+
+/* If true, the time taken to display the first frame and to build
+ * the search indexes is reported at exit.
+ */
+static int showstats = FALSE;
+
+/* The time at which the program started, and the times since then at
+ * which the first frame was displayed and the search indexes became
+ * ready (or zero if they have not yet).
+ */
+static double starttime = 0.0;
+static double firstframetime = 0.0;
+static double indexreadytime = 0.0;
+
+/* The lock shared with the thread that builds the search indexes in
+ * the background. It protects the filter bitmaps while they are being
+ * built, and indexreadytime.
+ */
+static pthread_mutex_t indexlock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The file to which the session's keystrokes are recorded, if any.
+ */
+static FILE *recordfile = NULL;
+
+/* The file from which a recorded session's keystrokes are read in
+ * place of the terminal, if any.
+ */
+static FILE *replayfile = NULL;
+
+/* The number of keystrokes replayed, and the time the replay began.
+ */
+static unsigned long replaycount = 0;
+static double replaystart = 0.0;
+
 /*
  * Lookup functions
  */
 
-/* Find the codepoint with the value uchar in the charlist array and
- * return its index. If uchar doesn't map to a defined codepoint,
- * return the nearest one.
+/* Return the number of cells the terminal uses to display a codepoint.
+ * The terminal's own measurements are used when they are available in
+ * the width cache; otherwise the value comes from wcwidth(3).
  */
-static int lookupchar(int uchar)
+static int glyphwidth(unsigned int uchar)
 {
-    int top, bottom, n;
+    int width;
 
-    top = 0;
-    bottom = charlistsize - 1;
-    while (bottom - top > 1) {
-	n = (top + bottom) / 2;
-	if (charlist[n].uchar < uchar)
-	    top = n;
-	else if (charlist[n].uchar > uchar)
-	    bottom = n;
-	else
-	    return n;
+    width = cachedwidth(uchar);
+    return width < 0 ? wcwidth(uchar) : width;
+}
+
+/* Return true if the terminal is believed to be able to display the
+ * index-th character. A character is assumed to be unsupported if no
+ * installed font covers it (when the fonts have been scanned), or if
+ * the width the terminal was measured to give it differs from the
+ * width given by wcwidth(3). Characters that have not been measured
+ * are given the benefit of the doubt.
+ */
+static int glyphsupport(int index)
+{
+    int measured, expected;
+
+    if (!fontcovers(charlist[index].uchar))
+	return FALSE;
+    measured = cachedwidth(charlist[index].uchar);
+    if (measured < 0)
+	return TRUE;
+    expected = wcwidth(charlist[index].uchar);
+    return measured == (expected < 0 ? 0 : expected);
+}
+
+/* Build the bitmap for the given filter, unless it is already built.
+ */
+static int buildfilter(int mode)
+{
+    bitmap *map = &filters[mode];
+    int i;
+
+    if (mode == FILTER_NONE || map->bits)
+	return TRUE;
+    if (mode == FILTER_CENSUS && !censusresult.counts)
+	return FALSE;
+    if (!bitmapinit(map, charlistsize))
+	return FALSE;
+    for (i = 0 ; i < charlistsize ; ++i) {
+	if (mode == FILTER_CENSUS) {
+	    if (censusresult.counts[charlist[i].uchar])
+		bitmapset(map, i);
+	} else if (glyphsupport(i) == (mode == FILTER_SUPPORTED)) {
+	    bitmapset(map, i);
+	}
+    }
+    if (!bitmapindex(map)) {
+	bitmapfree(map);
+	return FALSE;
     }
-    return uchar - charlist[top].uchar < charlist[bottom].uchar - uchar ?
-		top : bottom;
+    return TRUE;
 }
 
-/* Return the index of the (nearest) codepoint that is charoffset away
- * from the current codepoint, as indicated by pos.
+/* Prepare the bitmap for the given filter. The return value is false
+ * if memory could not be allocated. The bitmaps may be built by the
+ * background thread, so this waits if that thread is busy with one.
  */
-static int offsetchar(int pos, int charoffset)
+static int filterinit(int mode)
 {
-    return lookupchar(charlist[pos].uchar + charoffset);
+    int ret;
+
+    pthread_mutex_lock(&indexlock);
+    ret = buildfilter(mode);
+    pthread_mutex_unlock(&indexlock);
+    return ret;
 }
 
-/* Return the index of the next codepoint that contains the given
- * substring in its official name. The return value is negative if the
- * substring appears nowhere in any name. If substring is NULL, the
- * previous search string is used.
+/* Return the number of characters that pass the current filter.
  */
-static int findcharbyname(char const *substring, int startpos, int direction)
+static int filtercount(void)
 {
-    static char lastsubstring[265];
-    char buf[256];
-    char const *p;
-    int size, pos;
+    return filtermode == FILTER_NONE ? charlistsize
+				     : filters[filtermode].count;
+}
 
-    if (substring) {
-	if (strlen(substring) >= sizeof buf - 1)
-	    return -1;
-    } else if (*lastsubstring) {
-	substring = lastsubstring;
-    } else {
+/* Return the number of characters that pass the current filter and
+ * precede the index-th character. This is the position in the
+ * filtered table at which the index-th character appears, or would
+ * appear if it passed the filter.
+ */
+static int filterrank(int index)
+{
+    return filtermode == FILTER_NONE ? index
+				     : bitmaprank(&filters[filtermode], index);
+}
+
+/* Return the index of the character at position pos in the filtered
+ * table. The position is clamped to the table's extent. The return
+ * value is -1 if no characters pass the filter.
+ */
+static int filterselect(int pos)
+{
+    int count = filtercount();
+
+    if (count == 0)
 	return -1;
-    }
+    if (pos >= count)
+	pos = count - 1;
+    if (pos < 0)
+	return 0;
+    return filtermode == FILTER_NONE ? pos
+				     : bitmapselect(&filters[filtermode], pos);
+}
+
+/* Return true if the widths of the index-th character given by
+ * wcwidth(3), by the Unicode data, and by the terminal's measurements
+ * (if available) do not all agree.
+ */
+static int widthmismatch(int index)
+{
+    int width, measured;
+
+    width = charlist[index].width;
+    measured = cachedwidth(charlist[index].uchar);
+    if (measured >= 0 && measured != width)
+	return TRUE;
+    return wcwidth(charlist[index].uchar) != width;
+}
+
+/* Return the index of the next codepoint with conflicting widths,
+ * searching in the given direction and wrapping around at the ends.
+ * The return value is negative if there are none.
+ */
+static int findmismatch(int startpos, int direction)
+{
+    int pos;
 
     pos = startpos;
     for (;;) {
@@ -160,51 +616,26 @@ static int findcharbyname(char const *substring, int startpos, int direction)
 	    pos = 0;
 	else if (pos < 0)
 	    pos = charlistsize - 1;
-	p = charnamebuffer + charlist[pos].nameoffset;
-	size = charlist[pos].namesize;
-	if (memchr(p, *substring, size)) {
-	    memcpy(buf, p, size);
-	    buf[size] = '\0';
-	    if (strstr(buf, substring)) {
-		if (substring != lastsubstring)
-		    strcpy(lastsubstring, substring);
-		return pos;
-	    }
-	}
+	if (widthmismatch(pos))
+	    return pos;
 	if (pos == startpos)
 	    return -1;
     }
 }
 
-/* Go through each block in the block list and mark the ones that
- * don't contain any valid or displayable codepoints.
+/* Return the index of the (nearest) codepoint that is charoffset away
+ * from the current codepoint, as indicated by pos.
  */
-static void emptyblocksinit(void)
+static int offsetchar(int pos, int charoffset)
 {
-    int i, n;
-
-    if (emptyblocks)
-	return;
-    emptyblocks = malloc(blocklistsize);
-    for (i = 0 ; i < blocklistsize ; ++i) {
-	n = lookupchar(blocklist[i].from);
-	if (charlist[n].uchar >= blocklist[i].from &&
-			charlist[n].uchar <= blocklist[i].to)
-	    emptyblocks[i] = FALSE;
-	else if (n + 1 < charlistsize &&
-			charlist[n + 1].uchar >= blocklist[i].from &&
-			charlist[n + 1].uchar <= blocklist[i].to)
-	    emptyblocks[i] = FALSE;
-	else
-	    emptyblocks[i] = TRUE;
-    }
+    return lookupchar(charlist[pos].uchar + charoffset);
 }
 
 /* Parse a string containing a hex value representing a Unicode
  * codepoint and return the parsed value. -1 is returned if the
  * string's contents are not valid.
  */
-static int readuchar(char const *input)
+static long readucharvalue(char const *input)
 {
     unsigned long value;
     char *p;
@@ -216,7 +647,20 @@ static int readuchar(char const *input)
 	return -1;
     if (value > (unsigned long)lastucharval)
 	return -1;
-    return lookupchar((int)value);
+    return (long)value;
+}
+
+/* Parse a string containing a hex value representing a Unicode
+ * codepoint and return the index of the codepoint, or of the nearest
+ * one if it is not defined. -1 is returned if the string's contents
+ * are not valid.
+ */
+static int readuchar(char const *input)
+{
+    long value;
+
+    value = readucharvalue(input);
+    return value < 0 ? -1 : lookupchar((int)value);
 }
 
 /* If str points to a string containing a single codepoint (according
@@ -233,6 +677,134 @@ static int readsinglecharstring(char const *str)
     return -1;
 }
 
+/*
+ * Instrumentation functions
+ */
+
+/* Return the current time in seconds.
+ */
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+}
+
+/* Return the number of the histogram bucket that holds value. Values
+ * too large for the last bucket are counted in it.
+ */
+static int histogrambucket(long value)
+{
+    int shift, bucket;
+
+    if (value < 4)
+	return value < 0 ? 0 : (int)value;
+    for (shift = 0 ; value >> shift >= 8 ; ++shift) ;
+    bucket = 4 + 4 * shift + (int)(value >> shift) - 4;
+    return bucket < histogramsize ? bucket : histogramsize - 1;
+}
+
+/* Return the smallest value that belongs in the given bucket.
+ */
+static long bucketvalue(int bucket)
+{
+    if (bucket < 4)
+	return bucket;
+    bucket -= 4;
+    return (long)(4 + bucket % 4) << (bucket / 4);
+}
+
+/* Add a measurement to a histogram.
+ */
+static void recordvalue(histogram *hist, long value)
+{
+    ++hist->count;
+    hist->total += value;
+    if (hist->max < value)
+	hist->max = value;
+    ++hist->buckets[histogrambucket(value)];
+}
+
+/* Return the approximate value below which the given percentage of
+ * the measurements in the histogram fall.
+ */
+static long percentile(histogram const *hist, int percent)
+{
+    unsigned long n, limit;
+    int i;
+
+    limit = (hist->count * percent + 99) / 100;
+    n = 0;
+    for (i = 0 ; i < histogramsize ; ++i) {
+	n += hist->buckets[i];
+	if (n >= limit)
+	    break;
+    }
+    if (i >= histogramsize - 1 || bucketvalue(i + 1) > hist->max)
+	return hist->max;
+    return bucketvalue(i + 1) - 1;
+}
+
+/* Record the measurements for a newly displayed frame.
+ */
+static void recordframe(double start, double rendered, double flushed,
+			long bytes)
+{
+    recordvalue(&rendertimes, (long)((rendered - start) * 1000000.0));
+    recordvalue(&latencytimes, (long)((flushed - keytime) * 1000000.0));
+    recordvalue(&outputsizes, bytes);
+}
+
+/* Write one line of the timing summary for the given histogram.
+ */
+static void printhistogram(FILE *fp, histogram const *hist)
+{
+    fprintf(fp, "%-16s%9ld%9ld%9ld%9ld%9.0f\n", hist->name,
+	    percentile(hist, 50), percentile(hist, 90),
+	    percentile(hist, 99), hist->max,
+	    hist->count ? hist->total / hist->count : 0.0);
+}
+
+/* Display a summary of the timing statistics collected, if any. This
+ * function is called at exit, after ncurses has been shut down.
+ */
+static void showtimingsummary(void)
+{
+    if (replayfile && replaystart)
+	fprintf(stderr, "%lu keys replayed in %.3f seconds\n",
+		replaycount, now() - replaystart);
+    if (!rendertimes.count)
+	return;
+    fprintf(stderr, "%lu frames\n", rendertimes.count);
+    fprintf(stderr, "%-16s%9s%9s%9s%9s%9s\n",
+	    "", "p50", "p90", "p99", "max", "mean");
+    printhistogram(stderr, &rendertimes);
+    printhistogram(stderr, &latencytimes);
+    printhistogram(stderr, &outputsizes);
+}
+
+/* Display how long the program took to display its first frame and
+ * to finish building the search indexes. This function is called at
+ * exit, after ncurses has been shut down.
+ */
+static void showstartupstats(void)
+{
+    double ready;
+
+    pthread_mutex_lock(&indexlock);
+    ready = indexreadytime;
+    pthread_mutex_unlock(&indexlock);
+    if (firstframetime)
+	fprintf(stderr, "first frame after %.1f ms", firstframetime * 1000);
+    else
+	fprintf(stderr, "no frame displayed");
+    if (ready)
+	fprintf(stderr, ", indexes ready after %.1f ms\n", ready * 1000);
+    else
+	fprintf(stderr, ", indexes not ready\n");
+}
+
 /*
  * Curses-specific functions
  */
@@ -241,6 +813,7 @@ static int readsinglecharstring(char const *str)
  */
 static void shutdown(void)
 {
+    glyphsclear();
     if (!isendwin())
 	endwin();
 }
@@ -268,21 +841,85 @@ static void measurescreen(void)
     lastrow = ytermsize - 1;
 }
 
-/* Initialize ncurses.
+/* Initialize ncurses. When replaying a session, the output is
+ * discarded instead of being sent to the terminal. When standard
+ * input is not the terminal, as when it supplies the text to
+ * inspect, keys are read from the terminal directly.
  */
 static int ioinit(void)
 {
+    char const *term;
+    FILE *fp;
+
     atexit(shutdown);
-    if (!initscr())
-	return FALSE;
+    if (replayfile) {
+	term = getenv("TERM");
+	fp = fopen("/dev/null", "r+");
+	if (!fp || !newterm(term && *term ? term : "xterm", fp, fp))
+	    return FALSE;
+    } else if (!isatty(STDIN_FILENO)) {
+	fp = fopen("/dev/tty", "r");
+	if (!fp || !newterm(NULL, stdout, fp))
+	    return FALSE;
+    } else {
+	if (!initscr())
+	    return FALSE;
+    }
     measurescreen();
     nonl();
     noecho();
     keypad(stdscr, TRUE);
+    if (lowbandwidth) {
+	idlok(stdscr, TRUE);
+	if (!linerate)
+	    linerate = baudrate() / 10;
+	if (linerate <= 0)
+	    linerate = 960;
+    }
 
     return TRUE;
 }
 
+/* Return the next key event from ncurses for the given window. When
+ * replaying a session, the event is read from the recording instead,
+ * and the program exits at the end of the recording. Changes to the
+ * terminal size are recorded and replayed along with the keys. The
+ * time of every key is noted, including keys that dismiss a popup or
+ * complete a prompt, so that the latency of the next frame does not
+ * include the time spent waiting for them.
+ */
+static int getkey(WINDOW *win)
+{
+    char line[64];
+    int key, rows, cols;
+
+    if (replayfile) {
+	wrefresh(win);
+	for (;;) {
+	    if (!fgets(line, sizeof line, replayfile))
+		exit(EXIT_SUCCESS);
+	    if (sscanf(line, "resize %d %d", &rows, &cols) == 2) {
+		resizeterm(rows, cols);
+		key = KEY_RESIZE;
+		break;
+	    }
+	    if (sscanf(line, "%d", &key) == 1)
+		break;
+	}
+	++replaycount;
+    } else {
+	key = wgetch(win);
+    }
+    if (recordfile) {
+	if (key == KEY_RESIZE)
+	    fprintf(recordfile, "resize %d %d\n", LINES, COLS);
+	else
+	    fprintf(recordfile, "%d\n", key);
+    }
+    keytime = now();
+    return key;
+}
+
 /* Translate a key event from ncurses. Special keys that represent
  * controls are translated to appropriate ASCII equivalents. If the
  * terminal is resized, the function automatically updates the
@@ -314,46 +951,272 @@ static int translatekey(int key)
 }
 
 /* Wait for the user to press a key and return, or exit if ctrl-C is
- * pressed.
+ * pressed. The prompt is shown on the bottom line of the given window.
  */
-static void anykey(void)
+static void anykey(WINDOW *win)
 {
-    mvaddstr(lastrow, 0, "[Press any key to continue]");
-    clrtoeol();
-    if (getch() == '\003')
+    int ch;
+
+    mvwaddstr(win, getmaxy(win) - 2, 2, "[Press any key to continue]");
+    ch = getkey(win);
+    if (ch == '\003')
 	exit(EXIT_SUCCESS);
+    if (ch == KEY_RESIZE)
+	measurescreen();
 }
 
-/* Display a string of text at the given position. If the text is too
- * long to fit on a single line, it is broken at a word boundary. (The
- * text is assumed to only use a single ASCII space between words.)
- * The return value is the y-value of the line immediately following
- * the end the of the displayed text.
+/* Work out where a string of text needs to be broken in order to fit
+ * within the given width. Lines are broken at a word boundary when
+ * possible. (The text is assumed to only use a single ASCII space
+ * between words.) The layout is only recomputed when the text or the
+ * width has changed since the last call. A width of less than one
+ * cell is treated as one.
  */
-static int drawtext(int y, int x, char const *text, int size)
+static void layouttext(textlayout *layout, char const *text, int size,
+		       int width)
 {
     int n;
 
+    if (width < 1)
+	width = 1;
+    if (layout->text == text && layout->size == size
+			     && layout->width == width)
+	return;
+    layout->text = text;
+    layout->size = size;
+    layout->width = width;
+    layout->linecount = 0;
     while (size) {
-	if (size <= xtermsize - x) {
-	    mvaddnstr(y++, x, text, size);
-	    break;
+	if (layout->linecount == layout->linesalloced) {
+	    layout->linesalloced = layout->linesalloced * 2 + 4;
+	    layout->lines = realloc(layout->lines, layout->linesalloced
+						   * sizeof *layout->lines);
+	    if (!layout->lines)
+		die("out of memory");
 	}
-	for (n = xtermsize - x ; n ; --n)
-	    if (text[n] == ' ')
-		break;
-	if (n == 0) {
-	    n = xtermsize - x;
-	    mvaddnstr(y++, x, text, n);
-	    text += n;
-	    size -= n;
+	if (size <= width) {
+	    n = size;
 	} else {
-	    mvaddnstr(y++, x, text, n);
-	    text += n + 1;
-	    size -= n + 1;
+	    for (n = width ; n ; --n)
+		if (text[n] == ' ')
+		    break;
+	    if (n == 0)
+		n = width;
 	}
+	layout->lines[layout->linecount].start = layout->size - size;
+	layout->lines[layout->linecount].size = n;
+	++layout->linecount;
+	if (n < size && text[n] == ' ')
+	    ++n;
+	text += n;
+	size -= n;
     }
-    return y;
+}
+
+/* Display a laid-out piece of text in a window at the given position.
+ * The return value is the y-value of the line immediately following
+ * the end the of the displayed text.
+ */
+static int drawlayout(WINDOW *win, int y, int x, textlayout const *layout)
+{
+    int i;
+
+    for (i = 0 ; i < layout->linecount ; ++i)
+	mvwaddnstr(win, y++, x, layout->text + layout->lines[i].start,
+		   layout->lines[i].size);
+    return y;
+}
+
+/* Create a window with a border to display over the top of the main
+ * display, centered on the screen. The requested size is reduced if
+ * necessary to fit within the terminal.
+ */
+static WINDOW *openpopup(int height, int width)
+{
+    WINDOW *win;
+
+    glyphsclear();
+    if (height > ytermsize)
+	height = ytermsize;
+    if (width > xtermsize)
+	width = xtermsize;
+    win = newwin(height, width, (ytermsize - height) / 2,
+		 (xtermsize - width) / 2);
+    if (!win)
+	die("unable to create window");
+    keypad(win, TRUE);
+    box(win, 0, 0);
+    return win;
+}
+
+/* Remove a popup window. The main display underneath the popup is
+ * restored from the contents of stdscr, so that only the part of the
+ * screen that was covered needs to be sent to the terminal.
+ */
+static void closepopup(WINDOW *win)
+{
+    int y, height;
+
+    y = getbegy(win);
+    height = getmaxy(win);
+    delwin(win);
+    touchwin(stdscr);
+    if (glyphmode == GLYPHS_SIXEL)
+	wredrawln(stdscr, y, height);
+    refresh();
+}
+
+/* Display a list of lines of text in a popup window, and wait for the
+ * user to press a key.
+ */
+static void showhelppopup(char const *const *text, int count)
+{
+    WINDOW *win;
+    int width, n, i;
+
+    width = 0;
+    for (i = 0 ; i < count ; ++i) {
+	n = strlen(text[i]);
+	if (width < n)
+	    width = n;
+    }
+    win = openpopup(count + 4, width + 6);
+    for (i = 0 ; i < count ; ++i)
+	mvwaddnstr(win, i + 1, 3, text[i], getmaxx(win) - 4);
+    anykey(win);
+    closepopup(win);
+}
+
+/* Return the size in bytes of the UTF-8 encoding of the given
+ * codepoint.
+ */
+static int utf8size(unsigned int uchar)
+{
+    return uchar < 0x0080 ? 1 : uchar < 0x0800 ? 2 : uchar < 0x10000 ? 3 : 4;
+}
+
+/* Return true if the cell at (y, x) in the given window is blank.
+ * The contents of the cell are also returned via wch and attr.
+ */
+static int getcell(WINDOW *win, int y, int x, wchar_t *wch, attr_t *attr)
+{
+    cchar_t cell;
+    short pair;
+
+    mvwin_wch(win, y, x, &cell);
+    getcchar(&cell, wch, attr, &pair, NULL);
+    return wch[0] == L' ' && wch[1] == L'\0' && !*attr;
+}
+
+/* Estimate the number of bytes that the next call to refresh() will
+ * send to the terminal, by comparing the contents of stdscr with what
+ * ncurses believes is currently on the screen. Each run of changed
+ * cells is charged for a cursor movement and an attribute change in
+ * addition to the encoded text, and blank space at the end of a line
+ * is assumed to be cleared with a single control sequence.
+ */
+static long estimateoutput(void)
+{
+    wchar_t newwch[CCHARW_MAX + 1], oldwch[CCHARW_MAX + 1];
+    attr_t newattr, oldattr;
+    int cleared, inrun, lastx, y, x, i;
+    long bytes;
+
+    cleared = is_cleared(stdscr);
+    bytes = cleared ? 4 : 0;
+    for (y = 0 ; y < ytermsize ; ++y) {
+	for (lastx = xtermsize - 1 ; lastx >= 0 ; --lastx)
+	    if (!getcell(stdscr, y, lastx, newwch, &newattr))
+		break;
+	inrun = FALSE;
+	for (x = 0 ; x <= lastx ; ++x) {
+	    getcell(stdscr, y, x, newwch, &newattr);
+	    if (cleared) {
+		if (newwch[0] == L' ' && newwch[1] == L'\0' && !newattr) {
+		    inrun = FALSE;
+		    continue;
+		}
+	    } else {
+		getcell(curscr, y, x, oldwch, &oldattr);
+		if (newattr == oldattr && !wcscmp(newwch, oldwch)) {
+		    inrun = FALSE;
+		    continue;
+		}
+	    }
+	    if (!inrun) {
+		bytes += newattr ? 12 : 8;
+		inrun = TRUE;
+	    }
+	    for (i = 0 ; newwch[i] ; ++i)
+		bytes += utf8size(newwch[i]);
+	}
+	if (!cleared) {
+	    for (x = lastx + 1 ; x < xtermsize ; ++x) {
+		if (!getcell(curscr, y, x, oldwch, &oldattr)) {
+		    bytes += inrun ? 4 : 12;
+		    break;
+		}
+	    }
+	}
+    }
+    return bytes;
+}
+
+/* Mark the start or end of a frame, if synchronized updates are in
+ * use. The sequences are written directly to the terminal, so they
+ * must be sent when curses has nothing buffered, i.e. before the
+ * frame is drawn or after it has been refreshed.
+ */
+static void syncupdate(int begin)
+{
+    static char const bsu[] = "\033[?2026h";
+    static char const esu[] = "\033[?2026l";
+
+    if (!syncupdates)
+	return;
+    fflush(stdout);
+    write(STDOUT_FILENO, begin ? bsu : esu, sizeof bsu - 1);
+}
+
+/* Update the terminal with a newly rendered frame, the size of which
+ * has been estimated as bytes. In low-bandwidth mode, the time taken
+ * for the output to drain is used to update the measured throughput.
+ */
+static void sendframe(long bytes)
+{
+    struct timeval start, stop;
+    long elapsed, rate;
+
+    framebytes = bytes;
+    if (!firstframetime)
+	firstframetime = now() - starttime;
+    if (!lowbandwidth) {
+	refresh();
+	glyphsflush();
+	syncupdate(FALSE);
+	return;
+    }
+    gettimeofday(&start, NULL);
+    refresh();
+    syncupdate(FALSE);
+    tcdrain(STDOUT_FILENO);
+    gettimeofday(&stop, NULL);
+    elapsed = (stop.tv_sec - start.tv_sec) * 1000
+			+ (stop.tv_usec - start.tv_usec) / 1000;
+    if (fixedlinerate || bytes < 64)
+	return;
+    if (elapsed < 1)
+	elapsed = 1;
+    rate = bytes * 1000 / elapsed;
+    linerate = (3 * linerate + rate) / 4;
+}
+
+/* Return the number of bytes that a frame may use in low-bandwidth
+ * mode without falling behind the user's input.
+ */
+static long framebudget(void)
+{
+    return linerate * frametime / 1000;
 }
 
 /*
@@ -383,7 +1246,7 @@ static int doinputui(char *input, int inputsize, char const *prompt,
     if (inputmax > inputsize - 1)
 	inputmax = inputsize - 1;
     while (!done) {
-	ch = getch();
+	ch = getkey(stdscr);
 	if (ch == ERR)
 	    return -1;
 	if (validchar(ch)) {
@@ -447,22 +1310,29 @@ static int doinputui(char *input, int inputsize, char const *prompt,
 static int searchui(int index, int repeat)
 {
     char searchstring[256];
+    namesearch search;
     int n;
 
-    if (repeat) {
-	n = findcharbyname(NULL, index, repeat);
+    if (repeat && searchmismatches) {
+	n = findmismatch(index, repeat);
+    } else if (repeat) {
+	n = findcharbyname(&lastsearch, index, repeat);
     } else {
+	searchmismatches = FALSE;
 	n = doinputui(searchstring, sizeof searchstring, "/", isprint);
 	if (n < 0)
 	    return index;
 	if (n == 0) {
-	    n = findcharbyname(NULL, index, +1);
+	    n = findcharbyname(&lastsearch, index, +1);
 	    if (n < 0)
 		return index;
+	} else if (namesearchinit(&search, searchstring)) {
+	    n = findcharbyname(&search, index, +1);
+	    if (n >= 0)
+		lastsearch = search;
+	} else {
+	    n = -1;
 	}
-	while (n--)
-	    searchstring[n] = tolower(searchstring[n]);
-	n = findcharbyname(searchstring, index, +1);
     }
 
     if (n < 0) {
@@ -492,6 +1362,27 @@ static int jumpui(int index)
     return n;
 }
 
+/* Get a character name from the user and return the index of the
+ * character with that exact name or alias. The passed-in index is
+ * returned if no character has that name.
+ */
+static int nameui(int index)
+{
+    char buf[256];
+    int n;
+
+    n = doinputui(buf, sizeof buf, "Name: ", isprint);
+    if (n <= 0)
+	return index;
+    buf[n] = '\0';
+    n = findcharbyexactname(buf);
+    if (n < 0) {
+	beep();
+	return index;
+    }
+    return n;
+}
+
 /* Display the Unicode version the program was built with. Alert if no
  * version string is available.
  */
@@ -500,7 +1391,7 @@ static void showversion(void)
     if (unicodeversion && *unicodeversion) {
 	mvaddstr(lastrow, 0, "Unicode version ");
 	addstr(unicodeversion);
-	(void)getch();
+	(void)getkey(stdscr);
     } else {
 	beep();
     }
@@ -519,17 +1410,7 @@ static void showblockhelptext(void)
 	"^L     Redraw the screen            Q      Cancel and return"
     };
 
-    int i;
-
-    for (i = 0 ; i < (int)(sizeof helptext / sizeof *helptext) ; ++i) {
-	move(i, 0);
-	clrtoeol();
-	addstr("   ");
-	addstr(helptext[i]);
-    }
-    move(i, 0);
-    clrtoeol();
-    anykey();
+    showhelppopup(helptext, sizeof helptext / sizeof *helptext);
 }
 
 /* Display a full screen's worth of the block table, centered as
@@ -547,18 +1428,19 @@ static void drawblocklist(int selected)
 	top = blocklistsize - lastrow;
     namesize = xtermsize - 32;
 
+    glyphsclear();
     erase();
     for (i = top ; i < blocklistsize && i < top + lastrow ; ++i) {
 	if (i == selected)
 	    attron(A_STANDOUT);
-	if (emptyblocks[i])
+	if (isemptyblock(i))
 	    attron(A_DIM);
 	sprintf(frombuf, "%04X", blocklist[i].from);
 	sprintf(tobuf, "%04X", blocklist[i].to);
 	mvprintw(i - top, 4, "%6s ..%6s  %-*s",
 		 frombuf, tobuf, namesize, blocklist[i].name);
 	attrset(A_NORMAL);
-	if (emptyblocks[i])
+	if (isemptyblock(i))
 	    addstr(" [empty]");
     }
     mvaddstr(lastrow, 0, "Character Blocks");
@@ -575,7 +1457,6 @@ static int blockselectui(int index)
 {
     int selected, done, i;
 
-    emptyblocksinit();
     for (i = 0 ; i < blocklistsize ; ++i)
 	if (blocklist[i].to >= charlist[index].uchar)
 	    break;
@@ -587,7 +1468,7 @@ static int blockselectui(int index)
 	if (selected >= blocklistsize)
 	    selected = blocklistsize - 1;
 	drawblocklist(selected);
-	switch (translatekey(getch())) {
+	switch (translatekey(getkey(stdscr))) {
 	  case '+':	++selected;				break;
 	  case '-':	--selected;				break;
 	  case 'F':	selected += ytermsize - 1;		break;
@@ -601,7 +1482,7 @@ static int blockselectui(int index)
 	  case '\007':	return index;
 	  case '\003':	exit(EXIT_SUCCESS);
 	  case '\n':
-	    if (emptyblocks[selected])
+	    if (isemptyblock(selected))
 		beep();
 	    else
 		done = TRUE;
@@ -618,13 +1499,16 @@ static int blockselectui(int index)
  */
 static int showcharinfo(int index)
 {
-    unsigned char utf8[8];
+    static textlayout namelayout;
+    unsigned char utf8[4];
+    unsigned int utf16[2];
     wchar_t wch[3];
     cchar_t cch;
+    WINDOW *win;
     char const *name;
-    int namesize, utf8size;
-    int uchar;
-    int i, y;
+    int namesize, utf8size, utf16size;
+    int uchar, width;
+    int i, y, n;
 
     uchar = charlist[index].uchar;
     name = charnamebuffer + charlist[index].nameoffset;
@@ -639,106 +1523,127 @@ static int showcharinfo(int index)
 	wch[1] = L'\0';
     }
 
-    if (uchar < 0x0080) {
-	utf8[0] = uchar;
-	utf8size = 1;
-    } else {
-	utf8[0] = 0x80 | (uchar & 0x3F);
-	if (uchar < 0x0800) {
-	    utf8[1] = 0xC0 | ((uchar >> 6) & 0x1F);
-	    utf8size = 2;
-	} else {
-	    utf8[1] = 0x80 | ((uchar >> 6) & 0x3F);
-	    if (uchar < 0x00010000) {
-		utf8[2] = 0xE0 | ((uchar >> 12) & 0x0F);
-		utf8size = 3;
-	    } else {
-		utf8[2] = 0x80 | ((uchar >> 12) & 0x3F);
-		utf8[3] = 0xF0 | ((uchar >> 18) & 0x07);
-		utf8size = 4;
-	    }
-	}
-    }
+    utf8size = encodeutf8(uchar, utf8);
+    utf16size = encodeutf16(uchar, utf16);
+
+    width = xtermsize - 4;
+    if (width > 76)
+	width = 76;
+    layouttext(&namelayout, name, namesize, width - 14);
+    win = openpopup(namelayout.linecount + 14, width);
 
-    clear();
     setcchar(&cch, wch, 0, 0, NULL);
-    mvadd_wch(1, 1, &cch);
+    mvwadd_wch(win, 2, 3, &cch);
     setcchar(&cch, wch, A_BOLD, 0, NULL);
-    mvadd_wch(1, 32, &cch);
-    mvprintw(3, 0, "U+%04X", uchar);
-    move(3, 10);
-    y = drawtext(3, 10, name, namesize) + 1;
-    mvaddstr(y++, 0, "       UTF-16: ");
-    if (uchar < 0x00010000)
-	printw("0x%04X", uchar);
-    else
-	printw("0x%04X 0x%04X", 0xD800 | ((uchar - 0x00010000) >> 10),
-                                0xDC00 | ((uchar - 0x00010000) & 0x03FF));
-    mvaddstr(y++, 0, "        UTF-8:");
-    for (i = utf8size ; i-- ; )
-	printw(" 0x%02X", utf8[i]);
-    mvaddstr(y++, 0, "C octal UTF-8: ");
-    for (i = utf8size ; i-- ; )
-	printw("\\%03o", utf8[i]);
-    mvprintw(y++, 0, "   XML entity: &#%u;", uchar);
+    mvwadd_wch(win, 2, width / 2, &cch);
+    mvwprintw(win, 4, 2, "U+%04X", uchar);
+    y = drawlayout(win, 4, 12, &namelayout) + 1;
+    mvwaddstr(win, y++, 2, "       UTF-16:");
+    for (i = 0 ; i < utf16size ; ++i)
+	wprintw(win, " 0x%04X", utf16[i]);
+    mvwaddstr(win, y++, 2, "        UTF-8:");
+    for (i = 0 ; i < utf8size ; ++i)
+	wprintw(win, " 0x%02X", utf8[i]);
+    mvwaddstr(win, y++, 2, "C octal UTF-8: ");
+    for (i = 0 ; i < utf8size ; ++i)
+	wprintw(win, "\\%03o", utf8[i]);
+    mvwprintw(win, y++, 2, "   XML entity: &#%u;", uchar);
     i = wcwidth(uchar);
     if (i < 0)
-	mvaddstr(y, 0, "        width: n/a");
+	mvwaddstr(win, y, 2, "        width: n/a");
     else
-	mvprintw(y, 0, "display width: %d", i);
+	mvwprintw(win, y, 2, "display width: %d", i);
+    i = cachedwidth(uchar);
+    if (i >= 0)
+	wprintw(win, " (measured: %d)", i);
+    if (scanfonts) {
+	name = fontcovering(uchar, &i);
+	if (!name)
+	    mvwaddstr(win, y + 1, 2, "         font: none installed");
+	else if (i > 1) {
+	    n = width - 34;
+	    if (n < 0)
+		n = 0;
+	    mvwprintw(win, y + 1, 2, "         font: %.*s (and %d more)",
+		      n, strrchr(name, '/') + 1, i - 1);
+	} else {
+	    n = width - 18;
+	    if (n < 0)
+		n = 0;
+	    mvwprintw(win, y + 1, 2, "         font: %.*s",
+		      n, strrchr(name, '/') + 1);
+	}
+	++y;
+    }
+    if (censusresult.counts)
+	mvwprintw(win, y + 1, 2, "  occurrences: %lu",
+		  censusresult.counts[uchar]);
+
+    if (glyphmode) {
+	glyphplace(uchar, getbegy(win) + 1, getbegx(win) + width / 2 - 2,
+		   3, 6);
+	wrefresh(win);
+	glyphsflush();
+    }
 
-    anykey();
-    clearok(stdscr, TRUE);
+    anykey(win);
+    closepopup(win);
     return index;
 }
 
-/* Display the index-th character at location (y, x) using colwidth
- * cells. The official name is rendered first, with the actual glyph
- * displayed at the rightmost position. (Note that wcwidth(3) is used
- * to determine how many cells the glyph occupies. Some terminals
- * and/or terminal fonts do not 100% adhere to what this function
- * reports. It is used because there is currently no alternative.)
+/* Work out how the index-th character is to be rendered in a column
+ * colwidth cells wide, and store the result in entry. The official
+ * name is rendered first, with the actual glyph displayed at the
+ * rightmost position. (Note that unless the terminal's widths have
+ * been measured with --probe, wcwidth(3) is used to determine how
+ * many cells the glyph occupies. Some terminals and/or terminal fonts
+ * do not 100% adhere to what this function reports.)
  */
-static int drawentry(int y, int x, int colwidth, int index)
+static void formatentry(tableentry *entry, int colwidth, int index)
 {
-    static wchar_t const ellipsis[] = { (wchar_t)0x2026, L'\0' };
-    char buf[8];
     wchar_t wch[3];
-    cchar_t cch;
-    char const *name;
     int width, size, n;
 
-    if (colwidth < mincolumnwidth)
-	return FALSE;
-    n = sprintf(buf, " %04X", charlist[index].uchar);
-    mvaddstr(y, x, buf + n - 5);
-    width = wcwidth(charlist[index].uchar);
+    entry->index = index;
+    entry->colwidth = colwidth;
+    entry->detail = namedetail;
+    n = sprintf(entry->hex, " %04X", charlist[index].uchar);
+    if (n > 5)
+	memmove(entry->hex, entry->hex + n - 5, 6);
+    width = glyphwidth(charlist[index].uchar);
     if (width < 0)
 	width = 0;
     if (charlist[index].combining && showcombining && width == 0)
 	width = 1;
-    if (n + 3 < colwidth) {
-	addch(' ');
-	name = charnamebuffer + charlist[index].nameoffset;
+    entry->width = width;
+
+    entry->showname = n + 3 < colwidth && namedetail != DETAIL_NONE;
+    entry->head = entry->tail = 0;
+    entry->ellipsis = FALSE;
+    entry->covered = fontcovers(charlist[index].uchar);
+    if (entry->showname) {
 	size = charlist[index].namesize;
 	n = colwidth - 7 - width;
-	if (n >= size) {
-	    addnstr(name, size);
+	if (namedetail == DETAIL_BRIEF && n > briefnamesize) {
+	    if (size <= briefnamesize) {
+		entry->head = size;
+	    } else {
+		entry->head = briefnamesize - 1;
+		entry->ellipsis = TRUE;
+	    }
+	} else if (n >= size) {
+	    entry->head = size;
 	} else if (n > 6) {
-	    addnstr(name, n / 2);
-	    setcchar(&cch, ellipsis, 0, 0, NULL);
-	    add_wch(&cch);
-	    n -= n / 2 + 1;
-	    addnstr(name + size - n, n);
+	    entry->head = n / 2;
+	    entry->ellipsis = TRUE;
+	    entry->tail = n - n / 2 - 1;
 	} else {
-	    setcchar(&cch, ellipsis, 0, 0, NULL);
-	    add_wch(&cch);
+	    entry->ellipsis = TRUE;
 	    if (n > 1)
-		addnstr(name + size - n + 1, n - 1);
+		entry->tail = n - 1;
 	}
     }
-    if (width == 0)
-	return TRUE;
+
     if (charlist[index].combining && showcombining) {
 	wch[0] = accentchar;
 	wch[1] = charlist[index].uchar;
@@ -747,33 +1652,346 @@ static int drawentry(int y, int x, int colwidth, int index)
 	wch[0] = charlist[index].uchar;
 	wch[1] = L'\0';
     }
-    setcchar(&cch, wch, 0, 0, NULL);
-    mvadd_wch(y, x + colwidth - width, &cch);
+    setcchar(&entry->glyph, wch, 0, 0, NULL);
+}
+
+/* Prepare the entry cache for a table of the given dimensions. The
+ * cache holds a few screens' worth of entries, so that entries which
+ * scroll off the screen and back on again do not need to be formatted
+ * anew. If the dimensions have changed, the cache is emptied.
+ */
+static void entrycacheinit(int tablesize, int colwidth)
+{
+    int size, i;
+
+    size = tablesize * entrycachescreens;
+    if (size == entrycachesize && colwidth == entrycachecolwidth)
+	return;
+    if (size != entrycachesize) {
+	free(entrycache);
+	entrycache = malloc(size * sizeof *entrycache);
+	if (!entrycache)
+	    die("out of memory");
+	entrycachesize = size;
+    }
+    entrycachecolwidth = colwidth;
+    for (i = 0 ; i < entrycachesize ; ++i)
+	entrycache[i].index = -1;
+}
+
+/* Display the index-th character at location (y, x) using colwidth
+ * cells. The rendering is taken from the entry cache if possible.
+ */
+static int drawentry(int y, int x, int colwidth, int index)
+{
+    static wchar_t const ellipsis[] = { (wchar_t)0x2026, L'\0' };
+    tableentry *entry;
+    cchar_t cch;
+    char const *name;
+
+    if (colwidth < mincolumnwidth)
+	return FALSE;
+    entry = entrycache + index % entrycachesize;
+    if (entry->index != index || entry->colwidth != colwidth
+			      || entry->detail != namedetail)
+	formatentry(entry, colwidth, index);
+
+    if (!entry->covered)
+	attron(A_DIM);
+    mvaddstr(y, x, entry->hex);
+    if (!entry->covered)
+	attroff(A_DIM);
+    if (entry->showname) {
+	addch(' ');
+	name = charnamebuffer + charlist[index].nameoffset;
+	if (entry->head)
+	    addnstr(name, entry->head);
+	if (entry->ellipsis) {
+	    setcchar(&cch, ellipsis, 0, 0, NULL);
+	    add_wch(&cch);
+	}
+	if (entry->tail)
+	    addnstr(name + charlist[index].namesize - entry->tail,
+		    entry->tail);
+    }
+    if (entry->width) {
+	mvadd_wch(y, x + colwidth - entry->width, &entry->glyph);
+	if (glyphmode)
+	    glyphplace(charlist[index].uchar, y, x + colwidth - entry->width,
+		       1, entry->width);
+    }
     return TRUE;
 }
 
+/* Send the part of the table rendered so far to the terminal. When
+ * timing, the output is measured, and the time spent is added to
+ * flushtime so that it is not counted as part of the rendering.
+ */
+static void partialrefresh(long *bytes, double *flushtime)
+{
+    double start;
+
+    if (!showtiming) {
+	refresh();
+	return;
+    }
+    *bytes += estimateoutput();
+    start = now();
+    refresh();
+    *flushtime += now() - start;
+}
+
+/* Display the timing statistics on the status line.
+ */
+static void drawtimingstatus(void)
+{
+    printw("  render %ld/%ldus  latency %ld/%ldus  %ld/%ld bytes",
+	   percentile(&rendertimes, 50), percentile(&rendertimes, 99),
+	   percentile(&latencytimes, 50), percentile(&latencytimes, 99),
+	   percentile(&outputsizes, 50), percentile(&outputsizes, 99));
+}
+
+/* Display the conflicting widths of the index-th character on the
+ * status line.
+ */
+static void drawmismatchstatus(int index)
+{
+    int width;
+
+    printw("  U+%04X width: unicode %d", charlist[index].uchar,
+	   charlist[index].width);
+    width = wcwidth(charlist[index].uchar);
+    if (width < 0)
+	printw(", libc n/a");
+    else
+	printw(", libc %d", width);
+    width = cachedwidth(charlist[index].uchar);
+    if (width >= 0)
+	printw(", terminal %d", width);
+}
+
 /* Display a full screen's worth of the character table, starting with
- * the character given by index. The range of displayed codepoints is
- * shown on the bottommost line of the terminal.
+ * the character at position pos in the filtered table. The range of
+ * displayed codepoints is shown on the bottommost line of the
+ * terminal, along with the filter in use. When the screen is being
+ * repainted from scratch, each column is sent to the terminal as soon
+ * as it is rendered.
  */
-static int drawtable(int index)
+static void drawtable(int pos)
 {
     int colwidth = xtermsize / columncount;
-    int i = index;
-    int y, x;
+    double start, flushtime, rendered;
+    long bytes;
+    int progressive, count, first, last, n, y, x;
+
+    start = now();
+    syncupdate(TRUE);
+    progressive = !lowbandwidth && is_cleared(stdscr);
+    flushtime = 0.0;
+    count = filtercount();
+    first = filterselect(pos);
+    last = filterselect(pos + lastrow * (xtermsize / colwidth) - 1);
+    entrycacheinit(lastrow * columncount, colwidth - 1);
+    namedetail = DETAIL_FULL;
+    for (;;) {
+	erase();
+	bytes = 0;
+	n = pos;
+	for (x = 0 ; x <= xtermsize - colwidth ; x += colwidth) {
+	    for (y = 0 ; y < lastrow && n < count ; ++y)
+		drawentry(y, x, colwidth - 1, filterselect(n++));
+	    if (progressive)
+		partialrefresh(&bytes, &flushtime);
+	}
+	move(lastrow, 0);
+	if (n > pos)
+	    printw("[%04X - %04X]", charlist[first].uchar,
+				    charlist[last].uchar);
+	if (filtermode != FILTER_NONE)
+	    printw("  %s: %d of %d", filternames[filtermode],
+		   count, charlistsize);
+	if (searchmismatches && n > pos && widthmismatch(first))
+	    drawmismatchstatus(first);
+	if (lowbandwidth)
+	    printw("  %ld bytes", framebytes);
+	if (showtiming)
+	    drawtimingstatus();
+	if (!lowbandwidth) {
+	    if (showtiming)
+		bytes += estimateoutput();
+	    break;
+	}
+	bytes = estimateoutput();
+	if (bytes <= framebudget() || namedetail == DETAIL_NONE)
+	    break;
+	--namedetail;
+    }
+    rendered = now() - flushtime;
+    sendframe(bytes);
+    if (showtiming)
+	recordframe(start, rendered, now(), bytes);
+}
+
+/* Return the index of the first codepoint in the grid row that is
+ * rowoffset rows away from the row containing the index-th codepoint.
+ * Rows that contain no assigned codepoints are skipped over. The
+ * movement stops at the first or last row.
+ */
+static int gridstep(int index, int rowoffset)
+{
+    int n;
+
+    index = findcharafter(charlist[index].uchar & ~0x0F);
+    for ( ; rowoffset > 0 ; --rowoffset) {
+	n = findcharafter((charlist[index].uchar | 0x0F) + 1);
+	if (n >= charlistsize)
+	    break;
+	index = n;
+    }
+    for ( ; rowoffset < 0 && index > 0 ; ++rowoffset)
+	index = findcharafter(charlist[index - 1].uchar & ~0x0F);
+    return index;
+}
+
+/* Display a full screen's worth of the character table as a code
+ * chart, with sixteen glyphs to a row and one row for each group of
+ * sixteen codepoints. Unassigned codepoints are left blank. The first
+ * row displayed is the one containing the index-th codepoint.
+ */
+static int drawgrid(int index)
+{
+    wchar_t wch[3];
+    cchar_t cch;
+    double start, rendered;
+    long bytes;
+    int cellwidth, row, i, y, x;
+
+    start = now();
+    syncupdate(TRUE);
+    cellwidth = (xtermsize - 7) / 16;
+    if (cellwidth > 4)
+	cellwidth = 4;
+    else if (cellwidth < 2)
+	cellwidth = 2;
 
     erase();
-    for (x = 0 ; x <= xtermsize - colwidth ; x += colwidth) {
-	for (y = 0 ; y < lastrow ; ++y)
-	    drawentry(y, x, colwidth - 1, i++);
-	refresh();
+    for (x = 0 ; x < 16 ; ++x)
+	mvprintw(0, 7 + x * cellwidth, "%X", x);
+    i = gridstep(index, 0);
+    for (y = 1 ; y < lastrow && i < charlistsize ; ++y) {
+	row = charlist[i].uchar >> 4;
+	mvprintw(y, 0, "%6X", row << 4);
+	for ( ; i < charlistsize && charlist[i].uchar >> 4 == row ; ++i) {
+	    if (charlist[i].combining && showcombining) {
+		wch[0] = accentchar;
+		wch[1] = charlist[i].uchar;
+		wch[2] = L'\0';
+	    } else if (glyphwidth(charlist[i].uchar) > 0) {
+		wch[0] = charlist[i].uchar;
+		wch[1] = L'\0';
+	    } else {
+		continue;
+	    }
+	    setcchar(&cch, wch, 0, 0, NULL);
+	    mvadd_wch(y, 7 + (charlist[i].uchar & 0x0F) * cellwidth, &cch);
+	}
     }
     mvprintw(lastrow, 0, "[%04X - %04X]",
-	     charlist[index].uchar, charlist[i - 1].uchar);
-    refresh();
+	     charlist[gridstep(index, 0)].uchar & ~0x0F,
+	     charlist[i - 1].uchar | 0x0F);
+    if (searchmismatches && widthmismatch(index))
+	drawmismatchstatus(index);
+    if (lowbandwidth)
+	printw("  %ld bytes", framebytes);
+    if (showtiming)
+	drawtimingstatus();
+    bytes = lowbandwidth || showtiming ? estimateoutput() : 0;
+    rendered = now();
+    sendframe(bytes);
+    if (showtiming)
+	recordframe(start, rendered, now(), bytes);
     return i;
 }
 
+/* Display a brief description of the key commands.
+ */
+static void showgridhelptext(void)
+{
+    static char const *helptext[] = {
+	"Spc    Move forward one screenful   Bkspc  Move back one screenful",
+	"Down   Move forward one row         Up     Move back one row",
+	"}      Move forward by U+1000       {      Move back by U+1000",
+	"U or S Go to a specific codepoint   J or B Jump to a selected block",
+	"I      Show info for top codepoint  /      Search for string in name",
+	"N      Repeat the last search       P      To previous search result",
+	"M      Find the next character whose widths disagree (then N or P)",
+	"V      Display Unicode version      ?      Display this help text",
+	"T      Show timing statistics       ^L     Redraw the screen",
+	"=      Go to an exact name          G or Q Return to the list view"
+    };
+
+    showhelppopup(helptext, sizeof helptext / sizeof *helptext);
+}
+
+/* Render the character table as a code chart and alter it in
+ * response to keystrokes from the user. The function returns when the
+ * user leaves the grid view, with the position in the character table
+ * corresponding to the top of the chart.
+ */
+static int gridui(int index)
+{
+    int repaint = TRUE;
+    int pagesize, ch;
+
+    for (;;) {
+	pagesize = lastrow - 1;
+	index = gridstep(index, 0);
+	if (index > gridstep(charlistsize - 1, 1 - pagesize))
+	    index = gridstep(charlistsize - 1, 1 - pagesize);
+	if (repaint && !lowbandwidth)
+	    clearok(stdscr, TRUE);
+	drawgrid(index);
+	repaint = TRUE;
+	ch = getkey(stdscr);
+	switch (translatekey(ch)) {
+	  case '+':	index = gridstep(index, +1);		break;
+	  case '-':	index = gridstep(index, -1);		break;
+	  case '>':	index = gridstep(index, +1);		break;
+	  case '<':	index = gridstep(index, -1);		break;
+	  case 'F':	index = gridstep(index, +pagesize);	break;
+	  case 'B':	index = gridstep(index, -pagesize);	break;
+	  case '}':	index = offsetchar(index, +0x1000);	break;
+	  case '{':	index = offsetchar(index, -0x1000);	break;
+	  case '/':	index = searchui(index, 0);		break;
+	  case 'n':	index = searchui(index, +1);		break;
+	  case 'p':	index = searchui(index, -1);		break;
+	  case 'm':
+	    searchmismatches = TRUE;
+	    index = searchui(index, +1);
+	    break;
+	  case 'u':	index = jumpui(index);			break;
+	  case 's':	index = jumpui(index);			break;
+	  case '=':	index = nameui(index);			break;
+	  case 'j':	index = blockselectui(index);		break;
+	  case 'b':	index = blockselectui(index);		break;
+	  case 'i':
+	    showcharinfo(index);
+	    repaint = FALSE;
+	    break;
+	  case 't':	showtiming = !showtiming;		break;
+	  case '?':
+	    showgridhelptext();
+	    repaint = FALSE;
+	    break;
+	  case 'v':	showversion();				break;
+	  case '\f':	clearok(stdscr, TRUE);			break;
+	  case 'g':	return index;
+	  case 'q':	return index;
+	  case '\003':	exit(EXIT_SUCCESS);
+	}
+    }
+}
+
 /* Display a brief description of the key commands.
  */
 static void showmainhelptext(void)
@@ -787,21 +2005,14 @@ static void showmainhelptext(void)
 	"U or S Go to a specific codepoint   J or B Jump to a selected block",
 	"I      Show info for top codepoint  /      Search for string in name",
 	"N      Repeat the last search       P      To previous search result",
+	"M      Find the next character whose widths disagree (then N or P)",
 	"V      Display Unicode version      ?      Display this help text",
-	"^L     Redraw the screen            Q      Exit the program"
+	"G      View as a code chart         T      Show timing statistics",
+	"F      Cycle the character filter   ^L     Redraw the screen",
+	"=      Go to an exact name          Q      Exit the program"
     };
 
-    int i;
-
-    for (i = 0 ; i < (int)(sizeof helptext / sizeof *helptext) ; ++i) {
-	move(i, 0);
-	clrtoeol();
-	addstr("   ");
-	addstr(helptext[i]);
-    }
-    move(i, 0);
-    clrtoeol();
-    anykey();
+    showhelppopup(helptext, sizeof helptext / sizeof *helptext);
 }
 
 /* Render a view of the character table as per the user's keyboard
@@ -810,68 +2021,473 @@ static void showmainhelptext(void)
  */
 static void mainui(int index)
 {
-    int tablesize;
+    int repaint = FALSE;
+    int tablesize, pos, prev, ch, n;
 
     for (;;) {
-	if (index < 0)
-	    index = 0;
 	if (columncount < 1)
 	    columncount = 1;
 	else if (columncount > (xtermsize - 1) / (mincolumnwidth + 1))
 	    columncount = (xtermsize - 1) / (mincolumnwidth + 1);
 	tablesize = (ytermsize - 1) * columncount;
-	if (index > charlistsize - tablesize)
-	    index = charlistsize - tablesize;
-	drawtable(index);
-	clearok(stdscr, TRUE);
-	switch (translatekey(getch())) {
-	  case '+':	++index;				break;
-	  case '-':	--index;				break;
-	  case '>':	index += ytermsize - 1;			break;
-	  case '<':	index -= ytermsize - 1;			break;
-	  case 'F':	index += tablesize;			break;
-	  case 'B':	index -= tablesize;			break;
+	pos = filterrank(index);
+	if (pos > filtercount() - tablesize)
+	    pos = filtercount() - tablesize;
+	if (pos < 0)
+	    pos = 0;
+	n = filterselect(pos);
+	if (n >= 0)
+	    index = n;
+	if (repaint && !lowbandwidth)
+	    clearok(stdscr, TRUE);
+	drawtable(pos);
+	repaint = TRUE;
+	prev = index;
+	ch = getkey(stdscr);
+	switch (translatekey(ch)) {
+	  case '+':	index = filterselect(pos + 1);		break;
+	  case '-':	index = filterselect(pos - 1);		break;
+	  case '>':	index = filterselect(pos + ytermsize - 1);	break;
+	  case '<':	index = filterselect(pos - ytermsize + 1);	break;
+	  case 'F':	index = filterselect(pos + tablesize);	break;
+	  case 'B':	index = filterselect(pos - tablesize);	break;
 	  case '}':	index = offsetchar(index, +0x1000);	break;
 	  case '{':	index = offsetchar(index, -0x1000);	break;
 	  case '/':	index = searchui(index, 0);		break;
 	  case 'n':	index = searchui(index, +1);		break;
 	  case 'p':	index = searchui(index, -1);		break;
+	  case 'm':
+	    searchmismatches = TRUE;
+	    index = searchui(index, +1);
+	    break;
 	  case 'u':	index = jumpui(index);			break;
 	  case 's':	index = jumpui(index);			break;
+	  case '=':	index = nameui(index);			break;
 	  case 'j':	index = blockselectui(index);		break;
 	  case 'b':	index = blockselectui(index);		break;
 	  case '[':	++columncount;				break;
 	  case ']':	--columncount;				break;
-	  case 'i':	showcharinfo(index);			break;
-	  case '?':	showmainhelptext();			break;
+	  case 'g':
+	    if (filtercount())
+		index = gridui(index);
+	    else
+		beep();
+	    break;
+	  case 'f':
+	    n = filtermode;
+	    do
+		n = (n + 1) % FILTER_COUNT;
+	    while (!filterinit(n) || (n != FILTER_NONE && !filters[n].count));
+	    filtermode = n;
+	    break;
+	  case 'i':
+	    if (filtercount()) {
+		showcharinfo(index);
+		repaint = FALSE;
+	    } else {
+		beep();
+	    }
+	    break;
+	  case 't':	showtiming = !showtiming;		break;
+	  case '?':
+	    showmainhelptext();
+	    repaint = FALSE;
+	    break;
 	  case 'v':	showversion();				break;
 	  case '\f':	clearok(stdscr, TRUE);			break;
 	  case 'q':	return;
 	  case '\003':	exit(EXIT_SUCCESS);
 	}
+	if (index < 0)
+	    index = prev;
     }
 }
 
-/*
- * Top-level functions
+/* Return the offset of the codepoint that is count codepoints away
+ * from the one at offset in the inspected text, stopping at either
+ * end of the text.
  */
+static unsigned long inspectstep(unsigned long offset, int count)
+{
+    long uchar;
+    int n;
 
-/* Parse the command-line arguments. The return value is the initial
- * codepoint specified on the command-line, or 0 if no initial
- * codepoint was present. If the command-line was invalid, the
+    for ( ; count > 0 ; --count) {
+	n = inspectdecode(&inspected, offset, &uchar);
+	if (!n)
+	    break;
+	offset += n;
+    }
+    for ( ; count < 0 && offset > 0 ; ++count)
+	offset = inspectprev(&inspected, offset);
+    return offset;
+}
+
+/* Return the offset of the grapheme cluster that follows (or, if
+ * direction is negative, precedes) the one containing the codepoint
+ * at offset.
+ */
+static unsigned long inspectcluster(unsigned long offset, int direction)
+{
+    if (direction > 0) {
+	do
+	    offset = inspectstep(offset, +1);
+	while (!inspectboundary(&inspected, offset));
+    } else {
+	while (!inspectboundary(&inspected, offset))
+	    offset = inspectprev(&inspected, offset);
+	do
+	    offset = inspectprev(&inspected, offset);
+	while (!inspectboundary(&inspected, offset));
+    }
+    return offset;
+}
+
+/* Return the name to display for a decoded codepoint, which is either
+ * its official name or a description of why it has none.
+ */
+static char const *inspectname(long uchar, int index, int *size)
+{
+    char const *name;
+
+    if (index >= 0) {
+	*size = charlist[index].namesize;
+	return charnamebuffer + charlist[index].nameoffset;
+    }
+    if (uchar < 0)
+	name = "<invalid UTF-8 sequence>";
+    else if (uchar < 0x20)
+	name = controlnames[uchar];
+    else if (uchar == 0x7F)
+	name = "delete";
+    else if (uchar == 0x85)
+	name = "next line";
+    else if (uchar < 0xA0)
+	name = "<control>";
+    else if ((uchar & 0xFFFE) == 0xFFFE
+			|| (uchar >= 0xFDD0 && uchar <= 0xFDEF))
+	name = "<noncharacter>";
+    else
+	name = "<unassigned>";
+    *size = strlen(name);
+    return name;
+}
+
+/* Display the codepoint at the given offset in the inspected text on
+ * row y. The first column holds the byte offset, padded to width
+ * cells, followed by a bracket that joins the codepoints of a
+ * grapheme cluster, the codepoint value, its UTF-8 bytes, its width,
+ * its glyph, and its name. first is true if a cluster boundary falls
+ * before the codepoint. The return value is true if one falls after
+ * it.
+ */
+static int drawinspectrow(int y, unsigned long offset, int width, int first)
+{
+    unsigned char const *bytes;
+    wchar_t wch[3];
+    cchar_t cch;
+    char const *name;
+    long uchar;
+    int last, size, glyph, index, namesize, x, i;
+
+    size = inspectdecode(&inspected, offset, &uchar);
+    last = inspectboundary(&inspected, offset + size);
+    bytes = inspected.data + offset;
+    index = uchar < 0 ? -1 : charindex(uchar);
+
+    mvprintw(y, 0, "%*lu ", width, offset);
+    if (!last)
+	addch(first ? ACS_ULCORNER : ACS_VLINE);
+    else if (!first)
+	addch(ACS_LLCORNER);
+    x = width + 3;
+    if (uchar < 0) {
+	attron(A_REVERSE);
+	mvaddstr(y, x, "invalid");
+	attroff(A_REVERSE);
+    } else {
+	mvprintw(y, x, "U+%04lX", uchar);
+    }
+    x += 9;
+    for (i = 0 ; i < size ; ++i)
+	mvprintw(y, x + i * 3, "%02X", bytes[i]);
+    x += 12;
+
+    glyph = 0;
+    if (index >= 0) {
+	glyph = glyphwidth(uchar);
+	if (glyph >= 0)
+	    mvprintw(y, x, "%d", glyph);
+	if (charlist[index].combining && showcombining && glyph <= 0) {
+	    wch[0] = accentchar;
+	    wch[1] = uchar;
+	    wch[2] = L'\0';
+	    glyph = 1;
+	} else {
+	    wch[0] = uchar;
+	    wch[1] = L'\0';
+	}
+	if (glyph > 0) {
+	    setcchar(&cch, wch, 0, 0, NULL);
+	    mvadd_wch(y, x + 2, &cch);
+	    if (glyphmode)
+		glyphplace(uchar, y, x + 2, 1, glyph);
+	}
+    } else {
+	mvaddch(y, x, '-');
+    }
+    x += 5;
+
+    name = inspectname(uchar, index, &namesize);
+    if (namesize > xtermsize - x)
+	namesize = xtermsize - x;
+    if (namesize > 0)
+	mvaddnstr(y, x, name, namesize);
+    return last;
+}
+
+/* Display a full screen's worth of the inspected text, one codepoint
+ * to a row, starting with the codepoint at offset top. Only the rows
+ * that are visible are decoded. The range of bytes displayed is
+ * shown on the bottommost line of the terminal.
+ */
+static void drawinspect(unsigned long top)
+{
+    unsigned long offset, n;
+    double start, rendered;
+    long bytes;
+    int width, first, y;
+
+    start = now();
+    syncupdate(TRUE);
+    width = 1;
+    for (n = inspected.size ; n >= 10 ; n /= 10)
+	++width;
+    erase();
+    offset = top;
+    first = inspectboundary(&inspected, offset);
+    for (y = 0 ; y < lastrow && offset < inspected.size ; ++y) {
+	first = drawinspectrow(y, offset, width, first);
+	offset = inspectstep(offset, +1);
+    }
+    move(lastrow, 0);
+    if (inspected.size == 0)
+	printw("[empty]");
+    else
+	printw("[bytes %lu - %lu of %lu]", top, offset - 1, inspected.size);
+    if (lowbandwidth)
+	printw("  %ld bytes", framebytes);
+    if (showtiming)
+	drawtimingstatus();
+    bytes = lowbandwidth || showtiming ? estimateoutput() : 0;
+    rendered = now();
+    sendframe(bytes);
+    if (showtiming)
+	recordframe(start, rendered, now(), bytes);
+}
+
+/* Return the offset of the next unusual character in the inspected
+ * text after the codepoint at offset, going in the given direction.
+ * The passed-in offset is returned if there is none.
+ */
+static unsigned long inspectunusualui(unsigned long offset, int direction)
+{
+    long found;
+
+    found = inspectfindunusual(&inspected, offset, direction);
+    if (found < 0) {
+	beep();
+	return offset;
+    }
+    return found;
+}
+
+/* Get a codepoint from the user, and return the offset of its next
+ * occurrence in the inspected text after the codepoint at offset.
+ * The passed-in offset is returned if there is none.
+ */
+static unsigned long inspectfindui(unsigned long offset)
+{
+    char buf[7];
+    long value, found;
+
+    if (doinputui(buf, sizeof buf, "U+", isxdigit) < 0)
+	return offset;
+    value = readucharvalue(buf);
+    found = value < 0 ? -1 : inspectfindchar(&inspected, offset, value);
+    if (found < 0) {
+	beep();
+	return offset;
+    }
+    return found;
+}
+
+/* Get a byte offset from the user, and return the offset of the
+ * codepoint at that position in the inspected text. The passed-in
+ * offset is returned if the position is not within the text.
+ */
+static unsigned long inspectoffsetui(unsigned long offset)
+{
+    char buf[24];
+    unsigned long value;
+
+    if (doinputui(buf, sizeof buf, "Offset: ", isdigit) <= 0)
+	return offset;
+    value = strtoul(buf, NULL, 10);
+    if (value >= inspected.size) {
+	beep();
+	return offset;
+    }
+    return inspectstart(&inspected, value);
+}
+
+/* Display a brief description of the key commands.
+ */
+static void showinspecthelptext(void)
+{
+    static char const *helptext[] = {
+	"Spc    Move forward one screenful   Bkspc  Move back one screenful",
+	"Down   Move forward one codepoint   Up     Move back one codepoint",
+	"Right  Move forward one cluster     Left   Move back one cluster",
+	"}      Move to the end of the text  {      Move to the start",
+	"N      Find the next unusual char   P      Find the previous one",
+	"U or S Find a specific codepoint    O      Go to a byte offset",
+	"I      Show info for top codepoint  V      Display Unicode version",
+	"T      Show timing statistics       ?      Display this help text",
+	"^L     Redraw the screen            Q      Exit the program",
+	"",
+	"Unusual characters are all but printable ASCII, tab, and newline."
+    };
+
+    showhelppopup(helptext, sizeof helptext / sizeof *helptext);
+}
+
+/* Render the codepoints of the inspected text as a list, and move
+ * through it in response to keystrokes from the user. Return when the
+ * user requests to leave the program.
+ */
+static void inspectui(void)
+{
+    unsigned long top, last;
+    long uchar, n;
+    int repaint = FALSE;
+    int ch;
+
+    top = 0;
+    for (;;) {
+	last = inspectstep(inspected.size, -lastrow);
+	if (top > last)
+	    top = last;
+	if (repaint && !lowbandwidth)
+	    clearok(stdscr, TRUE);
+	drawinspect(top);
+	repaint = TRUE;
+	ch = getkey(stdscr);
+	switch (translatekey(ch)) {
+	  case '+':	top = inspectstep(top, +1);		break;
+	  case '-':	top = inspectstep(top, -1);		break;
+	  case '>':	top = inspectcluster(top, +1);		break;
+	  case '<':	top = inspectcluster(top, -1);		break;
+	  case 'F':	top = inspectstep(top, +lastrow);	break;
+	  case 'B':	top = inspectstep(top, -lastrow);	break;
+	  case '}':	top = last;				break;
+	  case '{':	top = 0;				break;
+	  case 'n':	top = inspectunusualui(top, +1);	break;
+	  case 'p':	top = inspectunusualui(top, -1);	break;
+	  case 'u':	top = inspectfindui(top);		break;
+	  case 's':	top = inspectfindui(top);		break;
+	  case 'o':	top = inspectoffsetui(top);		break;
+	  case 'i':
+	    inspectdecode(&inspected, top, &uchar);
+	    n = uchar < 0 ? -1 : charindex(uchar);
+	    if (n < 0) {
+		beep();
+	    } else {
+		showcharinfo(n);
+		repaint = FALSE;
+	    }
+	    break;
+	  case 't':	showtiming = !showtiming;		break;
+	  case '?':
+	    showinspecthelptext();
+	    repaint = FALSE;
+	    break;
+	  case 'v':	showversion();				break;
+	  case '\f':	clearok(stdscr, TRUE);			break;
+	  case 'q':	return;
+	  case '\003':	exit(EXIT_SUCCESS);
+	}
+    }
+}
+
+/*
+ * Top-level functions
+ */
+
+/* Parse a comma-separated list of field names, and select those
+ * fields for output.
+ */
+static void readfields(char const *list)
+{
+    char const *end;
+    int size, n;
+
+    fieldcount = 0;
+    for (;;) {
+	end = strchr(list, ',');
+	size = end ? (int)(end - list) : (int)strlen(list);
+	for (n = 0 ; n < FIELD_COUNT ; ++n)
+	    if ((int)strlen(fieldnames[n]) == size
+			&& !memcmp(fieldnames[n], list, size))
+		break;
+	if (n == FIELD_COUNT || fieldcount == FIELD_COUNT)
+	    die("invalid field name: \"%.*s\"", size, list);
+	fields[fieldcount++] = n;
+	if (!end)
+	    break;
+	list = end + 1;
+    }
+}
+
+/* Parse the command-line arguments. The return value is the initial
+ * codepoint specified on the command-line, or 0 if no initial
+ * codepoint was present. If the command-line was invalid, the
  * function quits the program.
  */
 static int readcmdline(int argc, char *argv[])
 {
-    static char const *optstring = "a:A";
+    static char const *optstring = "a:AlT";
     static struct option options[] = {
 	{ "accent", required_argument, NULL, 'a' },
 	{ "noaccent", no_argument, NULL, 'A' },
+	{ "lowbandwidth", no_argument, NULL, 'l' },
+	{ "baud", required_argument, NULL, 'B' },
+	{ "timing", no_argument, NULL, 'T' },
+	{ "sync", no_argument, NULL, 'S' },
+	{ "fonts", no_argument, NULL, 'f' },
+	{ "glyphs", required_argument, NULL, 'G' },
+	{ "mismatches", no_argument, NULL, 'M' },
+	{ "report", optional_argument, NULL, 'R' },
+	{ "census", required_argument, NULL, 'C' },
+	{ "dump", optional_argument, NULL, 'D' },
+	{ "batch", no_argument, NULL, 'b' },
+	{ "name", required_argument, NULL, 'N' },
+	{ "serve", required_argument, NULL, 'E' },
+	{ "client", required_argument, NULL, 'L' },
+	{ "fields", required_argument, NULL, 'F' },
+	{ "format", required_argument, NULL, 'O' },
+	{ "convert", required_argument, NULL, 'X' },
+	{ "inspect", no_argument, NULL, 'I' },
+	{ "stats", no_argument, NULL, 'W' },
+	{ "record", required_argument, NULL, 'k' },
+	{ "replay", required_argument, NULL, 'K' },
+	{ "probe", no_argument, NULL, 'P' },
 	{ "help", no_argument, NULL, 'h' },
 	{ "version", no_argument, NULL, 'v' },
 	{ 0, 0, 0, 0 }
     };
     char const *str;
+    char *p;
     int ch, i;
 
     while ((ch = getopt_long(argc, argv, optstring, options, NULL)) != EOF) {
@@ -889,6 +2505,107 @@ static int readcmdline(int argc, char *argv[])
 	  case 'A':
 	    showcombining = FALSE;
 	    break;
+	  case 'l':
+	    lowbandwidth = TRUE;
+	    break;
+	  case 'T':
+	    showtiming = TRUE;
+	    break;
+	  case 'S':
+	    syncupdates = TRUE;
+	    break;
+	  case 'f':
+	    scanfonts = TRUE;
+	    break;
+	  case 'G':
+	    if (!strcmp(optarg, "sixel"))
+		glyphmode = GLYPHS_SIXEL;
+	    else if (!strcmp(optarg, "kitty"))
+		glyphmode = GLYPHS_KITTY;
+	    else
+		die("invalid graphics protocol: \"%s\"", optarg);
+	    scanfonts = TRUE;
+	    break;
+	  case 'M':
+	    mismatchmode = TRUE;
+	    break;
+	  case 'R':
+	    if (!optarg || !strcmp(optarg, "text"))
+		reportformat = REPORT_TEXT;
+	    else if (!strcmp(optarg, "tsv"))
+		reportformat = REPORT_TSV;
+	    else if (!strcmp(optarg, "json"))
+		reportformat = REPORT_JSON;
+	    else
+		die("invalid report format: \"%s\"", optarg);
+	    break;
+	  case 'C':
+	    censusname = optarg;
+	    break;
+	  case 'W':
+	    showstats = TRUE;
+	    break;
+	  case 'k':
+	    recordfile = fopen(optarg, "w");
+	    if (!recordfile)
+		die("%s: %s", optarg, strerror(errno));
+	    setvbuf(recordfile, NULL, _IOLBF, 0);
+	    break;
+	  case 'K':
+	    replayfile = fopen(optarg, "r");
+	    if (!replayfile)
+		die("%s: %s", optarg, strerror(errno));
+	    break;
+	  case 'D':
+	    dumpmode = TRUE;
+	    dumpspec = optarg;
+	    break;
+	  case 'F':
+	    readfields(optarg);
+	    break;
+	  case 'X':
+	    for (i = 0 ; i < CONVERT_COUNT ; ++i)
+		if (!strcmp(optarg, convertnames[i]))
+		    break;
+	    if (i == CONVERT_COUNT)
+		die("invalid encoding: \"%s\"", optarg);
+	    convertencoding = i;
+	    break;
+	  case 'O':
+	    if (!strcmp(optarg, "tsv"))
+		dumpformat = DUMP_TSV;
+	    else if (!strcmp(optarg, "csv"))
+		dumpformat = DUMP_CSV;
+	    else if (!strcmp(optarg, "jsonl"))
+		dumpformat = DUMP_JSONL;
+	    else
+		die("invalid output format: \"%s\"", optarg);
+	    break;
+	  case 'I':
+	    inspectmode = TRUE;
+	    break;
+	  case 'b':
+	    batchmode = TRUE;
+	    break;
+	  case 'N':
+	    exactname = optarg;
+	    break;
+	  case 'E':
+	    servepath = optarg;
+	    break;
+	  case 'L':
+	    clientpath = optarg;
+	    break;
+	  case 'P':
+	    probemode = TRUE;
+	    break;
+	  case 'B':
+	    linerate = strtol(optarg, &p, 10) / 10;
+	    if (*p || linerate <= 0)
+		die("invalid baud rate: \"%s\"", optarg);
+	    fixedlinerate = TRUE;
+	    lowbandwidth = TRUE;
+	    break;
 	  case 'h':
 	    for (i = 0 ; i < (int)(sizeof yowzitch / sizeof *yowzitch) ; ++i)
 		puts(yowzitch[i]);
@@ -902,13 +2619,19 @@ static int readcmdline(int argc, char *argv[])
 	}
     }
     ch = 0;
-    if (optind < argc) {
+    if (optind < argc && inspectmode) {
+	inspectarg = argv[optind++];
+    } else if (optind < argc) {
 	str = argv[optind];
 	ch = readsinglecharstring(str);
 	if (ch < 0) {
 	    ch = readuchar(str);
+	    if (ch < 0)
+		ch = findcharbyexactname(str);
 	    if (ch < 0) {
-		ch = findcharbyname(str, 0, +1);
+		ch = -1;
+		if (namesearchinit(&lastsearch, str))
+		    ch = findcharbyname(&lastsearch, 0, +1);
 		if (ch < 0)
 		    die("Invalid start value: \"%s\".", argv[optind]);
 	    }
@@ -917,18 +2640,1348 @@ static int readcmdline(int argc, char *argv[])
     }
     if (optind < argc)
 	die("Bad command-line argument.\nTry --help for more information.");
+    if (glyphmode && lowbandwidth)
+	die("--glyphs cannot be used with --lowbandwidth.");
     return ch;
 }
 
+/* Measure how wide the terminal displays each codepoint, and output
+ * the results as a table. The measurements are saved to the width
+ * cache as they are made, so an interrupted probe can be resumed
+ * later, and codepoints that have already been measured are skipped.
+ */
+static void runprobe(void)
+{
+    static int const chunksize = 4096;
+    unsigned char *widths;
+    double start;
+    int cached, from, to, total, n, i;
+
+    widths = malloc(charlistsize);
+    if (!widths)
+	die("out of memory");
+    if (!probeopen())
+	die("unable to access the terminal");
+    cached = widthcacheopen(TRUE);
+    if (!cached)
+	fputs("unable to open the width cache; results will not be saved\n",
+	      stderr);
+    for (i = 0 ; i < charlistsize ; ++i) {
+	n = cachedwidth(charlist[i].uchar);
+	widths[i] = n < 0 ? WIDTH_UNKNOWN : n;
+    }
+    start = now();
+    total = n = 0;
+    for (from = 0 ; from < charlistsize ; from = to) {
+	to = from + chunksize;
+	if (to > charlistsize)
+	    to = charlistsize;
+	n = probewidths(widths, from, to);
+	if (n < 0)
+	    break;
+	total += n;
+	for (i = from ; i < to ; ++i)
+	    if (widths[i] != WIDTH_UNKNOWN)
+		setcachedwidth(charlist[i].uchar, widths[i]);
+	if (probeinterrupted())
+	    break;
+    }
+    probeclose();
+    widthcacheclose();
+    if (n < 0 && !total)
+	die("the terminal did not report its cursor position");
+    for (i = n = 0 ; i < charlistsize ; ++i) {
+	if (widths[i] != WIDTH_UNKNOWN) {
+	    printf("%04X\t%d\n", charlist[i].uchar, widths[i]);
+	    ++n;
+	}
+    }
+    fprintf(stderr, "%d codepoints measured in %.1f seconds;"
+		    " %d of %d now known\n",
+	    total, now() - start, n, charlistsize);
+    if (from < charlistsize && cached)
+	fputs("run --probe again to resume\n", stderr);
+    free(widths);
+}
+
+/* The columns of the coverage report.
+ */
+enum { COUNT_ASSIGNED, COUNT_DISPLAYABLE, COUNT_ZEROWIDTH, COUNT_WIDE,
+       COUNT_UNSUPPORTED, COUNT_COLUMNS };
+
+/* Output a string as a JSON string literal.
+ */
+static void printjsonstring(char const *str)
+{
+    putchar('"');
+    for ( ; *str ; ++str) {
+	if (*str == '"' || *str == '\\')
+	    printf("\\%c", *str);
+	else if ((unsigned char)*str < 0x20)
+	    printf("\\u%04X", (unsigned char)*str);
+	else
+	    putchar(*str);
+    }
+    putchar('"');
+}
+
+/* Output one line of the coverage report.
+ */
+static void printreportline(char const *name, unsigned int from,
+			    unsigned int to, long const *counts, int first)
+{
+    static char const *jsonnames[COUNT_COLUMNS] = {
+	"assigned", "displayable", "zerowidth", "wide", "unsupported"
+    };
+    int i;
+
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printf("%06X..%06X %-50s", from, to, name);
+	for (i = 0 ; i < COUNT_COLUMNS ; ++i)
+	    printf(" %6ld", counts[i]);
+	putchar('\n');
+	break;
+      case REPORT_TSV:
+	printf("%04X\t%04X\t%s", from, to, name);
+	for (i = 0 ; i < COUNT_COLUMNS ; ++i)
+	    printf("\t%ld", counts[i]);
+	putchar('\n');
+	break;
+      case REPORT_JSON:
+	fputs(first ? "\n    " : ",\n    ", stdout);
+	fputs("{ \"block\": ", stdout);
+	printjsonstring(name);
+	printf(", \"from\": %u, \"to\": %u", from, to);
+	for (i = 0 ; i < COUNT_COLUMNS ; ++i)
+	    printf(", \"%s\": %ld", jsonnames[i], counts[i]);
+	fputs(" }", stdout);
+	break;
+    }
+}
+
+/* Output a report of how many characters in each block can be
+ * displayed, using the best information available about the
+ * terminal: its measured widths and the installed fonts' coverage,
+ * if known, or else the widths provided by wcwidth(3). The blocks
+ * and the characters are walked through together, in a single pass.
+ */
+static void runreport(void)
+{
+    long counts[COUNT_COLUMNS], totals[COUNT_COLUMNS];
+    char const *widthsource, *coveragesource;
+    int width, b, i, n;
+
+    widthsource = havewidthcache ? "measured" : "wcwidth";
+    coveragesource = scanfonts ? "fonts" : "none";
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printf("Unicode %s, widths: %s, coverage: %s\n\n",
+	       unicodeversion, widthsource, coveragesource);
+	printf("%-14s %-50s %6s %6s %6s %6s %6s\n", "Range", "Block",
+	       "Assign", "Disp", "Zero", "Wide", "Unsupp");
+	break;
+      case REPORT_TSV:
+	printf("from\tto\tblock\tassigned\tdisplayable\tzerowidth\twide"
+	       "\tunsupported\n");
+	break;
+      case REPORT_JSON:
+	printf("{\n  \"unicode\": \"%s\",\n  \"widths\": \"%s\",\n"
+	       "  \"coverage\": \"%s\",\n  \"blocks\": [",
+	       unicodeversion, widthsource, coveragesource);
+	break;
+    }
+
+    memset(totals, 0, sizeof totals);
+    i = 0;
+    for (b = 0 ; b < blocklistsize ; ++b) {
+	memset(counts, 0, sizeof counts);
+	while (i < charlistsize && charlist[i].uchar < blocklist[b].from)
+	    ++i;
+	for ( ; i < charlistsize && charlist[i].uchar <= blocklist[b].to ; ++i) {
+	    ++counts[COUNT_ASSIGNED];
+	    width = glyphwidth(charlist[i].uchar);
+	    if (width < 0 || !glyphsupport(i)) {
+		++counts[COUNT_UNSUPPORTED];
+		continue;
+	    }
+	    ++counts[COUNT_DISPLAYABLE];
+	    if (width == 0)
+		++counts[COUNT_ZEROWIDTH];
+	    else if (width > 1)
+		++counts[COUNT_WIDE];
+	}
+	for (n = 0 ; n < COUNT_COLUMNS ; ++n)
+	    totals[n] += counts[n];
+	printreportline(blocklist[b].name, blocklist[b].from, blocklist[b].to,
+			counts, b == 0);
+    }
+
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printreportline("Total", 0, lastucharval, totals, FALSE);
+	break;
+      case REPORT_TSV:
+	break;
+      case REPORT_JSON:
+	printf("\n  ],\n  \"total\": { \"assigned\": %ld, \"displayable\":"
+	       " %ld, \"zerowidth\": %ld, \"wide\": %ld, \"unsupported\": %ld"
+	       " }\n}\n", totals[COUNT_ASSIGNED], totals[COUNT_DISPLAYABLE],
+	       totals[COUNT_ZEROWIDTH], totals[COUNT_WIDE],
+	       totals[COUNT_UNSUPPORTED]);
+	break;
+    }
+}
+
+/* Get the text to inspect, from the command line or standard input.
+ */
+static void loadinspect(void)
+{
+    if (inspectarg)
+	inspectstring(&inspected, inspectarg);
+    else if (!inspectread(&inspected, STDIN_FILENO))
+	die("standard input: %s", strerror(errno));
+}
+
+/* Count the characters in the file given with --census.
+ */
+static void loadcensus(void)
+{
+    double start;
+
+    start = now();
+    if (!censusfile(&censusresult, censusname))
+	die("%s: %s", censusname, strerror(errno));
+    censustime = now() - start;
+}
+
+/* Output one line of the census report.
+ */
+static void printcensusline(char const *name, unsigned int from,
+			    unsigned int to, unsigned long distinct,
+			    unsigned long total, int first)
+{
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printf("%06X..%06X %-50s %8lu %12lu\n", from, to, name,
+	       distinct, total);
+	break;
+      case REPORT_TSV:
+	printf("%04X\t%04X\t%s\t%lu\t%lu\n", from, to, name, distinct, total);
+	break;
+      case REPORT_JSON:
+	fputs(first ? "\n    " : ",\n    ", stdout);
+	fputs("{ \"block\": ", stdout);
+	printjsonstring(name);
+	printf(", \"from\": %u, \"to\": %u, \"distinct\": %lu,"
+	       " \"count\": %lu }", from, to, distinct, total);
+	break;
+    }
+}
+
+/* Output the census results for the codepoints from..to. The
+ * return value is true if a line was output.
+ */
+static int censusrange(char const *name, unsigned int from, unsigned int to,
+		       int first)
+{
+    unsigned long distinct, total;
+    unsigned int uchar;
+
+    distinct = total = 0;
+    for (uchar = from ; uchar <= to ; ++uchar) {
+	if (censusresult.counts[uchar]) {
+	    ++distinct;
+	    total += censusresult.counts[uchar];
+	}
+    }
+    if (!distinct)
+	return FALSE;
+    printcensusline(name, from, to, distinct, total, first);
+    return TRUE;
+}
+
+/* Output the location and bytes of an invalid sequence.
+ */
+static void printinvalid(censusinvalid const *inv, int first)
+{
+    int i;
+
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printf("  offset %lu:", inv->offset);
+	for (i = 0 ; i < inv->size ; ++i)
+	    printf(" %02X", inv->bytes[i]);
+	putchar('\n');
+	break;
+      case REPORT_TSV:
+	fprintf(stderr, "%s: invalid UTF-8 at offset %lu:", censusname,
+		inv->offset);
+	for (i = 0 ; i < inv->size ; ++i)
+	    fprintf(stderr, " %02X", inv->bytes[i]);
+	fputc('\n', stderr);
+	break;
+      case REPORT_JSON:
+	fputs(first ? "\n    " : ",\n    ", stdout);
+	printf("{ \"offset\": %lu, \"bytes\": \"", inv->offset);
+	for (i = 0 ; i < inv->size ; ++i)
+	    printf(i ? " %02X" : "%02X", inv->bytes[i]);
+	fputs("\" }", stdout);
+	break;
+    }
+}
+
+/* Output the results of the census as a report of the number of
+ * distinct characters, and the total number of occurrences, found in
+ * each block, followed by the locations of the invalid sequences.
+ * The codepoints that are outside of every block are counted
+ * together at the end. In the tsv format, which has room for only
+ * one table, the invalid sequences are reported on standard error.
+ */
+static void runcensusreport(void)
+{
+    unsigned int from;
+    int first, shown, b, i;
+
+    switch (reportformat) {
+      case REPORT_TEXT:
+	printf("%s: %lu bytes, %lu characters, %lu invalid sequences\n",
+	       censusname, censusresult.bytes, censusresult.chars,
+	       censusresult.invalidcount);
+	printf("Decoded in %.3f seconds (%.0f MB/s)\n\n", censustime,
+	       censustime > 0 ? censusresult.bytes / censustime / 1e6 : 0.0);
+	printf("%-14s %-50s %8s %12s\n", "Range", "Block", "Distinct",
+	       "Count");
+	break;
+      case REPORT_TSV:
+	printf("from\tto\tblock\tdistinct\tcount\n");
+	break;
+      case REPORT_JSON:
+	fputs("{\n  \"file\": ", stdout);
+	printjsonstring(censusname);
+	printf(",\n  \"bytes\": %lu,\n  \"characters\": %lu,\n"
+	       "  \"invalid\": %lu,\n  \"seconds\": %.6f,\n  \"blocks\": [",
+	       censusresult.bytes, censusresult.chars,
+	       censusresult.invalidcount, censustime);
+	break;
+    }
+
+    first = TRUE;
+    from = 0;
+    for (b = 0 ; b <= blocklistsize ; ++b) {
+	if (b < blocklistsize && blocklist[b].from == from) {
+	    if (censusrange(blocklist[b].name, from, blocklist[b].to, first))
+		first = FALSE;
+	    from = blocklist[b].to + 1;
+	    continue;
+	}
+	if (censusrange("No_Block", from,
+			b < blocklistsize ? blocklist[b].from - 1
+					  : lastucharval, first))
+	    first = FALSE;
+	if (b < blocklistsize) {
+	    if (censusrange(blocklist[b].name, blocklist[b].from,
+			    blocklist[b].to, first))
+		first = FALSE;
+	    from = blocklist[b].to + 1;
+	}
+    }
+
+    shown = censusresult.invalidcount < CENSUS_MAXINVALID ?
+		(int)censusresult.invalidcount : CENSUS_MAXINVALID;
+    switch (reportformat) {
+      case REPORT_TEXT:
+	if (shown)
+	    printf("\nInvalid sequences:\n");
+	break;
+      case REPORT_JSON:
+	printf("\n  ],\n  \"invalidsequences\": [");
+	break;
+    }
+    for (i = 0 ; i < shown ; ++i)
+	printinvalid(&censusresult.invalid[i], i == 0);
+    switch (reportformat) {
+      case REPORT_TEXT:
+	if (censusresult.invalidcount > (unsigned long)shown)
+	    printf("  (and %lu more)\n", censusresult.invalidcount - shown);
+	break;
+      case REPORT_JSON:
+	printf("\n  ]\n}\n");
+	break;
+    }
+}
+
+/* Write the contents of the output buffer to standard output.
+ */
+static void outflush(void)
+{
+    char const *p = outbuf;
+    int n;
+
+    while (outsize > 0) {
+	n = write(STDOUT_FILENO, p, outsize);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    die("write error: %s", strerror(errno));
+	}
+	p += n;
+	outsize -= n;
+    }
+    outsize = 0;
+}
+
+/* Add bytes to the output buffer.
+ */
+static void outbytes(char const *data, int size)
+{
+    if (outsize + size > (int)sizeof outbuf)
+	outflush();
+    memcpy(outbuf + outsize, data, size);
+    outsize += size;
+}
+
+/* Store an unsigned number at p in hexadecimal, using at least the
+ * given number of digits, and return the position following it.
+ */
+static char *puthex(char *p, unsigned long value, int digits)
+{
+    static char const hexdigits[] = "0123456789ABCDEF";
+    char *end;
+
+    while (digits < 8 && value >> (digits * 4))
+	++digits;
+    end = p + digits;
+    p = end;
+    while (digits >= 2) {
+	p -= 2;
+	p[0] = hexdigits[(value >> 4) & 15];
+	p[1] = hexdigits[value & 15];
+	value >>= 8;
+	digits -= 2;
+    }
+    if (digits)
+	p[-1] = hexdigits[value & 15];
+    return end;
+}
+
+/* Store an unsigned number at p in decimal, and return the position
+ * following it.
+ */
+static char *putdecimal(char *p, unsigned long value)
+{
+    char buf[16];
+    int n;
+
+    n = sizeof buf;
+    do {
+	buf[--n] = '0' + value % 10;
+	value /= 10;
+    } while (value);
+    memcpy(p, buf + n, sizeof buf - n);
+    return p + sizeof buf - n;
+}
+
+/* Store a string at p, and return the position following it.
+ */
+static char *putstr(char *p, char const *str, int size)
+{
+    memcpy(p, str, size);
+    return p + size;
+}
+
+/* Return true if two block names are the same, ignoring case,
+ * spaces, hyphens, and underscores.
+ */
+static int blocknamesmatch(char const *a, char const *b)
+{
+    for (;;) {
+	while (*a == ' ' || *a == '-' || *a == '_')
+	    ++a;
+	while (*b == ' ' || *b == '-' || *b == '_')
+	    ++b;
+	if (tolower((unsigned char)*a) != tolower((unsigned char)*b))
+	    return FALSE;
+	if (!*a)
+	    return TRUE;
+	++a;
+	++b;
+    }
+}
+
+/* Interpret the specification given with --dump. A range of
+ * codepoints is stored in from and to. A block name is stored as the
+ * block's range. Anything else is stored in query, in lowercase, as a
+ * string to find in the names, and the range is left unchanged.
+ */
+static void readdumpspec(char const *spec, unsigned int *from,
+			 unsigned int *to, char *query, int querysize)
+{
+    char buf[64];
+    char const *sep;
+    long first, last;
+    int size, i;
+
+    sep = strstr(spec, "..");
+    size = 2;
+    if (!sep) {
+	sep = strchr(spec, '-');
+	size = 1;
+    }
+    if (sep && sep - spec < (int)sizeof buf) {
+	memcpy(buf, spec, sep - spec);
+	buf[sep - spec] = '\0';
+	first = readucharvalue(buf);
+	last = readucharvalue(sep + size);
+	if (first >= 0 && last >= first) {
+	    *from = first;
+	    *to = last;
+	    return;
+	}
+    }
+    if (spec[0] == 'U' && spec[1] == '+') {
+	first = readucharvalue(spec);
+	if (first >= 0) {
+	    *from = *to = first;
+	    return;
+	}
+    }
+    for (i = 0 ; i < blocklistsize ; ++i) {
+	if (blocknamesmatch(blocklist[i].name, spec)) {
+	    *from = blocklist[i].from;
+	    *to = blocklist[i].to;
+	    return;
+	}
+    }
+    if ((int)strlen(spec) >= querysize)
+	die("search string too long: \"%s\"", spec);
+    for (i = 0 ; spec[i] ; ++i)
+	query[i] = tolower((unsigned char)spec[i]);
+    query[i] = '\0';
+}
+
+/* Store a glyph at p, escaped or quoted as the output format
+ * requires, and return the position following it. Codepoints that
+ * cannot appear in JSON text as they are, which only arise from batch
+ * input, are written as escapes.
+ */
+static char *putglyph(char *p, unsigned int uchar, int index)
+{
+    if (dumpformat == DUMP_JSONL) {
+	*p++ = '"';
+	if (uchar == '"' || uchar == '\\') {
+	    *p++ = '\\';
+	} else if (uchar < 0x20 || (uchar >= 0xD800 && uchar < 0xE000)) {
+	    p = putstr(p, "\\u", 2);
+	    p = puthex(p, uchar, 4);
+	    *p++ = '"';
+	    return p;
+	}
+    } else if (dumpformat == DUMP_CSV) {
+	if (uchar == '"')
+	    return putstr(p, "\"\"\"\"", 4);
+	if (uchar == ',' || uchar == '\n' || uchar == '\r') {
+	    *p++ = '"';
+	    *p++ = uchar;
+	    *p++ = '"';
+	    return p;
+	}
+    }
+    if (index >= 0 && charlist[index].combining && showcombining)
+	p += encodeutf8(accentchar, (unsigned char*)p);
+    p += encodeutf8(uchar, (unsigned char*)p);
+    if (dumpformat == DUMP_JSONL)
+	*p++ = '"';
+    return p;
+}
+
+/* Output the selected fields of a codepoint as a line in the output
+ * format: tab-separated or comma-separated values, or a JSON object.
+ * index is the codepoint's index in the charlist array, or -1 if it
+ * is not defined. block is the index of the block containing the
+ * codepoint, or -1 if it is in no block. Missing values are output
+ * as "-" or "<unassigned>", or as null in JSON. None of the names
+ * contain any characters that would need quoting or escaping. The
+ * line is formatted directly into the output buffer, after checking
+ * once that there is room for the longest possible line.
+ */
+static void dumpline(unsigned int uchar, int index, int block)
+{
+    unsigned char utf8[4];
+    unsigned int utf16[2];
+    char const *str;
+    char *p;
+    int json, quote, i, n, size;
+
+    if (outsize + maxdumpline > (int)sizeof outbuf)
+	outflush();
+    p = outbuf + outsize;
+    json = dumpformat == DUMP_JSONL;
+    if (json)
+	*p++ = '{';
+    for (i = 0 ; i < fieldcount ; ++i) {
+	if (i)
+	    *p++ = dumpformat == DUMP_TSV ? '\t' : ',';
+	if (json) {
+	    *p++ = '"';
+	    p = putstr(p, fieldnames[fields[i]], strlen(fieldnames[fields[i]]));
+	    p = putstr(p, "\":", 2);
+	}
+	quote = json;
+	switch (fields[i]) {
+	  case FIELD_CODE:
+	    if (quote)
+		*p++ = '"';
+	    *p++ = 'U';
+	    *p++ = '+';
+	    p = puthex(p, uchar, 4);
+	    break;
+	  case FIELD_GLYPH:
+	    p = putglyph(p, uchar, index);
+	    quote = FALSE;
+	    break;
+	  case FIELD_NAME:
+	    if (index < 0 && json) {
+		p = putstr(p, "null", 4);
+		quote = FALSE;
+		break;
+	    }
+	    if (quote)
+		*p++ = '"';
+	    if (index < 0)
+		p = putstr(p, "<unassigned>", 12);
+	    else
+		p = putstr(p, charnamebuffer + charlist[index].nameoffset,
+			   charlist[index].namesize);
+	    break;
+	  case FIELD_UTF8:
+	    if (quote)
+		*p++ = '"';
+	    size = encodeutf8(uchar, utf8);
+	    for (n = 0 ; n < size ; ++n) {
+		if (n)
+		    *p++ = ' ';
+		p = puthex(p, utf8[n], 2);
+	    }
+	    break;
+	  case FIELD_UTF16:
+	    if (quote)
+		*p++ = '"';
+	    size = encodeutf16(uchar, utf16);
+	    for (n = 0 ; n < size ; ++n) {
+		if (n)
+		    *p++ = ' ';
+		p = puthex(p, utf16[n], 4);
+	    }
+	    break;
+	  case FIELD_DECIMAL:
+	    p = putdecimal(p, uchar);
+	    quote = FALSE;
+	    break;
+	  case FIELD_WIDTH:
+	    if (index >= 0)
+		*p++ = '0' + charlist[index].width;
+	    else if (json)
+		p = putstr(p, "null", 4);
+	    else
+		*p++ = '-';
+	    quote = FALSE;
+	    break;
+	  case FIELD_BLOCK:
+	    if (block < 0 && json) {
+		p = putstr(p, "null", 4);
+		quote = FALSE;
+		break;
+	    }
+	    if (quote)
+		*p++ = '"';
+	    str = block < 0 ? "No_Block" : blocklist[block].name;
+	    p = putstr(p, str, strlen(str));
+	    break;
+	  case FIELD_COMBINING:
+	    if (index < 0)
+		p = json ? putstr(p, "null", 4) : putstr(p, "-", 1);
+	    else if (json)
+		p = charlist[index].combining ? putstr(p, "true", 4)
+					      : putstr(p, "false", 5);
+	    else
+		*p++ = charlist[index].combining ? '1' : '0';
+	    quote = FALSE;
+	    break;
+	}
+	if (quote)
+	    *p++ = '"';
+    }
+    if (json)
+	*p++ = '}';
+    *p++ = '\n';
+    outsize = p - outbuf;
+}
+
+/* Output the line that marks a line of batch input as invalid. In CSV
+ * the marker goes in the first column, and the other columns are left
+ * empty, so that every row has the same number of fields.
+ */
+static void dumpinvalid(void)
+{
+    int i;
+
+    if (dumpformat == DUMP_JSONL) {
+	outbytes("{\"invalid\":true}\n", 17);
+    } else if (dumpformat == DUMP_CSV) {
+	outbytes("<invalid>", 9);
+	for (i = 1 ; i < fieldcount ; ++i)
+	    outbytes(",", 1);
+	outbytes("\n", 1);
+    } else {
+	outbytes("<invalid>\n", 10);
+    }
+}
+
+/* Output the column headings, if the output format has them.
+ */
+static void dumpheader(void)
+{
+    int i;
+
+    if (dumpformat != DUMP_CSV)
+	return;
+    for (i = 0 ; i < fieldcount ; ++i) {
+	if (i)
+	    outbytes(",", 1);
+	outbytes(fieldnames[fields[i]], strlen(fieldnames[fields[i]]));
+    }
+    outbytes("\n", 1);
+}
+
+/* Select the default fields for --dump and --name, if none were
+ * given on the command line.
+ */
+static void dumpfieldsinit(void)
+{
+    if (!fieldcount) {
+	fields[0] = FIELD_CODE;
+	fields[1] = FIELD_GLYPH;
+	fields[2] = FIELD_NAME;
+	fieldcount = 3;
+    }
+}
+
+/* Output a codepoint followed by a newline, in the encoding selected
+ * with --convert.
+ */
+static void convertline(unsigned int uchar)
+{
+    unsigned char *p;
+
+    if (outsize + 2 * CONVERT_MAXCHAR > (int)sizeof outbuf)
+	outflush();
+    p = (unsigned char*)outbuf + outsize;
+    p += convertchar(uchar, convertencoding, p);
+    p += convertchar('\n', convertencoding, p);
+    outsize = p - (unsigned char*)outbuf;
+}
+
+/* Output a line for each character selected by the --dump
+ * specification. The output goes through a large buffer, so that
+ * dumping the entire character list is limited by the speed of the
+ * output rather than the formatting.
+ */
+static void rundump(void)
+{
+    char query[256];
+    unsigned int from, to;
+    int block, i;
+
+    from = 0;
+    to = lastucharval;
+    *query = '\0';
+    if (dumpspec && *dumpspec)
+	readdumpspec(dumpspec, &from, &to, query, sizeof query);
+    dumpfieldsinit();
+    if (convertencoding < 0)
+	dumpheader();
+
+    block = 0;
+    for (i = findcharafter(from) ; i < charlistsize ; ++i) {
+	if (charlist[i].uchar > to)
+	    break;
+	if (*query && !namecontains(i, query))
+	    continue;
+	if (convertencoding >= 0) {
+	    convertline(charlist[i].uchar);
+	    continue;
+	}
+	while (block < blocklistsize && blocklist[block].to < charlist[i].uchar)
+	    ++block;
+	if (block < blocklistsize && blocklist[block].from <= charlist[i].uchar)
+	    dumpline(charlist[i].uchar, i, block);
+	else
+	    dumpline(charlist[i].uchar, i, -1);
+    }
+    outflush();
+}
+
+/* Output a line for the character named with --name.
+ */
+static void runname(void)
+{
+    int index;
+
+    index = findcharbyexactname(exactname);
+    if (index < 0)
+	die("no character named \"%s\"", exactname);
+    dumpfieldsinit();
+    dumpheader();
+    dumpline(charlist[index].uchar, index, findblock(charlist[index].uchar));
+    outflush();
+}
+
+/* Decode a line of batch input, which is either a single character
+ * in UTF-8 or a hex value optionally preceded by "U+". The return
+ * value is the codepoint, or -1 if the line is not valid. Surrogates
+ * are not valid, as they cannot be encoded in UTF-8. This is
+ * written out by hand, rather than using sscanf() and strtoul(), as
+ * it is called once for every line of input.
+ */
+static long readbatchline(unsigned char const *line, int size)
+{
+    unsigned long value;
+    int n, c;
+
+    if (size && line[size - 1] == '\r')
+	--size;
+    if (size == 1 && line[0] < 0x80)
+	return line[0];
+    if (size >= 2 && line[0] >= 0xC2 && line[0] <= 0xF4) {
+	n = line[0] < 0xE0 ? 2 : line[0] < 0xF0 ? 3 : 4;
+	if (size == n) {
+	    value = line[0] & (0x7F >> n);
+	    for (c = 1 ; c < n ; ++c) {
+		if ((line[c] & 0xC0) != 0x80)
+		    return -1;
+		value = (value << 6) | (line[c] & 0x3F);
+	    }
+	    if ((n == 3 && value < 0x0800) || (n == 4 && value < 0x010000)
+			|| (value >= 0xD800 && value < 0xE000)
+			|| value > lastucharval)
+		return -1;
+	    return (long)value;
+	}
+    }
+    if (size >= 2 && (line[0] == 'U' || line[0] == 'u') && line[1] == '+') {
+	line += 2;
+	size -= 2;
+    }
+    if (size < 1 || size > 8)
+	return -1;
+    value = 0;
+    for (n = 0 ; n < size ; ++n) {
+	c = line[n];
+	if (c >= '0' && c <= '9')
+	    c -= '0';
+	else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+	    c = (c | 0x20) - 'a' + 10;
+	else
+	    return -1;
+	value = (value << 4) | c;
+    }
+    if ((value >= 0xD800 && value < 0xE000) || value > lastucharval)
+	return -1;
+    return (long)value;
+}
+
+/* Output a line for a single line of batch input.
+ */
+static void batchline(unsigned char const *line, int size, int wantblock)
+{
+    long uchar;
+
+    uchar = readbatchline(line, size);
+    if (uchar < 0)
+	dumpinvalid();
+    else
+	dumpline(uchar, charindex(uchar), wantblock ? findblock(uchar) : -1);
+}
+
+/* Read codepoints from standard input, one per line, and output the
+ * selected fields for each one. The input is read in large chunks
+ * and split into lines in place, and each codepoint is found with the
+ * direct lookup table instead of a binary search, so that the rate is
+ * limited by the speed of the pipes rather than the lookups.
+ */
+static void runbatch(void)
+{
+    static unsigned char inbuf[262144];
+    unsigned char const *line, *end;
+    int wantblock, skipping, size, n, i;
+
+    if (!fieldcount) {
+	fields[0] = FIELD_CODE;
+	fields[1] = FIELD_NAME;
+	fields[2] = FIELD_UTF8;
+	fields[3] = FIELD_UTF16;
+	fieldcount = 4;
+    }
+    wantblock = FALSE;
+    for (i = 0 ; i < fieldcount ; ++i)
+	if (fields[i] == FIELD_BLOCK)
+	    wantblock = TRUE;
+    if (!charindexinit())
+	die("out of memory");
+    dumpheader();
+
+    size = 0;
+    skipping = FALSE;
+    for (;;) {
+	n = read(STDIN_FILENO, inbuf + size, sizeof inbuf - size);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    die("read error: %s", strerror(errno));
+	}
+	if (n == 0)
+	    break;
+	size += n;
+	line = inbuf;
+	for (;;) {
+	    end = memchr(line, '\n', inbuf + size - line);
+	    if (!end)
+		break;
+	    if (skipping)
+		skipping = FALSE;
+	    else
+		batchline(line, end - line, wantblock);
+	    line = end + 1;
+	}
+	size = inbuf + size - line;
+	if (size == (int)sizeof inbuf) {
+	    if (!skipping)
+		dumpinvalid();
+	    skipping = TRUE;
+	    size = 0;
+	} else if (size) {
+	    memmove(inbuf, line, size);
+	}
+    }
+    if (size && !skipping)
+	batchline(inbuf, size, wantblock);
+    outflush();
+}
+
+/* Store a reply to the lookup server that reports an error, and
+ * return its length.
+ */
+static int serverfailure(char *reply, char const *message)
+{
+    return putstr(putstr(reply, "ERR\t", 4), message, strlen(message))
+		- reply;
+}
+
+/* Answer a request made to the lookup server. The requests are:
+ *
+ *   name-of CHAR   the codepoint and its name
+ *   block-of CHAR  the range and the name of the codepoint's block
+ *   encode CHAR    the codepoint in UTF-8 bytes and UTF-16 units
+ *   find NAME      the character with NAME as its name or alias, or
+ *                  failing that the characters whose names contain
+ *                  NAME as a substring
+ *
+ * where CHAR is either a literal character or a hex value, as with
+ * --batch. A successful reply is "OK" followed by tab-separated
+ * fields; a failure is "ERR" followed by a tab and a message. Only
+ * tables that are never modified are consulted here, as the requests
+ * are answered on several threads at once.
+ */
+static int serverrequest(char const *request, char *reply)
+{
+    static char const *const commands[] = {
+	"name-of", "block-of", "encode", "find"
+    };
+    unsigned char utf8[4];
+    unsigned int utf16[2];
+    char query[256];
+    char const *arg;
+    char *p;
+    long uchar;
+    int cmd, index, count, size, n;
+
+    arg = strchr(request, ' ');
+    size = arg ? (int)(arg - request) : (int)strlen(request);
+    for (cmd = 0 ; cmd < (int)(sizeof commands / sizeof *commands) ; ++cmd)
+	if ((int)strlen(commands[cmd]) == size
+			&& !memcmp(commands[cmd], request, size))
+	    break;
+    if (cmd == (int)(sizeof commands / sizeof *commands))
+	return serverfailure(reply, "unknown request");
+    if (!arg || !arg[1])
+	return serverfailure(reply, "missing argument");
+    ++arg;
+
+    p = putstr(reply, "OK", 2);
+    if (cmd == 3) {
+	index = findcharbyexactname(arg);
+	if (index >= 0) {
+	    p = putstr(p, "\tU+", 3);
+	    p = puthex(p, charlist[index].uchar, 4);
+	    return p - reply;
+	}
+	if (strlen(arg) >= sizeof query)
+	    return serverfailure(reply, "name too long");
+	for (n = 0 ; arg[n] ; ++n)
+	    query[n] = tolower((unsigned char)arg[n]);
+	query[n] = '\0';
+	count = 0;
+	for (index = 0 ; index < charlistsize ; ++index) {
+	    if (!namecontains(index, query))
+		continue;
+	    if (count++ == findlimit) {
+		p = putstr(p, "\t...", 4);
+		break;
+	    }
+	    p = putstr(p, "\tU+", 3);
+	    p = puthex(p, charlist[index].uchar, 4);
+	}
+	if (!count)
+	    return serverfailure(reply, "no match");
+	return p - reply;
+    }
+
+    uchar = readbatchline((unsigned char const*)arg, strlen(arg));
+    if (uchar < 0)
+	return serverfailure(reply, "invalid character");
+    *p++ = '\t';
+    switch (cmd) {
+      case 0:
+	p = putstr(p, "U+", 2);
+	p = puthex(p, uchar, 4);
+	*p++ = '\t';
+	index = charindex(uchar);
+	if (index < 0)
+	    p = putstr(p, "<unassigned>", 12);
+	else
+	    p = putstr(p, charnamebuffer + charlist[index].nameoffset,
+		       charlist[index].namesize);
+	break;
+      case 1:
+	index = findblock(uchar);
+	if (index < 0) {
+	    p = putstr(p, "-\tNo_Block", 10);
+	    break;
+	}
+	p = putstr(p, "U+", 2);
+	p = puthex(p, blocklist[index].from, 4);
+	p = putstr(p, "-U+", 3);
+	p = puthex(p, blocklist[index].to, 4);
+	*p++ = '\t';
+	p = putstr(p, blocklist[index].name, strlen(blocklist[index].name));
+	break;
+      case 2:
+	size = encodeutf8(uchar, utf8);
+	for (n = 0 ; n < size ; ++n) {
+	    if (n)
+		*p++ = ' ';
+	    p = puthex(p, utf8[n], 2);
+	}
+	*p++ = '\t';
+	size = encodeutf16(uchar, utf16);
+	for (n = 0 ; n < size ; ++n) {
+	    if (n)
+		*p++ = ' ';
+	    p = puthex(p, utf16[n], 4);
+	}
+	break;
+    }
+    return p - reply;
+}
+
+/* Run the lookup server on the socket given with --serve. The lookup
+ * tables are built once, before any requests are accepted, and are
+ * shared by all of the worker threads, one for each processor.
+ */
+static void runserver(void)
+{
+    long threadcount;
+
+    if (!charindexinit())
+	die("out of memory");
+    threadcount = sysconf(_SC_NPROCESSORS_ONLN);
+    if (threadcount < 1)
+	threadcount = 1;
+    if (!serverrun(servepath, threadcount, serverrequest))
+	die("%s: %s", servepath, strerror(errno));
+}
+
+/* Convert UTF-8 text from standard input to the encoding selected
+ * with --convert. Each chunk of input is converted straight into the
+ * output buffer, which is sized so that the largest possible output
+ * from a chunk always fits. A sequence cut off at the end of a chunk
+ * is carried over to the start of the next one.
+ */
+static void runconvert(void)
+{
+    static unsigned char inbuf[sizeof outbuf / CONVERT_MAXGROWTH];
+    long size, used;
+    int n;
+
+    size = 0;
+    for (;;) {
+	n = read(STDIN_FILENO, inbuf + size, sizeof inbuf - size);
+	if (n < 0) {
+	    if (errno == EINTR)
+		continue;
+	    die("read error: %s", strerror(errno));
+	}
+	size += n;
+	outsize = convertutf8(inbuf, size, n == 0, convertencoding,
+			      (unsigned char*)outbuf, &used);
+	outflush();
+	if (n == 0)
+	    break;
+	size -= used;
+	memmove(inbuf, inbuf + used, size);
+    }
+}
+
+/* Output the widths of a run of codepoints that all have the same
+ * conflicting widths.
+ */
+static void printmismatchrun(int from, int to)
+{
+    char range[16];
+    int width;
+
+    if (from == to)
+	sprintf(range, "%04X", charlist[from].uchar);
+    else
+	sprintf(range, "%04X..%04X", charlist[from].uchar, charlist[to].uchar);
+    printf("  %-16sunicode %d", range, charlist[from].width);
+    width = wcwidth(charlist[from].uchar);
+    if (width < 0)
+	printf("  libc -");
+    else
+	printf("  libc %d", width);
+    width = cachedwidth(charlist[from].uchar);
+    if (width < 0)
+	printf("  terminal -");
+    else
+	printf("  terminal %d", width);
+    printf("  %.*s", (int)charlist[from].namesize,
+	   charnamebuffer + charlist[from].nameoffset);
+    if (from != to)
+	printf(" .. %.*s", (int)charlist[to].namesize,
+	       charnamebuffer + charlist[to].nameoffset);
+    putchar('\n');
+}
+
+/* Return true if two characters have the same widths from each of
+ * the sources, and are adjacent codepoints.
+ */
+static int samemismatch(int a, int b)
+{
+    return charlist[b].uchar == charlist[a].uchar + (b - a)
+	&& charlist[b].width == charlist[a].width
+	&& wcwidth(charlist[b].uchar) == wcwidth(charlist[a].uchar)
+	&& cachedwidth(charlist[b].uchar) == cachedwidth(charlist[a].uchar);
+}
+
+/* List every character whose widths, as given by wcwidth(3), by the
+ * Unicode data, and by the terminal's measurements (if the width
+ * cache is available), do not all agree. Consecutive codepoints with
+ * the same set of widths are grouped into runs, and the runs are
+ * grouped by block. As with the coverage report, the blocks and the
+ * characters are walked through together in a single pass.
+ */
+static void runmismatches(void)
+{
+    int chars, runs, blocks, inblock;
+    int from, b, i;
+
+    printf("Unicode %s, terminal widths: %s\n", unicodeversion,
+	   havewidthcache ? "measured" : "not available");
+    chars = runs = blocks = 0;
+    i = 0;
+    for (b = 0 ; b < blocklistsize ; ++b) {
+	while (i < charlistsize && charlist[i].uchar < blocklist[b].from)
+	    ++i;
+	inblock = FALSE;
+	from = -1;
+	for ( ; i < charlistsize && charlist[i].uchar <= blocklist[b].to ; ++i) {
+	    if (from >= 0) {
+		if (samemismatch(from, i)) {
+		    ++chars;
+		    continue;
+		}
+		printmismatchrun(from, i - 1);
+		from = -1;
+	    }
+	    if (!widthmismatch(i))
+		continue;
+	    if (!inblock) {
+		printf("\n%s (%04X..%04X)\n", blocklist[b].name,
+		       blocklist[b].from, blocklist[b].to);
+		inblock = TRUE;
+		++blocks;
+	    }
+	    from = i;
+	    ++runs;
+	    ++chars;
+	}
+	if (from >= 0)
+	    printmismatchrun(from, i - 1);
+    }
+    printf("\n%d codepoints in %d runs in %d blocks have conflicting"
+	   " widths.\n", chars, runs, blocks);
+}
+
+/* Write the state at the start of the session to the record file:
+ * the terminal size and the initial codepoint.
+ */
+static void startrecording(int index)
+{
+    fprintf(recordfile, "ubrowse-session %d %d %04X\n",
+	    LINES, COLS, charlist[index].uchar);
+}
+
+/* Read the state at the start of a recorded session, resize the
+ * display to match, and return the initial position.
+ */
+static int startreplay(void)
+{
+    char line[64];
+    unsigned int uchar;
+    int rows, cols;
+
+    if (!fgets(line, sizeof line, replayfile)
+		|| sscanf(line, "ubrowse-session %d %d %X",
+			  &rows, &cols, &uchar) != 3)
+	die("not a recorded session");
+    resizeterm(rows, cols);
+    measurescreen();
+    replaystart = now();
+    return lookupchar(uchar);
+}
+
+/* Build the search indexes and the filter bitmaps. This runs on its
+ * own thread, so that the user does not have to wait for it.
+ */
+static void *buildindexes(void *arg)
+{
+    int mode;
+
+    (void)arg;
+    charindexinit();
+    nameindexinit();
+    for (mode = FILTER_NONE + 1 ; mode < FILTER_COUNT ; ++mode)
+	filterinit(mode);
+    pthread_mutex_lock(&indexlock);
+    indexreadytime = now() - starttime;
+    pthread_mutex_unlock(&indexlock);
+    return NULL;
+}
+
+/* Start building the search indexes in the background. Until they
+ * are ready, the functions that use them fall back to scanning, or
+ * build what they need themselves, so nothing is lost if the thread
+ * cannot be started.
+ */
+static void startindexing(void)
+{
+    pthread_t thread;
+
+    if (!pthread_create(&thread, NULL, buildindexes, NULL))
+	pthread_detach(thread);
+}
+
 /* Run the program.
  */
 int main(int argc, char *argv[])
 {
+    int cellwidth = 10, cellheight = 20;
     int startpos;
 
+    starttime = now();
     setlocale(LC_ALL, "");
     startpos = readcmdline(argc, argv);
-    ioinit();
-    mainui(startpos);
+    if (probemode) {
+	runprobe();
+	return 0;
+    }
+    if (convertencoding >= 0 && !dumpmode) {
+	runconvert();
+	return 0;
+    }
+    if (dumpmode) {
+	rundump();
+	return 0;
+    }
+    if (batchmode) {
+	runbatch();
+	return 0;
+    }
+    if (exactname) {
+	runname();
+	return 0;
+    }
+    if (servepath) {
+	runserver();
+	return 0;
+    }
+    if (clientpath) {
+	if (!serverclient(clientpath))
+	    die("%s: %s", clientpath, strerror(errno));
+	return 0;
+    }
+    if (inspectmode)
+	loadinspect();
+    if (censusname) {
+	loadcensus();
+	if (reportformat != REPORT_NONE) {
+	    runcensusreport();
+	    return 0;
+	}
+	if (!censusresult.chars)
+	    die("%s: no characters found", censusname);
+	if (!filterinit(FILTER_CENSUS))
+	    die("out of memory");
+	filtermode = FILTER_CENSUS;
+    }
+    if (replayfile) {
+	showtiming = TRUE;
+	syncupdates = FALSE;
+	glyphmode = GLYPHS_NONE;
+    } else if (probeopen()) {
+	havewidthcache = widthcacheopen(FALSE);
+	if (glyphmode)
+	    probecellsize(&cellwidth, &cellheight);
+	probeclose();
+    }
+    if (scanfonts)
+	fontscan();
+    if (glyphmode)
+	glyphsinit(glyphmode, cellwidth, cellheight);
+    if (reportformat != REPORT_NONE) {
+	runreport();
+	return 0;
+    }
+    if (mismatchmode) {
+	runmismatches();
+	return 0;
+    }
+    atexit(showtimingsummary);
+    if (showstats)
+	atexit(showstartupstats);
+    keytime = now();
+    if (!ioinit())
+	die("unable to initialize the display");
+    startindexing();
+    if (replayfile)
+	startpos = startreplay();
+    if (recordfile)
+	startrecording(startpos);
+    if (inspectmode)
+	inspectui();
+    else
+	mainui(startpos);
     return 0;
 }
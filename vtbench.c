@@ -0,0 +1,845 @@
+/*
+ * vtbench.c: Measuring the rendering cost of the character table.
+ *
+ * Copyright (C) 2013-2017 Brian Raiter <breadbox@muppetlabs.com>
+ *
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without
+ * restriction, including without limitation the rights to use, copy,
+ * modify, merge, publish, distribute, sublicense, and/or sell copies
+ * of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+ * BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ * ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <wchar.h>
+#include <locale.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+
+/* This program runs ubrowse on a pseudo-terminal, sends it scripted
+ * sequences of keystrokes, and feeds its output to a minimal terminal
+ * emulator. ubrowse is run with --sync, so that the end of each frame
+ * is marked in the output stream, allowing the keystrokes to be sent
+ * one frame at a time. For every frame the number of bytes output,
+ * the CPU time used by ubrowse, and the time taken by the emulator to
+ * process the output are recorded. The results are summarized for
+ * each scenario and written to a file, which can also be compared
+ * against a previous run to catch increases in the output volume.
+ */
+
+/* How long to wait for a frame, in milliseconds, before giving up.
+ */
+static int const frametimeout = 5000;
+
+/* A scripted test run. The setup keys are sent first, and the frames
+ * they produce are not measured. Then the keys are sent in turn,
+ * cycling through the list repeat times in total.
+ */
+typedef struct scenario {
+    char const *name;		/* the scenario's name */
+    char const *args[4];	/* arguments to ubrowse */
+    char const *setup[4];	/* keys sent before measuring */
+    char const *keys[4];	/* keys sent, one frame each */
+    int repeat;			/* the number of frames to measure */
+} scenario;
+
+/* The scenarios.
+ */
+static scenario const scenarios[] = {
+    { "page-forward", { NULL }, { NULL }, { " ", NULL }, 150 },
+    { "page-back", { "U+20000", NULL }, { NULL }, { "\177", NULL }, 150 },
+    { "row-down", { NULL }, { NULL }, { "\033OB", NULL }, 200 },
+    { "column-right", { NULL }, { NULL }, { "\033OC", NULL }, 200 },
+    { "four-columns", { NULL }, { "[", "[", NULL }, { " ", NULL }, 150 },
+    { "wide-glyphs", { "U+4E00", NULL }, { NULL }, { " ", NULL }, 150 },
+    { "combining", { "U+0300", NULL }, { NULL }, { " ", "\177", NULL }, 100 },
+    { "grid", { NULL }, { "g", NULL }, { " ", NULL }, 150 },
+    { "lowbandwidth", { "--baud=9600", NULL }, { NULL }, { " ", NULL }, 100 }
+};
+
+/* The measurements taken for a single frame.
+ */
+typedef struct frame {
+    long bytes;			/* bytes output */
+    double cpu;			/* CPU time used by ubrowse, in seconds */
+    double parse;		/* time spent in the emulator, in seconds */
+} frame;
+
+/* The summary of a scenario, as written to the results file.
+ */
+typedef struct summary {
+    char name[32];
+    int frames;
+    long bytes, bytesp50, bytesp95, bytesmax;
+    double cpumean, cpup95, parsemean;
+    unsigned long screenhash;
+} summary;
+
+/*
+ * The terminal emulator.
+ */
+
+/* The state of the emulated terminal. Only the character content of
+ * the screen is tracked; attributes are ignored.
+ */
+static struct {
+    unsigned int *cells;	/* the screen contents */
+    int rows, cols;		/* the screen size */
+    int y, x;			/* the cursor position */
+    int savedy, savedx;		/* the saved cursor position */
+    int top, bottom;		/* the scrolling region */
+    int wrapnext;		/* true if the next character wraps */
+    unsigned int lastchar;	/* the most recently displayed character */
+    int state;			/* the parser state */
+    int params[16];		/* the parameters of a control sequence */
+    int paramcount;		/* the number of parameters */
+    int private;		/* the private-mode marker, if any */
+    unsigned int uchar;		/* the UTF-8 sequence being decoded */
+    int pending;		/* the number of UTF-8 bytes still to come */
+    int frameended;		/* true when the end of a frame was seen */
+} vt;
+
+/* The parser states.
+ */
+enum { ST_GROUND, ST_ESCAPE, ST_CHARSET, ST_CSI, ST_STRING, ST_STRINGESC };
+
+/* Initialize the emulator with a blank screen.
+ */
+static void vtinit(int rows, int cols)
+{
+    free(vt.cells);
+    memset(&vt, 0, sizeof vt);
+    vt.rows = rows;
+    vt.cols = cols;
+    vt.bottom = rows - 1;
+    vt.cells = malloc(rows * cols * sizeof *vt.cells);
+    if (!vt.cells) {
+	fputs("vtbench: out of memory\n", stderr);
+	exit(EXIT_FAILURE);
+    }
+    for (rows = 0 ; rows < vt.rows * vt.cols ; ++rows)
+	vt.cells[rows] = ' ';
+}
+
+/* Blank the cells from (y, x0) up to but not including (y, x1).
+ */
+static void vterase(int y, int x0, int x1)
+{
+    if (x1 > vt.cols)
+	x1 = vt.cols;
+    for ( ; x0 < x1 ; ++x0)
+	vt.cells[y * vt.cols + x0] = ' ';
+}
+
+/* Move the lines of the scrolling region from y down (n > 0) or up
+ * (n < 0) by n lines, blanking the lines left behind.
+ */
+static void vtscroll(int y, int n)
+{
+    int width = vt.cols * sizeof *vt.cells;
+    int i;
+
+    if (y < vt.top || y > vt.bottom)
+	return;
+    if (n > 0) {
+	for (i = vt.bottom ; i >= y ; --i) {
+	    if (i - n >= y)
+		memcpy(vt.cells + i * vt.cols, vt.cells + (i - n) * vt.cols,
+		       width);
+	    else
+		vterase(i, 0, vt.cols);
+	}
+    } else {
+	for (i = y ; i <= vt.bottom ; ++i) {
+	    if (i - n <= vt.bottom)
+		memcpy(vt.cells + i * vt.cols, vt.cells + (i - n) * vt.cols,
+		       width);
+	    else
+		vterase(i, 0, vt.cols);
+	}
+    }
+}
+
+/* Move the cursor down a line, scrolling if it is at the bottom of
+ * the scrolling region.
+ */
+static void vtlinefeed(void)
+{
+    if (vt.y == vt.bottom)
+	vtscroll(vt.top, -1);
+    else if (vt.y < vt.rows - 1)
+	++vt.y;
+}
+
+/* Display a character at the cursor position.
+ */
+static void vtputchar(unsigned int uchar)
+{
+    int width;
+
+    width = wcwidth(uchar);
+    if (width == 0)
+	return;
+    if (width < 0)
+	width = 1;
+    if (vt.wrapnext) {
+	vt.x = 0;
+	vtlinefeed();
+	vt.wrapnext = 0;
+    }
+    if (vt.x + width > vt.cols) {
+	vt.x = 0;
+	vtlinefeed();
+    }
+    vt.cells[vt.y * vt.cols + vt.x] = uchar;
+    if (width == 2)
+	vt.cells[vt.y * vt.cols + vt.x + 1] = 0;
+    vt.x += width;
+    if (vt.x >= vt.cols) {
+	vt.x = vt.cols - 1;
+	vt.wrapnext = 1;
+    }
+    vt.lastchar = uchar;
+}
+
+/* Return the nth parameter of the control sequence, or def if it was
+ * omitted or zero.
+ */
+static int vtparam(int n, int def)
+{
+    return n < vt.paramcount && vt.params[n] ? vt.params[n] : def;
+}
+
+/* Carry out a control sequence.
+ */
+static void vtcsi(int final)
+{
+    int n, i;
+
+    if (vt.private) {
+	if (vt.private == '?' && final == 'l' && vt.params[0] == 2026)
+	    vt.frameended = 1;
+	return;
+    }
+    n = vtparam(0, 1);
+    vt.wrapnext = 0;
+    switch (final) {
+      case 'A':	vt.y = vt.y - n < 0 ? 0 : vt.y - n;			break;
+      case 'B':	vt.y = vt.y + n >= vt.rows ? vt.rows - 1 : vt.y + n;	break;
+      case 'C':	vt.x = vt.x + n >= vt.cols ? vt.cols - 1 : vt.x + n;	break;
+      case 'D':	vt.x = vt.x - n < 0 ? 0 : vt.x - n;			break;
+      case 'G':	vt.x = n > vt.cols ? vt.cols - 1 : n - 1;		break;
+      case 'd':	vt.y = n > vt.rows ? vt.rows - 1 : n - 1;		break;
+      case 'H':
+      case 'f':
+	vt.y = vtparam(0, 1) - 1;
+	vt.x = vtparam(1, 1) - 1;
+	if (vt.y >= vt.rows)
+	    vt.y = vt.rows - 1;
+	if (vt.x >= vt.cols)
+	    vt.x = vt.cols - 1;
+	break;
+      case 'J':
+	n = vtparam(0, 0);
+	if (n == 0) {
+	    vterase(vt.y, vt.x, vt.cols);
+	    for (i = vt.y + 1 ; i < vt.rows ; ++i)
+		vterase(i, 0, vt.cols);
+	} else if (n == 1) {
+	    for (i = 0 ; i < vt.y ; ++i)
+		vterase(i, 0, vt.cols);
+	    vterase(vt.y, 0, vt.x + 1);
+	} else {
+	    for (i = 0 ; i < vt.rows ; ++i)
+		vterase(i, 0, vt.cols);
+	}
+	break;
+      case 'K':
+	n = vtparam(0, 0);
+	if (n == 0)
+	    vterase(vt.y, vt.x, vt.cols);
+	else if (n == 1)
+	    vterase(vt.y, 0, vt.x + 1);
+	else
+	    vterase(vt.y, 0, vt.cols);
+	break;
+      case 'X':
+	vterase(vt.y, vt.x, vt.x + n);
+	break;
+      case '@':
+	for (i = vt.cols - 1 ; i >= vt.x + n ; --i)
+	    vt.cells[vt.y * vt.cols + i] = vt.cells[vt.y * vt.cols + i - n];
+	vterase(vt.y, vt.x, vt.x + n);
+	break;
+      case 'P':
+	for (i = vt.x ; i + n < vt.cols ; ++i)
+	    vt.cells[vt.y * vt.cols + i] = vt.cells[vt.y * vt.cols + i + n];
+	vterase(vt.y, vt.cols - n > vt.x ? vt.cols - n : vt.x, vt.cols);
+	break;
+      case 'L':	vtscroll(vt.y, n);					break;
+      case 'M':	vtscroll(vt.y, -n);					break;
+      case 'S':	vtscroll(vt.top, -n);					break;
+      case 'T':	vtscroll(vt.top, n);					break;
+      case 'b':
+	while (n--)
+	    vtputchar(vt.lastchar);
+	break;
+      case 'r':
+	vt.top = vtparam(0, 1) - 1;
+	vt.bottom = vtparam(1, vt.rows) - 1;
+	if (vt.bottom >= vt.rows || vt.top >= vt.bottom) {
+	    vt.top = 0;
+	    vt.bottom = vt.rows - 1;
+	}
+	vt.y = vt.x = 0;
+	break;
+    }
+}
+
+/* Process one byte of output.
+ */
+static void vtfeed(int ch)
+{
+    switch (vt.state) {
+      case ST_ESCAPE:
+	vt.state = ST_GROUND;
+	switch (ch) {
+	  case '[':
+	    vt.state = ST_CSI;
+	    vt.paramcount = 0;
+	    vt.params[0] = 0;
+	    vt.private = 0;
+	    break;
+	  case ']':
+	  case 'P':
+	  case '_':
+	  case '^':
+	    vt.state = ST_STRING;
+	    break;
+	  case '(':
+	  case ')':
+	  case '*':
+	  case '+':
+	    vt.state = ST_CHARSET;
+	    break;
+	  case '7':
+	    vt.savedy = vt.y;
+	    vt.savedx = vt.x;
+	    break;
+	  case '8':
+	    vt.y = vt.savedy;
+	    vt.x = vt.savedx;
+	    break;
+	  case 'D':
+	    vtlinefeed();
+	    break;
+	  case 'E':
+	    vt.x = 0;
+	    vtlinefeed();
+	    break;
+	  case 'M':
+	    if (vt.y == vt.top)
+		vtscroll(vt.top, 1);
+	    else if (vt.y > 0)
+		--vt.y;
+	    break;
+	}
+	return;
+      case ST_CHARSET:
+	vt.state = ST_GROUND;
+	return;
+      case ST_CSI:
+	if (ch >= '0' && ch <= '9') {
+	    if (!vt.paramcount)
+		vt.paramcount = 1;
+	    vt.params[vt.paramcount - 1] = vt.params[vt.paramcount - 1] * 10
+					   + ch - '0';
+	} else if (ch == ';') {
+	    if (!vt.paramcount)
+		vt.paramcount = 1;
+	    if (vt.paramcount < (int)(sizeof vt.params / sizeof *vt.params))
+		vt.params[vt.paramcount++] = 0;
+	} else if (ch >= '<' && ch <= '?') {
+	    vt.private = ch;
+	} else if (ch >= 0x40 && ch <= 0x7E) {
+	    vtcsi(ch);
+	    vt.state = ST_GROUND;
+	}
+	return;
+      case ST_STRING:
+	if (ch == '\007')
+	    vt.state = ST_GROUND;
+	else if (ch == '\033')
+	    vt.state = ST_STRINGESC;
+	return;
+      case ST_STRINGESC:
+	vt.state = ch == '\\' ? ST_GROUND : ST_STRING;
+	return;
+    }
+
+    if (vt.pending) {
+	if ((ch & 0xC0) == 0x80) {
+	    vt.uchar = (vt.uchar << 6) | (ch & 0x3F);
+	    if (!--vt.pending)
+		vtputchar(vt.uchar);
+	    return;
+	}
+	vt.pending = 0;
+    }
+    if (ch >= 0xF0) {
+	vt.uchar = ch & 0x07;
+	vt.pending = 3;
+    } else if (ch >= 0xE0) {
+	vt.uchar = ch & 0x0F;
+	vt.pending = 2;
+    } else if (ch >= 0xC0) {
+	vt.uchar = ch & 0x1F;
+	vt.pending = 1;
+    } else if (ch >= 0x20 && ch < 0x7F) {
+	vtputchar(ch);
+    } else {
+	switch (ch) {
+	  case '\033':	vt.state = ST_ESCAPE;				break;
+	  case '\r':	vt.x = 0;	vt.wrapnext = 0;		break;
+	  case '\n':	vtlinefeed();					break;
+	  case '\b':	if (vt.x > 0) --vt.x;	vt.wrapnext = 0;	break;
+	  case '\t':
+	    vt.x = (vt.x / 8 + 1) * 8;
+	    if (vt.x >= vt.cols)
+		vt.x = vt.cols - 1;
+	    break;
+	}
+    }
+}
+
+/* Return a hash of the current screen contents.
+ */
+static unsigned long vthash(void)
+{
+    unsigned long hash = 2166136261UL;
+    int i;
+
+    for (i = 0 ; i < vt.rows * vt.cols ; ++i)
+	hash = ((hash ^ vt.cells[i]) * 16777619UL) & 0xFFFFFFFFUL;
+    return hash;
+}
+
+/*
+ * Running ubrowse.
+ */
+
+/* Return the current time in seconds.
+ */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Return the CPU time used so far by a process, in seconds. The
+ * scheduler statistics are used if available, as they are measured
+ * in nanoseconds rather than clock ticks.
+ */
+static double cputime(pid_t pid)
+{
+    char path[64];
+    unsigned long utime, stime;
+    double ns;
+    FILE *fp;
+    int n;
+
+    sprintf(path, "/proc/%ld/schedstat", (long)pid);
+    fp = fopen(path, "r");
+    if (fp) {
+	n = fscanf(fp, "%lf", &ns);
+	fclose(fp);
+	if (n == 1)
+	    return ns / 1e9;
+    }
+    sprintf(path, "/proc/%ld/stat", (long)pid);
+    fp = fopen(path, "r");
+    if (!fp)
+	return 0.0;
+    n = fscanf(fp, "%*d (%*[^)]) %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u"
+		   " %lu %lu", &utime, &stime);
+    fclose(fp);
+    return n == 2 ? (utime + stime) / (double)sysconf(_SC_CLK_TCK) : 0.0;
+}
+
+/* Start ubrowse on a new pseudo-terminal of the given size. The
+ * return value is the file descriptor of the master side.
+ */
+static int spawn(char const *program, char const *const *args,
+		 int rows, int cols, pid_t *pid)
+{
+    char const *argv[8];
+    struct winsize ws;
+    char const *name;
+    int master, slave, n;
+
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) || unlockpt(master))
+	return -1;
+    name = ptsname(master);
+    if (!name)
+	return -1;
+    memset(&ws, 0, sizeof ws);
+    ws.ws_row = rows;
+    ws.ws_col = cols;
+    ioctl(master, TIOCSWINSZ, &ws);
+
+    argv[0] = program;
+    argv[1] = "--sync";
+    for (n = 0 ; args[n] && n < 4 ; ++n)
+	argv[n + 2] = args[n];
+    argv[n + 2] = NULL;
+
+    *pid = fork();
+    if (*pid < 0)
+	return -1;
+    if (*pid == 0) {
+	setsid();
+	slave = open(name, O_RDWR);
+	if (slave < 0)
+	    _exit(127);
+	dup2(slave, 0);
+	dup2(slave, 1);
+	dup2(slave, 2);
+	close(slave);
+	close(master);
+	setenv("TERM", "xterm", 1);
+	setenv("XDG_CACHE_HOME", "/nonexistent", 1);
+	execv(program, (char *const*)argv);
+	_exit(127);
+    }
+    return master;
+}
+
+/* Read the output of ubrowse and feed it to the emulator, until the
+ * end of a frame (the end of a synchronized update) is seen. The number of bytes read and the time spent
+ * in the emulator are added to the frame's measurements. The return
+ * value is false if the frame did not arrive.
+ */
+static int readframe(int fd, frame *f)
+{
+    unsigned char buf[65536];
+    struct pollfd pfd;
+    double start;
+    int size, i;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    vt.frameended = 0;
+    while (!vt.frameended) {
+	if (poll(&pfd, 1, frametimeout) <= 0)
+	    return 0;
+	size = read(fd, buf, sizeof buf);
+	if (size <= 0)
+	    return 0;
+	f->bytes += size;
+	start = now();
+	for (i = 0 ; i < size ; ++i)
+	    vtfeed(buf[i]);
+	f->parse += now() - start;
+    }
+    return 1;
+}
+
+/* Send a key to ubrowse and measure the frame it produces.
+ */
+static int sendkey(int fd, pid_t pid, char const *key, frame *f)
+{
+    double cpu;
+
+    memset(f, 0, sizeof *f);
+    cpu = cputime(pid);
+    if (write(fd, key, strlen(key)) != (int)strlen(key))
+	return 0;
+    if (!readframe(fd, f))
+	return 0;
+    f->cpu = cputime(pid) - cpu;
+    return 1;
+}
+
+/* Tell ubrowse to exit, and wait for it to do so.
+ */
+static void finish(int fd, pid_t pid)
+{
+    char buf[4096];
+    struct pollfd pfd;
+    int i;
+
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    for (i = 0 ; i < 3 ; ++i) {
+	if (waitpid(pid, NULL, WNOHANG) == pid)
+	    break;
+	if (write(fd, "q", 1) != 1)
+	    break;
+	while (poll(&pfd, 1, 500) > 0 && read(fd, buf, sizeof buf) > 0) ;
+    }
+    if (i == 3) {
+	kill(pid, SIGKILL);
+	waitpid(pid, NULL, 0);
+    }
+    close(fd);
+}
+
+/*
+ * Summarizing the results.
+ */
+
+/* Compare two longs, for sorting.
+ */
+static int comparelongs(void const *a, void const *b)
+{
+    long x = *(long const*)a, y = *(long const*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Compare two doubles, for sorting.
+ */
+static int comparedoubles(void const *a, void const *b)
+{
+    double x = *(double const*)a, y = *(double const*)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* Run one scenario, and summarize the measurements of its frames.
+ */
+static int runscenario(char const *program, scenario const *sc,
+		       int rows, int cols, summary *sum)
+{
+    frame *frames;
+    long *bytes;
+    double *cpu;
+    frame f;
+    pid_t pid;
+    int fd, i, n;
+
+    memset(sum, 0, sizeof *sum);
+    sprintf(sum->name, "%.31s", sc->name);
+    frames = malloc(sc->repeat * sizeof *frames);
+    bytes = malloc(sc->repeat * sizeof *bytes);
+    cpu = malloc(sc->repeat * sizeof *cpu);
+    if (!frames || !bytes || !cpu)
+	return 0;
+    vtinit(rows, cols);
+    fd = spawn(program, sc->args, rows, cols, &pid);
+    if (fd < 0)
+	return 0;
+    memset(&f, 0, sizeof f);
+    if (!readframe(fd, &f))
+	goto failed;
+    for (i = 0 ; sc->setup[i] ; ++i)
+	if (!sendkey(fd, pid, sc->setup[i], &f))
+	    goto failed;
+    for (n = 0 ; sc->keys[n] ; ++n) ;
+    for (i = 0 ; i < sc->repeat ; ++i)
+	if (!sendkey(fd, pid, sc->keys[i % n], &frames[i]))
+	    goto failed;
+    sum->screenhash = vthash();
+    finish(fd, pid);
+
+    sum->frames = sc->repeat;
+    for (i = 0 ; i < sc->repeat ; ++i) {
+	bytes[i] = frames[i].bytes;
+	cpu[i] = frames[i].cpu;
+	sum->bytes += frames[i].bytes;
+	sum->cpumean += frames[i].cpu;
+	sum->parsemean += frames[i].parse;
+    }
+    qsort(bytes, sc->repeat, sizeof *bytes, comparelongs);
+    qsort(cpu, sc->repeat, sizeof *cpu, comparedoubles);
+    sum->bytesp50 = bytes[sc->repeat / 2];
+    sum->bytesp95 = bytes[sc->repeat * 95 / 100];
+    sum->bytesmax = bytes[sc->repeat - 1];
+    sum->cpumean = sum->cpumean * 1e6 / sc->repeat;
+    sum->cpup95 = cpu[sc->repeat * 95 / 100] * 1e6;
+    sum->parsemean = sum->parsemean * 1e6 / sc->repeat;
+    free(frames);
+    free(bytes);
+    free(cpu);
+    return 1;
+
+  failed:
+    finish(fd, pid);
+    free(frames);
+    free(bytes);
+    free(cpu);
+    return 0;
+}
+
+/* The heading line of the results file.
+ */
+static char const resultsheading[] =
+    "scenario\tframes\tbytes\tbytes_p50\tbytes_p95\tbytes_max"
+    "\tcpu_us_mean\tcpu_us_p95\tparse_us_mean\tscreen_hash\n";
+
+/* Write a summary as a line of the results file.
+ */
+static void writesummary(FILE *fp, summary const *sum)
+{
+    fprintf(fp, "%s\t%d\t%ld\t%ld\t%ld\t%ld\t%.1f\t%.1f\t%.1f\t%08lx\n",
+	    sum->name, sum->frames, sum->bytes, sum->bytesp50, sum->bytesp95,
+	    sum->bytesmax, sum->cpumean, sum->cpup95, sum->parsemean,
+	    sum->screenhash);
+}
+
+/* Read the summaries from a results file. The return value is the
+ * number of summaries read.
+ */
+static int readsummaries(char const *filename, summary *sums, int count)
+{
+    char line[512];
+    FILE *fp;
+    int n;
+
+    fp = fopen(filename, "r");
+    if (!fp)
+	return -1;
+    n = 0;
+    while (n < count && fgets(line, sizeof line, fp)) {
+	if (sscanf(line, "%31s %d %ld %ld %ld %ld %lf %lf %lf %lx",
+		   sums[n].name, &sums[n].frames, &sums[n].bytes,
+		   &sums[n].bytesp50, &sums[n].bytesp95, &sums[n].bytesmax,
+		   &sums[n].cpumean, &sums[n].cpup95, &sums[n].parsemean,
+		   &sums[n].screenhash) == 10)
+	    ++n;
+    }
+    fclose(fp);
+    return n;
+}
+
+/* Display the command-line usage and exit.
+ */
+static void usage(int status)
+{
+    fputs("Usage: vtbench [-o FILE] [-b FILE] [-t PERCENT] [-s ROWSxCOLS]"
+	  " PROGRAM\n"
+	  "Run PROGRAM (ubrowse) on a pseudo-terminal and measure the output,\n"
+	  "CPU time, and emulator time of each frame.\n\n"
+	  "  -o FILE     Write the results to FILE (default vtbench.tsv).\n"
+	  "  -b FILE     Compare the results against the baseline in FILE.\n"
+	  "  -t PERCENT  Allowed increase in output volume (default 2).\n"
+	  "  -s RxC      Size of the terminal (default 24x80).\n",
+	  status ? stderr : stdout);
+    exit(status);
+}
+
+/* Run all of the scenarios, output the results, and compare them with
+ * the baseline. The exit status is non-zero if any scenario failed to
+ * run, or output more than the baseline allows.
+ */
+int main(int argc, char *argv[])
+{
+    enum { count = sizeof scenarios / sizeof *scenarios };
+    summary sums[count], baseline[count];
+    char const *outfile = "vtbench.tsv";
+    char const *basefile = NULL;
+    double tolerance = 2.0;
+    int rows = 24, cols = 80;
+    int basecount, failed, ch, i, j;
+    FILE *fp;
+
+    setlocale(LC_ALL, "");
+    if (!strstr(setlocale(LC_CTYPE, NULL), "UTF-8")
+			&& !strstr(setlocale(LC_CTYPE, NULL), "utf8"))
+	setlocale(LC_CTYPE, "C.UTF-8");
+    while ((ch = getopt(argc, argv, "o:b:t:s:h")) != -1) {
+	switch (ch) {
+	  case 'o':	outfile = optarg;			break;
+	  case 'b':	basefile = optarg;			break;
+	  case 't':	tolerance = atof(optarg);		break;
+	  case 's':
+	    if (sscanf(optarg, "%dx%d", &rows, &cols) != 2
+				|| rows < 4 || cols < 20)
+		usage(EXIT_FAILURE);
+	    break;
+	  case 'h':	usage(EXIT_SUCCESS);			break;
+	  default:	usage(EXIT_FAILURE);			break;
+	}
+    }
+    if (optind != argc - 1)
+	usage(EXIT_FAILURE);
+    signal(SIGPIPE, SIG_IGN);
+
+    basecount = 0;
+    if (basefile) {
+	basecount = readsummaries(basefile, baseline, count);
+	if (basecount < 0) {
+	    fprintf(stderr, "vtbench: %s: %s\n", basefile, strerror(errno));
+	    return EXIT_FAILURE;
+	}
+    }
+
+    failed = 0;
+    printf("%-14s %6s %9s %7s %7s %9s %9s %9s\n", "scenario", "frames",
+	   "bytes", "p50", "max", "cpu us", "parse us", "vs base");
+    for (i = 0 ; i < count ; ++i) {
+	if (!runscenario(argv[optind], &scenarios[i], rows, cols, &sums[i])) {
+	    printf("%-14s failed\n", scenarios[i].name);
+	    failed = 1;
+	    continue;
+	}
+	printf("%-14s %6d %9ld %7ld %7ld %9.1f %9.1f", sums[i].name,
+	       sums[i].frames, sums[i].bytes, sums[i].bytesp50,
+	       sums[i].bytesmax, sums[i].cpumean, sums[i].parsemean);
+	for (j = 0 ; j < basecount ; ++j)
+	    if (!strcmp(baseline[j].name, sums[i].name))
+		break;
+	if (j < basecount) {
+	    printf(" %+8.1f%%", baseline[j].bytes ?
+		   100.0 * (sums[i].bytes - baseline[j].bytes)
+			 / baseline[j].bytes : 0.0);
+	    if (sums[i].bytes > baseline[j].bytes * (1.0 + tolerance / 100)) {
+		printf("  REGRESSION");
+		failed = 1;
+	    }
+	    if (sums[i].screenhash != baseline[j].screenhash)
+		printf("  (final screen differs)");
+	}
+	putchar('\n');
+	fflush(stdout);
+    }
+
+    fp = fopen(outfile, "w");
+    if (!fp) {
+	fprintf(stderr, "vtbench: %s: %s\n", outfile, strerror(errno));
+	return EXIT_FAILURE;
+    }
+    fputs(resultsheading, fp);
+    for (i = 0 ; i < count ; ++i)
+	if (sums[i].frames)
+	    writesummary(fp, &sums[i]);
+    fclose(fp);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}